@@ -0,0 +1,530 @@
+// Measures the throughput and the caller latency of the loggers
+// for every combination of the given options, one result per line
+// as CSV (or JSON with -j) on stdout, progress on stderr.
+//
+// Usage: BLoggerBench [-j] [-l loggers] [-s sinks] [-t threads]
+//                     [-a argument counts] [-m message sizes]
+//                     [-n messages per thread] [-d directory] [-o output]
+//
+// Lists are comma separated, e.g. -l blocking,async -t 1,4
+// Loggers: blocking, async, spdlog, spdlog-async (the spdlog ones
+// need the BLOGGER_BENCH_SPDLOG CMake option)
+// Sinks: null, file (into -d, the current directory by default), stdout
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <BLogger/BLogger.h>
+
+#ifdef BLOGGER_BENCH_SPDLOG
+    #include <spdlog/spdlog.h>
+    #include <spdlog/async.h>
+    #include <spdlog/sinks/null_sink.h>
+    #include <spdlog/sinks/basic_file_sink.h>
+    #include <spdlog/sinks/stdout_sinks.h>
+#endif
+
+// Used by both the BLogger and the spdlog backend
+#define BLOGGER_BENCH_QUEUE_SIZE (1 << 16)
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Counts what reaches the sink so that the time an async logger
+// needs to drain its queue is part of the throughput. Forwards
+// to the wrapped sink, if there's one.
+class counting_sink : public BLogger::BaseSink
+{
+private:
+    std::unique_ptr<BLogger::BaseSink> m_Sink;
+    std::atomic<size_t>                m_Count;
+public:
+    explicit counting_sink(BLogger::BaseSink* sink)
+        : m_Sink(sink),
+        m_Count(0)
+    {
+    }
+
+    void write(BLogger::BLoggerLogMessage& msg) override
+    {
+        if (m_Sink)
+            m_Sink->write(msg);
+
+        m_Count.fetch_add(1, std::memory_order_release);
+    }
+
+    void write_batch(BLogger::BLoggerLogMessage* const* messages, size_t count) override
+    {
+        if (m_Sink)
+            m_Sink->write_batch(messages, count);
+
+        m_Count.fetch_add(count, std::memory_order_release);
+    }
+
+    void flush() override
+    {
+        if (m_Sink)
+            m_Sink->flush();
+    }
+
+    void set_tag(BLoggerInString tag) override
+    {
+        if (m_Sink)
+            m_Sink->set_tag(tag);
+    }
+
+    void set_single_writer(bool single_writer) override
+    {
+        BaseSink::set_single_writer(single_writer);
+
+        if (m_Sink)
+            m_Sink->set_single_writer(single_writer);
+    }
+
+    size_t count()
+    {
+        return m_Count.load(std::memory_order_acquire);
+    }
+};
+
+struct bench_options
+{
+    std::vector<std::string> loggers  { "blocking", "async" };
+    std::vector<std::string> sinks    { "null", "file" };
+    std::vector<size_t>      threads  { 1, 2, 4 };
+    std::vector<size_t>      args     { 0, 2, 4 };
+    std::vector<size_t>      sizes    { 16, 256 };
+    size_t                   messages = 100000;
+    std::string              directory = ".";
+    bool                     json = false;
+};
+
+struct bench_case
+{
+    std::string logger;
+    std::string sink;
+    size_t      threads;
+    size_t      args;
+    size_t      size;
+};
+
+struct bench_result
+{
+    size_t   messages;
+    double   seconds;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+// Runs one message through the logger, the arguments are
+// the same for every logger: an int, a double, a string
+// and an unsigned 64 bit integer, in that order
+template<typename LogT>
+void log_with_args(LogT&& log, size_t args, const char* format, size_t i)
+{
+    switch (args)
+    {
+    case 0: log(format); break;
+    case 1: log(format, static_cast<int>(i)); break;
+    case 2: log(format, static_cast<int>(i), 3.14159); break;
+    case 3: log(format, static_cast<int>(i), 3.14159, "argument"); break;
+    default: log(format, static_cast<int>(i), 3.14159, "argument", static_cast<uint64_t>(i) << 20); break;
+    }
+}
+
+// size characters of text followed by a {} for every argument
+static std::string make_format(size_t size, size_t args)
+{
+    std::string format;
+
+    for (size_t i = 0; i < size; i++)
+        format.push_back(static_cast<char>('a' + i % 26));
+
+    for (size_t i = 0; i < args; i++)
+        format += " {}";
+
+    return format;
+}
+
+// Every producer logs its messages and times each call,
+// returns the wall time from the first call until output
+// is drained and then sorts the latencies
+template<typename LogT, typename DrainT>
+bench_result run_producers(const bench_case& c, size_t messages, LogT log, DrainT drain)
+{
+    std::string format = make_format(c.size, c.args);
+    std::vector<std::vector<uint32_t>> latencies(c.threads);
+    std::vector<std::thread> producers;
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+
+    for (size_t t = 0; t < c.threads; t++)
+    {
+        producers.emplace_back([&, t]()
+        {
+            std::vector<uint32_t>& out = latencies[t];
+            out.resize(messages);
+
+            ready.fetch_add(1);
+
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            for (size_t i = 0; i < messages; i++)
+            {
+                auto begin = bench_clock::now();
+                log_with_args(log, c.args, format.c_str(), i);
+                auto end = bench_clock::now();
+
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+                out[i] = static_cast<uint32_t>((std::min)(ns, static_cast<decltype(ns)>(UINT32_MAX)));
+            }
+        });
+    }
+
+    while (ready.load() != c.threads)
+        std::this_thread::yield();
+
+    auto begin = bench_clock::now();
+    go.store(true, std::memory_order_release);
+
+    for (auto& producer : producers)
+        producer.join();
+
+    drain();
+
+    double seconds = std::chrono::duration<double>(bench_clock::now() - begin).count();
+
+    std::vector<uint32_t> all;
+    all.reserve(c.threads * messages);
+
+    for (auto& thread_latencies : latencies)
+        all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+
+    std::sort(all.begin(), all.end());
+
+    auto at = [&all](double quantile)
+    {
+        size_t index = static_cast<size_t>(quantile * static_cast<double>(all.size() - 1));
+        return static_cast<uint64_t>(all[index]);
+    };
+
+    return { all.size(), seconds, at(0.5), at(0.99), at(0.999), all.back() };
+}
+
+static BLogger::BaseSink* make_blogger_sink(const bench_case& c, const bench_options& options)
+{
+    if (c.sink == "file")
+        return new BLogger::FileSink(options.directory, "BLoggerBench", BLOGGER_INFINITE, 0);
+
+    if (c.sink == "stdout")
+        return new BLogger::BufferedStdoutSink(false);
+
+    return nullptr;
+}
+
+static bench_result run_blogger(const bench_case& c, const bench_options& options)
+{
+    std::shared_ptr<BLogger::BaseLogger> logger;
+
+    if (c.logger == "async")
+    {
+        auto async_logger = std::make_shared<AsyncLogger>("BLoggerBench", level::trace);
+
+        // every message has to make it to the sink to be counted
+        async_logger->SetOverflowPolicy(BLogger::overflow_policy::block);
+        logger = async_logger;
+    }
+    else
+        logger = std::make_shared<BlockingLogger>("BLoggerBench", level::trace);
+
+    counting_sink* sink = new counting_sink(make_blogger_sink(c, options));
+    logger->AddSink(sink);
+
+    size_t total = c.threads * options.messages;
+
+    bench_result result = run_producers(c, options.messages,
+        [&logger](const char* format, auto&&... args)
+        {
+            logger->Log(level::info, format, args...);
+        },
+        [&logger, sink, total]()
+        {
+            logger->Flush();
+
+            while (sink->count() < total)
+                std::this_thread::yield();
+        }
+    );
+
+    return result;
+}
+
+#ifdef BLOGGER_BENCH_SPDLOG
+static bench_result run_spdlog(const bench_case& c, const bench_options& options)
+{
+    spdlog::sink_ptr sink;
+
+    if (c.sink == "file")
+        sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(options.directory + "/spdlog-bench.txt", true);
+    else if (c.sink == "stdout")
+        sink = std::make_shared<spdlog::sinks::stdout_sink_mt>();
+    else
+        sink = std::make_shared<spdlog::sinks::null_sink_mt>();
+
+    std::shared_ptr<spdlog::logger> logger;
+    std::shared_ptr<spdlog::details::thread_pool> pool;
+
+    if (c.logger == "spdlog-async")
+    {
+        pool = std::make_shared<spdlog::details::thread_pool>(BLOGGER_BENCH_QUEUE_SIZE, 1);
+        logger = std::make_shared<spdlog::async_logger>(
+            "BLoggerBench", sink, pool, spdlog::async_overflow_policy::block
+        );
+    }
+    else
+        logger = std::make_shared<spdlog::logger>("BLoggerBench", sink);
+
+    // the same as BLOGGER_DEFAULT_PATTERN
+    logger->set_pattern("[%H:%M:%S][%l][%n] %v");
+
+    bench_result result = run_producers(c, options.messages,
+        [&logger](const char* format, auto&&... args)
+        {
+#if defined(FMT_VERSION) && FMT_VERSION >= 80000
+            logger->log(spdlog::level::info, fmt::runtime(format), args...);
+#else
+            logger->log(spdlog::level::info, format, args...);
+#endif
+        },
+        [&logger, &pool]()
+        {
+            logger->flush();
+
+            // the pool only finishes its queue when it's destroyed
+            logger.reset();
+            pool.reset();
+        }
+    );
+
+    return result;
+}
+#endif
+
+static bool is_blogger(const std::string& logger)
+{
+    return logger == "blocking" || logger == "async";
+}
+
+static bool is_known_logger(const std::string& logger)
+{
+#ifdef BLOGGER_BENCH_SPDLOG
+    if (logger == "spdlog" || logger == "spdlog-async")
+        return true;
+#endif
+
+    return is_blogger(logger);
+}
+
+static bool is_known_sink(const std::string& sink)
+{
+    return sink == "null" || sink == "file" || sink == "stdout";
+}
+
+static bench_result run_case(const bench_case& c, const bench_options& options)
+{
+#ifdef BLOGGER_BENCH_SPDLOG
+    if (!is_blogger(c.logger))
+        return run_spdlog(c, options);
+#endif
+
+    return run_blogger(c, options);
+}
+
+static void print_header(FILE* out, const bench_options& options)
+{
+    if (!options.json)
+        fprintf(out, "logger,sink,threads,args,size,messages,seconds,msgs_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+}
+
+static void print_result(FILE* out, const bench_options& options, const bench_case& c, const bench_result& r)
+{
+    double rate = r.seconds > 0 ? static_cast<double>(r.messages) / r.seconds : 0;
+
+    if (options.json)
+    {
+        fprintf(out,
+            "{\"logger\":\"%s\",\"sink\":\"%s\",\"threads\":%zu,\"args\":%zu,\"size\":%zu,"
+            "\"messages\":%zu,\"seconds\":%.6f,\"msgs_per_sec\":%.0f,\"p50_ns\":%llu,"
+            "\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}\n",
+            c.logger.c_str(), c.sink.c_str(), c.threads, c.args, c.size,
+            r.messages, r.seconds, rate,
+            static_cast<unsigned long long>(r.p50), static_cast<unsigned long long>(r.p99),
+            static_cast<unsigned long long>(r.p999), static_cast<unsigned long long>(r.max)
+        );
+    }
+    else
+    {
+        fprintf(out, "%s,%s,%zu,%zu,%zu,%zu,%.6f,%.0f,%llu,%llu,%llu,%llu\n",
+            c.logger.c_str(), c.sink.c_str(), c.threads, c.args, c.size,
+            r.messages, r.seconds, rate,
+            static_cast<unsigned long long>(r.p50), static_cast<unsigned long long>(r.p99),
+            static_cast<unsigned long long>(r.p999), static_cast<unsigned long long>(r.max)
+        );
+    }
+
+    fflush(out);
+}
+
+static std::vector<std::string> split(const char* list)
+{
+    std::vector<std::string> out;
+    std::string item;
+
+    for (const char* c = list; ; c++)
+    {
+        if (*c == ',' || !*c)
+        {
+            if (!item.empty())
+                out.push_back(item);
+
+            item.clear();
+
+            if (!*c)
+                return out;
+        }
+        else
+            item.push_back(*c);
+    }
+}
+
+static std::vector<size_t> split_numbers(const char* list)
+{
+    std::vector<size_t> out;
+
+    for (auto& item : split(list))
+        out.push_back(static_cast<size_t>(strtoull(item.c_str(), nullptr, 10)));
+
+    return out;
+}
+
+static void print_usage()
+{
+    fprintf(stderr,
+        "Usage: BLoggerBench [-j] [-l loggers] [-s sinks] [-t threads] [-a argument counts]\n"
+        "                    [-m message sizes] [-n messages per thread] [-d directory] [-o output]\n"
+        "Loggers: blocking, async"
+#ifdef BLOGGER_BENCH_SPDLOG
+        ", spdlog, spdlog-async"
+#endif
+        "\n"
+        "Sinks: null, file, stdout\n"
+        "-j prints JSON lines instead of CSV\n"
+        "The defaults are -l blocking,async -s null,file -t 1,2,4 -a 0,2,4 -m 16,256 -n 100000\n"
+    );
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    const char* output_path = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-j"))
+            options.json = true;
+        else if (!strcmp(argv[i], "-l") && has_value)
+            options.loggers = split(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && has_value)
+            options.sinks = split(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && has_value)
+            options.threads = split_numbers(argv[++i]);
+        else if (!strcmp(argv[i], "-a") && has_value)
+            options.args = split_numbers(argv[++i]);
+        else if (!strcmp(argv[i], "-m") && has_value)
+            options.sizes = split_numbers(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && has_value)
+            options.messages = static_cast<size_t>(strtoull(argv[++i], nullptr, 10));
+        else if (!strcmp(argv[i], "-d") && has_value)
+            options.directory = argv[++i];
+        else if (!strcmp(argv[i], "-o") && has_value)
+            output_path = argv[++i];
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (!options.messages)
+    {
+        print_usage();
+        return 1;
+    }
+
+    for (auto& logger : options.loggers)
+    {
+        if (!is_known_logger(logger))
+        {
+            fprintf(stderr, "BLoggerBench: unknown logger %s\n", logger.c_str());
+            return 1;
+        }
+    }
+
+    for (auto& sink : options.sinks)
+    {
+        if (!is_known_sink(sink))
+        {
+            fprintf(stderr, "BLoggerBench: unknown sink %s\n", sink.c_str());
+            return 1;
+        }
+    }
+
+    FILE* out = output_path ? fopen(output_path, "w") : stdout;
+
+    if (!out)
+    {
+        fprintf(stderr, "BLoggerBench: can't open %s\n", output_path);
+        return 1;
+    }
+
+    // a queue large enough for the backend to
+    // keep up instead of blocking the producers
+    BLogger::thread_pool_props props;
+    props.queue_capacity = BLOGGER_BENCH_QUEUE_SIZE;
+    BLogger::thread_pool::configure(props);
+
+    print_header(out, options);
+
+    for (auto& logger : options.loggers)
+    for (auto& sink : options.sinks)
+    for (auto threads : options.threads)
+    for (auto args : options.args)
+    for (auto size : options.sizes)
+    {
+        bench_case c = { logger, sink, threads ? threads : 1, (std::min)(args, static_cast<size_t>(4)), size };
+
+        fprintf(stderr, "%s/%s: %zu threads, %zu args, %zu bytes\n",
+            c.logger.c_str(), c.sink.c_str(), c.threads, c.args, c.size);
+
+        print_result(out, options, c, run_case(c, options));
+    }
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
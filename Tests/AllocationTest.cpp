@@ -0,0 +1,239 @@
+// Logs from several threads until the message memory pools are
+// warmed up and then counts every allocation made while the same
+// messages are logged again, on the logging threads and the backend.
+// Steady state logging has to reuse the pooled chunks. A thread can
+// still run dry while other threads hold on to their cached chunks,
+// so up to a full cache per thread may come from malloc, but never
+// anything that grows with the number of messages. Exits with 1
+// (and says why on stderr) otherwise.
+//
+// operator new is always counted, malloc only on glibc, where
+// it can be wrapped through __libc_malloc.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <BLogger/BLogger.h>
+
+#define ALLOCATION_TEST_THREADS  4
+#define ALLOCATION_TEST_MESSAGES 50000 // per thread and phase
+
+// the logging threads and the backend
+#define ALLOCATION_TEST_MAX_ALLOCATIONS ((ALLOCATION_TEST_THREADS + 1) * BLOGGER_CACHED_CHUNKS)
+
+static std::atomic<bool>   s_Counting(false);
+static std::atomic<size_t> s_Allocations(0);
+
+static void count_allocation()
+{
+    if (s_Counting.load(std::memory_order_relaxed))
+        s_Allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* memory, size_t size);
+    void  __libc_free(void* memory);
+
+    void* malloc(size_t size)
+    {
+        count_allocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        count_allocation();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* memory, size_t size)
+    {
+        count_allocation();
+        return __libc_realloc(memory, size);
+    }
+
+    void free(void* memory)
+    {
+        __libc_free(memory);
+    }
+}
+
+    #define ALLOCATION_TEST_ALLOC(size) __libc_malloc(size)
+    #define ALLOCATION_TEST_FREE(memory) __libc_free(memory)
+#else
+    #define ALLOCATION_TEST_ALLOC(size) std::malloc(size)
+    #define ALLOCATION_TEST_FREE(memory) std::free(memory)
+#endif
+
+void* operator new(size_t size)
+{
+    count_allocation();
+
+    void* memory = ALLOCATION_TEST_ALLOC(size ? size : 1);
+
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    ALLOCATION_TEST_FREE(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    ALLOCATION_TEST_FREE(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    ALLOCATION_TEST_FREE(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    ALLOCATION_TEST_FREE(memory);
+}
+
+// Only counts, so that the sink itself doesn't allocate
+class null_sink : public BLogger::BaseSink
+{
+public:
+    std::atomic<size_t> writes;
+public:
+    null_sink()
+        : writes(0)
+    {
+    }
+
+    void write(BLogger::BLoggerLogMessage&) override
+    {
+        writes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush() override
+    {
+    }
+};
+
+// Short and long (overflowing the inline buffer) messages,
+// stringified, formatted built-in and deferred arguments
+static void log_messages(AsyncLogger& logger, const std::string& long_text)
+{
+    for (size_t i = 0; i < ALLOCATION_TEST_MESSAGES; i++)
+    {
+        switch (i % 4)
+        {
+        case 0: logger.Info("short {} {}", i, 2.5); break;
+        case 1: logger.Warning("long {} {}", long_text, i); break;
+        case 2: logger.Error("string argument {}", "literal"); break;
+        case 3: logger.Debug("{1} before {0}", i, long_text.c_str()); break;
+        }
+    }
+}
+
+int main()
+{
+    BLogger::thread_pool_props props;
+    props.thread_count = BLOGGER_SINGLE_CONSUMER;
+    BLogger::thread_pool::create("allocation-test", props);
+
+    AsyncLogger logger(
+        "allocation-test",
+        level::trace,
+        true,
+        BLogger::thread_pool::get("allocation-test")
+    );
+    logger.SetOverflowPolicy(BLogger::overflow_policy::block);
+
+    auto sink = new null_sink();
+    logger.AddSink(sink);
+
+    std::string long_text(2 * BLOGGER_INLINE_BUFFER_SIZE, 'x');
+
+    std::atomic<size_t> warmed_up(0);
+    std::atomic<size_t> finished(0);
+    std::atomic<bool>   measure(false);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < ALLOCATION_TEST_THREADS; i++)
+    {
+        threads.emplace_back(
+            [&]()
+            {
+                log_messages(logger, long_text);
+                warmed_up.fetch_add(1);
+
+                while (!measure.load())
+                    std::this_thread::yield();
+
+                log_messages(logger, long_text);
+                finished.fetch_add(1);
+            }
+        );
+    }
+
+    while (warmed_up.load() != ALLOCATION_TEST_THREADS)
+        std::this_thread::yield();
+
+    // the backend has recycled everything the warm up posted
+    if (!logger.Flush(std::chrono::seconds(10)))
+    {
+        fprintf(stderr, "the warm up wasn't written in time\n");
+        return 1;
+    }
+
+    s_Counting.store(true);
+    measure.store(true);
+
+    while (finished.load() != ALLOCATION_TEST_THREADS)
+        std::this_thread::yield();
+
+    // Flush(timeout) allocates its ack, so it's only
+    // called once the logging threads are done
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    size_t expected = 2 * ALLOCATION_TEST_THREADS * ALLOCATION_TEST_MESSAGES;
+
+    while (sink->writes.load() != expected && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+
+    s_Counting.store(false);
+
+    for (auto& thread : threads)
+        thread.join();
+
+    size_t allocations = s_Allocations.load();
+
+    if (sink->writes.load() != expected)
+    {
+        fprintf(stderr, "%zu of %zu messages were written\n", sink->writes.load(), expected);
+        return 1;
+    }
+
+    if (allocations > ALLOCATION_TEST_MAX_ALLOCATIONS)
+    {
+        fprintf(stderr, "%zu allocations while logging %d messages, expected at most %d\n",
+            allocations, ALLOCATION_TEST_THREADS * ALLOCATION_TEST_MESSAGES, ALLOCATION_TEST_MAX_ALLOCATIONS);
+        return 1;
+    }
+
+    printf("%zu allocations while logging %d messages\n", allocations, ALLOCATION_TEST_THREADS * ALLOCATION_TEST_MESSAGES);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Feeds binary_log_reader a well formed log, every truncation of
+// it and logs with malformed records. The well formed one has to
+// decode, the rest have to be rejected without crashing (run it
+// with -fsanitize=address to be sure). Exits with 1 (and says why
+// on stderr) otherwise.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <BLogger/BLogger.h>
+#include <BLogger/Formatter/BinaryFormat.h>
+
+// format 0 "value {}", a message using it with 42 and a text record
+static const std::string s_ValidLog(
+    "BLOGBIN1"
+    "\x01\x00\x08" "value {}"
+    "\x02\x00\x00\x02\x00\x02\x04\x2a"
+    "\x03\x00\x03\x00\x02" "hi",
+    34
+);
+
+struct malformed_log
+{
+    const char* what;
+    std::string data;
+};
+
+static bool decode(const std::string& data, std::vector<std::string>& lines)
+{
+    BLogger::binary_log_reader reader("{msg}");
+
+    return reader.read(data.data(), data.size(),
+        [&lines](const char* line, size_t size)
+        {
+            lines.emplace_back(line, size);
+        }
+    );
+}
+
+int main()
+{
+    std::vector<std::string> lines;
+
+    if (!decode(s_ValidLog, lines) || lines.size() != 2 || lines[0] != "value 42\n" || lines[1] != "hi\n")
+    {
+        fprintf(stderr, "the well formed log didn't decode\n");
+        return 1;
+    }
+
+    // the magic on its own is an empty log
+    for (size_t size = BLOGGER_BINARY_MAGIC_SIZE + 1; size < s_ValidLog.size(); size++)
+    {
+        lines.clear();
+
+        if (size == 19 || size == 27)
+            continue; // between two records
+
+        if (decode(s_ValidLog.substr(0, size), lines))
+        {
+            fprintf(stderr, "the log truncated to %zu bytes decoded\n", size);
+            return 1;
+        }
+    }
+
+    std::vector<malformed_log> logs = {
+        { "a level above crit",       std::string("BLOGBIN1\x03\x00\x09\x00\x02hi", 14) },
+        { "a format id far ahead",    std::string("BLOGBIN1\x01\xff\xff\xff\xff\x0f\x02{}", 17) },
+        { "an undefined format",      std::string("BLOGBIN1\x02\x05\x00\x02\x00\x02\x04\x2a", 16) },
+        { "an unknown argument type", std::string("BLOGBIN1\x01\x00\x02{}\x02\x00\x00\x02\x00\x02\x7f\x2a", 21) },
+        { "an unknown record",        std::string("BLOGBIN1\x7f", 9) },
+        { "a runaway varint",         std::string("BLOGBIN1\x03\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff", 20) },
+        { "a string past the end",    std::string("BLOGBIN1\x04\x7fhi", 12) }
+    };
+
+    for (auto& log : logs)
+    {
+        lines.clear();
+
+        if (decode(log.data, lines))
+        {
+            fprintf(stderr, "a log with %s decoded\n", log.what);
+            return 1;
+        }
+    }
+
+    printf("%zu truncated and %zu malformed logs rejected\n",
+        s_ValidLog.size() - BLOGGER_BINARY_MAGIC_SIZE - 3, logs.size());
+
+    return 0;
+}
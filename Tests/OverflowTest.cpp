@@ -0,0 +1,178 @@
+// Floods a small drop_oldest queue from several threads while
+// flushes are interleaved. Every flush has to reach the sink, a
+// Flush(timeout) that returns true has to have flushed it, and
+// every message has to be either written or counted as dropped.
+// Loggers that are destroyed with a flush still queued must not
+// crash the backend (run it with -fsanitize=address to be sure).
+// Exits with 1 (and says why on stderr) otherwise.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <BLogger/BLogger.h>
+
+#define OVERFLOW_TEST_QUEUE_SIZE 256
+#define OVERFLOW_TEST_PRODUCERS  3
+#define OVERFLOW_TEST_FLUSHES    200
+
+typedef std::chrono::steady_clock test_clock;
+
+// Slow enough for the queue to stay full
+class slow_sink : public BLogger::BaseSink
+{
+public:
+    std::atomic<size_t> writes;
+    std::atomic<size_t> flushes;
+public:
+    slow_sink()
+        : writes(0),
+        flushes(0)
+    {
+    }
+
+    void write(BLogger::BLoggerLogMessage&) override
+    {
+        auto until = test_clock::now() + std::chrono::microseconds(5);
+
+        while (test_clock::now() < until)
+        {
+        }
+
+        writes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush() override
+    {
+        flushes.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+int main()
+{
+    BLogger::thread_pool_props props;
+    props.queue_capacity = OVERFLOW_TEST_QUEUE_SIZE;
+    props.thread_count = BLOGGER_SINGLE_CONSUMER;
+    BLogger::thread_pool::create("overflow-test", props);
+
+    AsyncLogger logger(
+        "overflow-test",
+        level::trace,
+        true,
+        BLogger::thread_pool::get("overflow-test")
+    );
+    logger.SetOverflowPolicy(BLogger::overflow_policy::drop_oldest);
+
+    auto sink = new slow_sink();
+    logger.AddSink(sink);
+
+    std::atomic<bool> flooding(true);
+    std::atomic<size_t> posted(0);
+    std::vector<std::thread> producers;
+
+    for (size_t i = 0; i < OVERFLOW_TEST_PRODUCERS; i++)
+    {
+        producers.emplace_back(
+            [&logger, &flooding, &posted]()
+            {
+                while (flooding.load(std::memory_order_relaxed))
+                {
+                    logger.Info("flooding the queue {}", 42);
+                    posted.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        );
+    }
+
+    for (size_t i = 0; i < OVERFLOW_TEST_FLUSHES; i++)
+    {
+        logger.Flush();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // the ones above might still be queued, so each synchronous
+    // flush has to add at least one to what the sink has seen
+    size_t synchronous = 0;
+
+    for (size_t i = 0; i < OVERFLOW_TEST_FLUSHES; i++)
+    {
+        size_t before = sink->flushes.load();
+
+        if (!logger.Flush(std::chrono::seconds(5)))
+        {
+            fprintf(stderr, "Flush(timeout) %zu timed out\n", i);
+            flooding.store(false, std::memory_order_relaxed);
+            break;
+        }
+
+        if (sink->flushes.load() <= before)
+        {
+            fprintf(stderr, "Flush(timeout) %zu returned before the sink was flushed\n", i);
+            flooding.store(false, std::memory_order_relaxed);
+            break;
+        }
+
+        synchronous++;
+    }
+
+    // loggers that queue a flush and go away right after, the
+    // flush tasks requeued by drop_oldest outlive their loggers
+    for (size_t i = 0; i < OVERFLOW_TEST_FLUSHES; i++)
+    {
+        AsyncLogger short_lived(
+            "short-lived",
+            level::trace,
+            true,
+            BLogger::thread_pool::get("overflow-test")
+        );
+
+        short_lived.AddSink(new slow_sink());
+        short_lived.Flush();
+    }
+
+    flooding.store(false, std::memory_order_relaxed);
+
+    for (auto& producer : producers)
+        producer.join();
+
+    auto deadline = test_clock::now() + std::chrono::seconds(10);
+
+    auto done = [&]()
+    {
+        return sink->flushes.load() >= 2 * OVERFLOW_TEST_FLUSHES &&
+               sink->writes.load() + logger.OverflowStats().dropped_oldest >= posted.load();
+    };
+
+    while (!done() && test_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    auto dropped = logger.OverflowStats().dropped_oldest;
+
+    if (synchronous != OVERFLOW_TEST_FLUSHES)
+        return 1;
+
+    if (sink->flushes.load() != 2 * OVERFLOW_TEST_FLUSHES)
+    {
+        fprintf(stderr, "%zu of %d flushes reached the sink\n", sink->flushes.load(), 2 * OVERFLOW_TEST_FLUSHES);
+        return 1;
+    }
+
+    if (sink->writes.load() + dropped != posted.load())
+    {
+        fprintf(stderr, "%zu messages posted, %zu written and %zu dropped\n",
+            posted.load(), sink->writes.load(), dropped);
+        return 1;
+    }
+
+    if (!dropped)
+    {
+        fprintf(stderr, "the queue never overflowed\n");
+        return 1;
+    }
+
+    printf("%d flushes, %zu messages dropped\n", 2 * OVERFLOW_TEST_FLUSHES, dropped);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Turns the files written by BinaryFileSink back into text,
+// or with -j prints the messages left pending in a crash journal
+//
+// Usage: blogger-decode [-j] [-p pattern] [-t timestamp format] files...
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <BLogger/BLogger.h>
+#include <BLogger/Sinks/BinaryFileSink.h>
+#include <BLogger/Loggers/CrashJournal.h>
+
+static void print_line(const char* line, size_t size)
+{
+    fwrite(line, 1, size, stdout);
+}
+
+static bool recover_journal(const char* path, const char* pattern, const char* timestamp_format)
+{
+    size_t broken = 0;
+
+    if (!BLogger::crash_journal::recover(path, pattern, timestamp_format, print_line, &broken))
+    {
+        fprintf(stderr, "blogger-decode: %s is not a crash journal\n", path);
+        return false;
+    }
+
+    if (broken)
+        fprintf(stderr, "blogger-decode: skipped %zu torn messages in %s\n", broken, path);
+
+    return true;
+}
+
+static void print_usage()
+{
+    fprintf(stderr,
+        "Usage: blogger-decode [-j] [-p pattern] [-t timestamp format] files...\n"
+        "-j reads crash journals (see thread_pool_props::journal_path)\n"
+        "The defaults are \"%s\" and \"%s\"\n",
+        BLOGGER_DEFAULT_PATTERN,
+        BLOGGER_TIMESTAMP
+    );
+}
+
+int main(int argc, char** argv)
+{
+    const char* pattern = BLOGGER_DEFAULT_PATTERN;
+    const char* timestamp_format = BLOGGER_TIMESTAMP;
+    bool journal = false;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            pattern = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            timestamp_format = argv[++i];
+        else if (!strcmp(argv[i], "-j"))
+            journal = true;
+        else if (argv[i][0] == '-')
+        {
+            print_usage();
+            return 1;
+        }
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (paths.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    int result = 0;
+
+    for (auto path : paths)
+    {
+        if (journal)
+        {
+            if (!recover_journal(path, pattern, timestamp_format))
+                result = 1;
+
+            continue;
+        }
+
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file)
+        {
+            fprintf(stderr, "blogger-decode: can't open %s\n", path);
+            result = 1;
+            continue;
+        }
+
+        std::vector<char> data(
+            (std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>()
+        );
+
+        BLogger::binary_log_reader reader(pattern, timestamp_format);
+
+        bool complete = reader.read(data.data(), data.size(), print_line);
+
+        if (!complete)
+        {
+            fprintf(stderr, "blogger-decode: %s is truncated, malformed or not a binary log\n", path);
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -8,6 +8,11 @@
 */ 
 #include "Loggers/BaseLogger.h"
 
+/* BLOGGER_TRACE(logger, ...) and friends,
+   see BLOGGER_ACTIVE_LEVEL.
+*/
+#include "LogMacros.h"
+
 /* Blocking version of BLogger.
    All logging happens on a
    single thread.
@@ -21,6 +26,46 @@
 */
 #include "Loggers/AsyncLogger.h"
 
+/* A sink that sends syslog or binary
+   records over udp/tcp.
+*/
+#include "Sinks/NetworkSink.h"
+
+/* Runs a sink on a queue and
+   a thread of its own.
+*/
+#include "Sinks/DedicatedSink.h"
+
+/* A console sink that writes every
+   batch to stdout with a single call.
+*/
+#include "Sinks/BufferedStdoutSink.h"
+
+/* A lock-free file sink that writes
+   into preallocated memory mapped files.
+*/
+#include "Sinks/MappedFileSink.h"
+
+/* A file sink that writes aligned pages
+   with O_DIRECT and io_uring on Linux.
+*/
+#include "Sinks/DirectFileSink.h"
+
+/* A file sink that writes zstd/lz4 frames,
+   see BLOGGER_USE_ZSTD and BLOGGER_USE_LZ4.
+*/
+#include "Sinks/CompressedFileSink.h"
+
+/* A file sink that writes compact binary
+   records, decoded by blogger-decode.
+*/
+#include "Sinks/BinaryFileSink.h"
+
+/* Queue, drop and sink latency stats
+   in the Prometheus text format.
+*/
+#include "Stats/Prometheus.h"
+
 // ---- Convenient typedefs ----
 typedef BLogger::BlockingLogger              BlockingLogger;
 typedef BLogger::AsyncLogger                 AsyncLogger;
@@ -33,31 +78,80 @@ typedef std::shared_ptr<BLogger::BaseLogger> BLoggerPtr;
 struct BLoggerProps
 {
     bool async;
+    BLogger::overflow_policy overflow;
+    size_t sample_rate;
+    bool deferred_format;
+    BLoggerString pool;
+    size_t staging_bytes;
+    size_t staging_delay_ms;
 
     bool console_logger;
     bool colored;
     BLoggerString tag;
     BLoggerString pattern;
+    BLoggerString timestamp_format;
     level filter;
+    level console_filter;
+    bool dedicated_sinks;
 
     bool file_logger;
+    level file_filter;
     BLoggerString path;
     size_t bytes_per_file;
     size_t log_files;
     bool rotate_logs;
+    BLogger::rotation_interval rotate_every;
+    BLogger::rotation_callback on_rotated;
+    bool memory_mapped;
+    bool direct_io;
+    BLogger::sync_policy fsync;
+    size_t fsync_interval_ms;
+    BLogger::compression_codec compression;
+    int compression_level;
+    bool binary;
+
+    BLoggerString network_host;
+    uint16_t network_port;
+    BLogger::network_protocol network_protocol;
+    BLogger::network_format network_format;
+    level network_filter;
 
     BLoggerProps()
         : async(true),
+        overflow(BLogger::overflow_policy::drop_oldest),
+        sample_rate(BLOGGER_DEFAULT_SAMPLE_RATE),
+        deferred_format(false),
+        pool(""),
+        staging_bytes(0),
+        staging_delay_ms(BLOGGER_STAGING_DELAY_MS),
         console_logger(true),
         colored(true),
         tag("Unnamed"),
         pattern(""),
+        timestamp_format(BLOGGER_TIMESTAMP),
         filter(level::trace),
+        console_filter(level::trace),
+        dedicated_sinks(false),
         file_logger(false),
+        file_filter(level::trace),
         path(""),
         bytes_per_file(BLOGGER_INFINITE),
         log_files(0),
-        rotate_logs(true)
+        rotate_logs(true),
+        rotate_every(BLogger::rotation_interval::none),
+        on_rotated(),
+        memory_mapped(false),
+        direct_io(false),
+        fsync(BLogger::sync_policy::never),
+        fsync_interval_ms(1000),
+        compression(BLogger::compression_codec::none),
+        compression_level(0),
+        binary(false),
+        network_host(""),
+        network_port(514),
+        network_protocol(BLogger::network_protocol::udp),
+        network_format(BLogger::network_format::syslog),
+        network_filter(level::trace)
     {
     }
 };
@@ -71,18 +165,45 @@ public:
         BLoggerPtr out_logger;
 
         if (props.async)
-            out_logger = std::make_shared<AsyncLogger>(
+        {
+            auto async_logger = std::make_shared<AsyncLogger>(
                 props.tag,
                 props.filter,
-                props.pattern.empty()
+                props.pattern.empty(),
+                BLogger::thread_pool::get(props.pool)
+            );
+
+            async_logger->SetOverflowPolicy(props.overflow, props.sample_rate);
+
+            // Binary sinks only defer for the format ids, the
+            // formats are copied unless deferral was asked for
+            bool binary = props.binary ||
+                (!props.network_host.empty() && props.network_format == BLogger::network_format::binary);
+
+            async_logger->SetDeferredFormatting(
+                props.deferred_format || binary,
+                !props.deferred_format
             );
+            out_logger = async_logger;
+        }
         else
-            out_logger = std::make_shared<BlockingLogger>(
+        {
+            auto blocking_logger = std::make_shared<BlockingLogger>(
                 props.tag,
                 props.filter,
                 props.pattern.empty()
             );
 
+            blocking_logger->SetStaging(
+                props.staging_bytes,
+                std::chrono::milliseconds(props.staging_delay_ms)
+            );
+            out_logger = blocking_logger;
+        }
+
+        if (props.timestamp_format != BLOGGER_TIMESTAMP)
+            out_logger->SetTimestampFormat(props.timestamp_format);
+
         if (!props.pattern.empty())
             out_logger->SetPattern(props.pattern);
 
@@ -90,18 +211,23 @@ public:
 
         if (props.console_logger)
         {
-            if (props.colored)
-                out_logger->AddSink(new BLogger::ColoredStdoutSink());
-            else
-                out_logger->AddSink(new BLogger::StdoutSink());
+            AddSink(
+                out_logger, props, props.console_filter,
+                new BLogger::BufferedStdoutSink(props.colored)
+            );
         }
 
         if (props.file_logger)
         {
-            if (!props.path.empty())
+            bool compressed =
+                props.compression != BLogger::compression_codec::none &&
+                BLogger::CompressedFileSink::is_supported(props.compression);
+
+            if (!props.path.empty() && props.binary)
             {
-                out_logger->AddSink(
-                    new BLogger::FileSink(
+                AddSink(
+                    out_logger, props, props.file_filter,
+                    new BLogger::BinaryFileSink(
                         props.path, props.tag,
                         props.bytes_per_file,
                         props.log_files,
@@ -109,6 +235,74 @@ public:
                     )
                 );
             }
+            else if (!props.path.empty() && compressed)
+            {
+                AddSink(
+                    out_logger, props, props.file_filter,
+                    new BLogger::CompressedFileSink(
+                        props.path, props.tag,
+                        props.bytes_per_file,
+                        props.log_files,
+                        props.rotate_logs,
+                        props.compression,
+                        props.compression_level
+                    )
+                );
+            }
+            else if (!props.path.empty() && props.memory_mapped)
+            {
+                AddSink(
+                    out_logger, props, props.file_filter,
+                    new BLogger::MappedFileSink(
+                        props.path, props.tag,
+                        props.bytes_per_file,
+                        props.log_files,
+                        props.rotate_logs
+                    )
+                );
+            }
+            else if (!props.path.empty() && props.direct_io)
+            {
+                AddSink(
+                    out_logger, props, props.file_filter,
+                    new BLogger::DirectFileSink(
+                        props.path, props.tag,
+                        props.bytes_per_file,
+                        props.log_files,
+                        props.rotate_logs,
+                        props.fsync,
+                        std::chrono::milliseconds(props.fsync_interval_ms)
+                    )
+                );
+            }
+            else if (!props.path.empty())
+            {
+                AddSink(
+                    out_logger, props, props.file_filter,
+                    new BLogger::FileSink(
+                        props.path, props.tag,
+                        props.bytes_per_file,
+                        props.log_files,
+                        props.rotate_logs,
+                        props.rotate_every,
+                        props.on_rotated
+                    )
+                );
+            }
+        }
+
+        if (!props.network_host.empty())
+        {
+            AddSink(
+                out_logger, props, props.network_filter,
+                new BLogger::NetworkSink(
+                    props.network_host,
+                    props.network_port,
+                    props.tag,
+                    props.network_protocol,
+                    props.network_format
+                )
+            );
         }
 
         return out_logger;
@@ -128,10 +322,7 @@ public:
                 default_pattern
             );
 
-        if (colored)
-            out_logger->AddSink(new BLogger::ColoredStdoutSink());
-        else
-            out_logger->AddSink(new BLogger::StdoutSink());
+        out_logger->AddSink(new BLogger::BufferedStdoutSink(colored));
 
         return out_logger;
     }
@@ -150,11 +341,23 @@ public:
                 default_pattern
             );
 
-        if (colored)
-            out_logger->AddSink(new BLogger::ColoredStdoutSink());
-        else
-            out_logger->AddSink(new BLogger::StdoutSink());
+        out_logger->AddSink(new BLogger::BufferedStdoutSink(colored));
 
         return out_logger;
     }
+private:
+    static void AddSink(
+        BLoggerPtr& logger,
+        const BLoggerProps& props,
+        level filter,
+        BLogger::BaseSink* sink
+    )
+    {
+        sink->set_filter(filter);
+
+        if (props.dedicated_sinks)
+            sink = new BLogger::DedicatedSink(sink);
+
+        logger->AddSink(sink);
+    }
 };
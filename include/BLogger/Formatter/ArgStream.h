@@ -0,0 +1,118 @@
+#pragma once
+
+#include <ostream>
+#include <streambuf>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+#include "BLogger/Formatter/SmallBuffer.h"
+
+namespace BLogger {
+
+    // A streambuf that appends straight into a message buffer
+    class buffer_streambuf : public std::basic_streambuf<bl_char>
+    {
+    private:
+        typedef std::basic_streambuf<bl_char> base;
+
+        BLoggerMessageBuffer m_Buffer;
+    public:
+        BLoggerMessageBuffer& buffer()
+        {
+            return m_Buffer;
+        }
+    protected:
+        std::streamsize xsputn(const bl_char* data, std::streamsize size) override
+        {
+            m_Buffer.append(data, static_cast<size_t>(size));
+            return size;
+        }
+
+        base::int_type overflow(base::int_type c) override
+        {
+            if (!base::traits_type::eq_int_type(c, base::traits_type::eof()))
+                m_Buffer.push_back(base::traits_type::to_char_type(c));
+
+            return base::traits_type::not_eof(c);
+        }
+    };
+
+    // Every thread stringifies its arguments through one
+    // long-lived stream instead of constructing a stringstream
+    // (and its string) per argument, so once the scratch buffer
+    // has grown to fit the largest argument no more memory is
+    // allocated. The scope resets the stream state so that
+    // manipulators used inside of operator<< don't leak
+    // into the next argument.
+    class arg_stream
+    {
+    private:
+        struct state
+        {
+            buffer_streambuf           buffer;
+            std::basic_ostream<bl_char> stream;
+            bool                       in_use;
+
+            state()
+                : buffer(),
+                stream(&buffer),
+                in_use(false)
+            {
+            }
+        };
+
+        state* m_State;
+    public:
+        arg_stream()
+            : m_State(&get_state())
+        {
+            // operator<< of a user type logged something itself
+            if (m_State->in_use)
+                m_State = new state();
+
+            m_State->in_use = true;
+            m_State->buffer.buffer().clear();
+        }
+
+        arg_stream(const arg_stream& other) = delete;
+        arg_stream& operator=(const arg_stream& other) = delete;
+
+        std::basic_ostream<bl_char>& stream()
+        {
+            return m_State->stream;
+        }
+
+        const bl_char* data()
+        {
+            return m_State->buffer.buffer().data();
+        }
+
+        size_t size()
+        {
+            return m_State->buffer.buffer().size();
+        }
+
+        ~arg_stream()
+        {
+            if (m_State != &get_state())
+            {
+                delete m_State;
+                return;
+            }
+
+            std::basic_ostream<bl_char>& os = m_State->stream;
+            os.clear();
+            os.flags(std::ios_base::dec | std::ios_base::skipws);
+            os.precision(6);
+            os.width(0);
+            os.fill(os.widen(' '));
+
+            m_State->in_use = false;
+        }
+    private:
+        static state& get_state()
+        {
+            static thread_local state s;
+            return s;
+        }
+    };
+}
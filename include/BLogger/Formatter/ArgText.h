@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+#include "BLogger/Formatter/ArgStream.h"
+#include "BLogger/Formatter/DeferredArgs.h"
+#include "BLogger/Formatter/NumberFormat.h"
+
+namespace BLogger {
+
+    template<typename T, typename = void>
+    struct is_streamable : std::false_type
+    {
+    };
+
+    template<typename T>
+    struct is_streamable<T, decltype(void(
+        std::declval<std::basic_ostream<bl_char>&>() << std::declval<const T&>()
+    ))> : std::true_type
+    {
+    };
+
+    // The text of a single argument. Built-in types are formatted
+    // right into a small array (or pointed to, if they're strings),
+    // with the same output as the default formatting of a stream
+    // would produce. Anything else is written with operator<<
+    // through the thread's arg_stream.
+    template<typename T, typename = void>
+    class arg_text
+    {
+    private:
+        arg_stream m_Stream;
+    public:
+        template<typename U>
+        explicit arg_text(U&& value)
+            : m_Stream()
+        {
+            m_Stream.stream() << std::forward<U>(value);
+        }
+
+        const bl_char* data()
+        {
+            return m_Stream.data();
+        }
+
+        size_t size()
+        {
+            return m_Stream.size();
+        }
+    };
+
+    class number_text
+    {
+    protected:
+        bl_char m_Text[BLOGGER_NUMBER_SIZE];
+        size_t  m_Size;
+    public:
+        number_text()
+            : m_Size(0)
+        {
+        }
+
+        const bl_char* data()
+        {
+            return m_Text;
+        }
+
+        size_t size()
+        {
+            return m_Size;
+        }
+    };
+
+    class string_text
+    {
+    protected:
+        const bl_char* m_Data;
+        size_t         m_Size;
+    public:
+        string_text(const bl_char* data, size_t size)
+            : m_Data(data),
+            m_Size(size)
+        {
+        }
+
+        const bl_char* data()
+        {
+            return m_Data;
+        }
+
+        size_t size()
+        {
+            return m_Size;
+        }
+    };
+
+    // 1 or 0, streams don't use boolalpha by default
+    template<>
+    class arg_text<bool> : public number_text
+    {
+    public:
+        explicit arg_text(bool value)
+        {
+            m_Text[0] = value ? '1' : '0';
+            m_Size = 1;
+        }
+    };
+
+    template<typename T>
+    class arg_text<T, typename std::enable_if<
+        std::is_same<T, char>::value ||
+        std::is_same<T, signed char>::value ||
+        std::is_same<T, unsigned char>::value
+    >::type> : public number_text
+    {
+    public:
+        explicit arg_text(T value)
+        {
+            m_Text[0] = static_cast<bl_char>(value);
+            m_Size = 1;
+        }
+    };
+
+    template<typename T>
+    class arg_text<T, typename std::enable_if<
+        is_deferred_integer<T>::value && std::is_signed<T>::value
+    >::type> : public number_text
+    {
+    public:
+        explicit arg_text(T value)
+        {
+            m_Size = format_signed(static_cast<int64_t>(value), m_Text);
+        }
+    };
+
+    template<typename T>
+    class arg_text<T, typename std::enable_if<
+        is_deferred_integer<T>::value && std::is_unsigned<T>::value
+    >::type> : public number_text
+    {
+    public:
+        explicit arg_text(T value)
+        {
+            m_Size = format_unsigned(static_cast<uint64_t>(value), m_Text);
+        }
+    };
+
+    template<typename T>
+    class arg_text<T, typename std::enable_if<
+        std::is_floating_point<T>::value
+    >::type> : public number_text
+    {
+    public:
+        explicit arg_text(T value)
+        {
+            m_Size = format_general(value, m_Text);
+        }
+    };
+
+    // Enums that can't be streamed are written as their
+    // underlying value, the rest go through operator<<
+    // since it might be a user defined one
+    template<typename T>
+    class arg_text<T, typename std::enable_if<
+        std::is_enum<T>::value && !is_streamable<T>::value
+    >::type> : public number_text
+    {
+    private:
+        typedef typename std::underlying_type<T>::type underlying;
+    public:
+        explicit arg_text(T value)
+        {
+            underlying number = static_cast<underlying>(value);
+
+            if (std::is_signed<underlying>::value)
+                m_Size = format_signed(static_cast<int64_t>(number), m_Text);
+            else
+                m_Size = format_unsigned(static_cast<uint64_t>(number), m_Text);
+        }
+    };
+
+    // A null string writes nothing, like a stream
+    // that refuses it (and sets its badbit) would
+    template<typename T>
+    class arg_text<T*, typename std::enable_if<
+        is_narrow_char<T>::value
+    >::type> : public string_text
+    {
+    public:
+        explicit arg_text(const T* value)
+            : string_text(
+                reinterpret_cast<const bl_char*>(value),
+                value ? strlen(reinterpret_cast<const bl_char*>(value)) : 0
+            )
+        {
+        }
+    };
+
+    template<>
+    class arg_text<BLoggerString> : public string_text
+    {
+    public:
+        explicit arg_text(const BLoggerString& value)
+            : string_text(value.data(), value.size())
+        {
+        }
+    };
+
+#if _MSVC_LANG >= 201703L || __cplusplus >= 201703L
+    template<>
+    class arg_text<std::basic_string_view<bl_char>> : public string_text
+    {
+    public:
+        explicit arg_text(std::basic_string_view<bl_char> value)
+            : string_text(value.data(), value.size())
+        {
+        }
+    };
+#endif
+
+    template<>
+    class arg_text<deferred_string> : public string_text
+    {
+    public:
+        explicit arg_text(const deferred_string& value)
+            : string_text(value.data, value.size)
+        {
+        }
+    };
+
+    // Function pointers are streamed as bools, so they
+    // fall back to the stream as well
+    template<typename T>
+    class arg_text<T*, typename std::enable_if<
+        !is_narrow_char<T>::value &&
+        !std::is_function<T>::value
+    >::type> : public number_text
+    {
+    public:
+        explicit arg_text(const T* value)
+        {
+            m_Size = format_stream_pointer(value, m_Text);
+        }
+    };
+
+    template<typename T>
+    using arg_text_for = arg_text<typename std::decay<T>::type>;
+}
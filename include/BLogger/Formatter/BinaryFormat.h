@@ -0,0 +1,612 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "BLogger/LogLevels.h"
+#include "BLogger/Formatter/Formatter.h"
+#include "BLogger/Formatter/DeferredArgs.h"
+#include "BLogger/Loggers/LogMessage.h"
+
+#define BLOGGER_BINARY_MAGIC "BLOGBIN1"
+#define BLOGGER_BINARY_MAGIC_SIZE 8
+
+namespace BLogger {
+
+    // A binary log starts with BLOGGER_BINARY_MAGIC
+    // followed by a series of records:
+    //
+    // format:  id, size, format string
+    // message: format id, timestamp delta, level, thread id, size, packed arguments
+    // text:    timestamp delta, level, thread id, size, text
+    // tag:     size, tag
+    //
+    // Every number is a varint, the timestamp deltas (wall clock ns
+    // since the previous message of the file) are zigzag encoded,
+    // the level is a single byte. A format is defined once per file
+    // before the first message that uses it, so every file can be
+    // decoded on its own.
+    enum class binary_record : uint8_t
+    {
+        format = 1,
+        message,
+        text,
+        tag
+    };
+
+    inline void put_varint(bl_string& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<bl_char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+
+        out.push_back(static_cast<bl_char>(value));
+    }
+
+    inline bool get_varint(const bl_char*& data, const bl_char* end, uint64_t& value)
+    {
+        value = 0;
+
+        for (unsigned shift = 0; data < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(*data++);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if (!(byte & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+
+    inline uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Re-encodes deferred arguments with varint integers
+    // and lengths instead of fixed size ones
+    class binary_arg_packer
+    {
+    private:
+        bl_string& m_Out;
+    public:
+        explicit binary_arg_packer(bl_string& out)
+            : m_Out(out)
+        {
+        }
+
+        void operator()(bool value)
+        {
+            put_tag(arg_tag::boolean);
+            m_Out.push_back(value ? 1 : 0);
+        }
+
+        void operator()(char value)
+        {
+            put_tag(arg_tag::character);
+            m_Out.push_back(value);
+        }
+
+        void operator()(int64_t value)
+        {
+            put_tag(arg_tag::signed_integer);
+            put_varint(m_Out, zigzag(value));
+        }
+
+        void operator()(uint64_t value)
+        {
+            put_tag(arg_tag::unsigned_integer);
+            put_varint(m_Out, value);
+        }
+
+        void operator()(double value)
+        {
+            put_tag(arg_tag::double_precision);
+            put_raw(value);
+        }
+
+        void operator()(long double value)
+        {
+            put_tag(arg_tag::extended_precision);
+            put_raw(value);
+        }
+
+        void operator()(const deferred_string& value)
+        {
+            put_tag(arg_tag::string);
+            put_varint(m_Out, value.size);
+            m_Out.insert(m_Out.end(), value.data, value.data + value.size);
+        }
+
+        void operator()(const void* value)
+        {
+            put_tag(arg_tag::pointer);
+            put_varint(m_Out, reinterpret_cast<uintptr_t>(value));
+        }
+    private:
+        void put_tag(arg_tag tag)
+        {
+            m_Out.push_back(static_cast<bl_char>(tag));
+        }
+
+        template<typename T>
+        void put_raw(T value)
+        {
+            const bl_char* bytes = reinterpret_cast<const bl_char*>(&value);
+            m_Out.insert(m_Out.end(), bytes, bytes + sizeof(value));
+        }
+    };
+
+    inline void pack_binary_args(const bl_char* args, size_t size, bl_string& out)
+    {
+        read_deferred(args, size, binary_arg_packer(out));
+    }
+
+    // Encodes messages into records, keeping track of the formats
+    // defined so far. Used by every sink that writes binary logs,
+    // reset it whenever a new log (file, frame...) is started.
+    class binary_log_encoder
+    {
+    private:
+        // Points into m_Formats, which never moves its strings
+        struct format_key
+        {
+            const bl_char* data;
+            size_t         size;
+
+            bool operator==(const format_key& other) const
+            {
+                return size == other.size && memcmp(data, other.data, size) == 0;
+            }
+        };
+
+        struct format_key_hash
+        {
+            size_t operator()(const format_key& key) const
+            {
+                uint64_t hash = 14695981039346656037ull;
+
+                for (size_t i = 0; i < key.size; i++)
+                {
+                    hash ^= static_cast<uint8_t>(key.data[i]);
+                    hash *= 1099511628211ull;
+                }
+
+                return static_cast<size_t>(hash);
+            }
+        };
+    public:
+        // Everything needed to take back the records
+        // encoded after it, see restore
+        struct checkpoint
+        {
+            size_t  size;
+            size_t  formats;
+            int64_t last_timestamp;
+        };
+    private:
+        bl_string m_Args;
+        int64_t   m_LastTimestamp;
+
+        // static formats are looked up by their address first
+        std::deque<BLoggerString>                                 m_Formats;
+        std::unordered_map<format_key, uint32_t, format_key_hash> m_FormatIds;
+        std::unordered_map<const bl_char*, uint32_t>              m_StaticFormatIds;
+    public:
+        binary_log_encoder()
+            : m_Args(),
+            m_LastTimestamp(0),
+            m_Formats(),
+            m_FormatIds(),
+            m_StaticFormatIds()
+        {
+        }
+
+        // Forgets every format and the last timestamp
+        void reset()
+        {
+            m_LastTimestamp = 0;
+            m_Formats.clear();
+            m_FormatIds.clear();
+            m_StaticFormatIds.clear();
+        }
+
+        // The magic and the tag, every log starts with them
+        void put_header(bl_string& out, BLoggerInString tag)
+        {
+            out.insert(out.end(), BLOGGER_BINARY_MAGIC, BLOGGER_BINARY_MAGIC + BLOGGER_BINARY_MAGIC_SIZE);
+            put_tag(out, tag);
+        }
+
+        void put_tag(bl_string& out, BLoggerInString tag)
+        {
+            out.push_back(static_cast<bl_char>(binary_record::tag));
+            put_varint(out, tag.size());
+            out.insert(out.end(), tag.begin(), tag.end());
+        }
+
+        // Deferred messages are stored as a format id and their
+        // packed arguments, the rest as the text of the message
+        // (with the fields in logfmt)
+        void put_message(bl_string& out, BLoggerLogMessage& msg)
+        {
+            int64_t timestamp = to_wall_clock_ns(msg.log_timestamp());
+
+            if (msg.is_deferred())
+            {
+                uint32_t id = format_id(out, msg);
+
+                m_Args.clear();
+                pack_binary_args(msg.deferred_args_data(), msg.deferred_args_size(), m_Args);
+
+                out.push_back(static_cast<bl_char>(binary_record::message));
+                put_varint(out, id);
+                put_header(out, msg, timestamp);
+                put_varint(out, m_Args.size());
+                out.insert(out.end(), m_Args.begin(), m_Args.end());
+            }
+            else if (msg.has_fields())
+            {
+                BLoggerMessageBuffer text = msg.message_text();
+                put_text(out, msg, text.data(), text.size());
+            }
+            else
+                put_text(out, msg, msg.data(), msg.size());
+        }
+
+        // A text record carrying the given text instead of
+        // the message's own, e.g. a clipped version of it
+        void put_text(bl_string& out, BLoggerLogMessage& msg, const bl_char* text, size_t size)
+        {
+            out.push_back(static_cast<bl_char>(binary_record::text));
+            put_header(out, msg, to_wall_clock_ns(msg.log_timestamp()));
+            put_varint(out, size);
+            out.insert(out.end(), text, text + size);
+        }
+
+        checkpoint save(const bl_string& out) const
+        {
+            return { out.size(), m_Formats.size(), m_LastTimestamp };
+        }
+
+        // Drops whatever was encoded into out since the checkpoint,
+        // including the formats it defined
+        void restore(bl_string& out, const checkpoint& point)
+        {
+            out.resize(point.size);
+            m_LastTimestamp = point.last_timestamp;
+
+            if (m_Formats.size() == point.formats)
+                return;
+
+            for (auto it = m_StaticFormatIds.begin(); it != m_StaticFormatIds.end();)
+            {
+                if (it->second >= point.formats)
+                    it = m_StaticFormatIds.erase(it);
+                else
+                    ++it;
+            }
+
+            while (m_Formats.size() > point.formats)
+            {
+                m_FormatIds.erase({ m_Formats.back().data(), m_Formats.back().size() });
+                m_Formats.pop_back();
+            }
+        }
+    private:
+        void put_header(bl_string& out, BLoggerLogMessage& msg, int64_t timestamp)
+        {
+            put_varint(out, zigzag(timestamp - m_LastTimestamp));
+            out.push_back(static_cast<bl_char>(msg.log_level()));
+            put_varint(out, msg.log_thread_id());
+
+            m_LastTimestamp = timestamp;
+        }
+
+        // Defines the format in out if it's new
+        uint32_t format_id(bl_string& out, BLoggerLogMessage& msg)
+        {
+            const bl_char* format = msg.deferred_format_data();
+            size_t size = msg.deferred_format_length();
+
+            if (msg.has_static_format())
+            {
+                auto cached = m_StaticFormatIds.find(format);
+
+                if (cached != m_StaticFormatIds.end())
+                    return cached->second;
+            }
+
+            auto found = m_FormatIds.find({ format, size });
+            uint32_t id;
+
+            if (found != m_FormatIds.end())
+                id = found->second;
+            else
+            {
+                id = static_cast<uint32_t>(m_Formats.size());
+
+                m_Formats.emplace_back(format, size);
+                m_FormatIds.emplace(format_key{ m_Formats.back().data(), size }, id);
+
+                out.push_back(static_cast<bl_char>(binary_record::format));
+                put_varint(out, id);
+                put_varint(out, size);
+                out.insert(out.end(), format, format + size);
+            }
+
+            if (msg.has_static_format())
+                m_StaticFormatIds.emplace(format, id);
+
+            return id;
+        }
+    };
+
+    // The reverse of pack_binary_args, produces the deferred
+    // encoding that read_deferred understands
+    inline bool unpack_binary_args(const bl_char* data, const bl_char* end, BLoggerMessageBuffer& out)
+    {
+        while (data < end)
+        {
+            arg_tag tag = static_cast<arg_tag>(*data++);
+            uint64_t value;
+
+            out.push_back(static_cast<bl_char>(tag));
+
+            switch (tag)
+            {
+            case arg_tag::boolean:
+            {
+                if (data == end)
+                    return false;
+
+                bool flag = *data++ != 0;
+                out.append(reinterpret_cast<const bl_char*>(&flag), sizeof(flag));
+                break;
+            }
+            case arg_tag::character:
+            {
+                if (data == end)
+                    return false;
+
+                out.push_back(*data++);
+                break;
+            }
+            case arg_tag::signed_integer:
+            {
+                if (!get_varint(data, end, value))
+                    return false;
+
+                int64_t number = unzigzag(value);
+                out.append(reinterpret_cast<const bl_char*>(&number), sizeof(number));
+                break;
+            }
+            case arg_tag::unsigned_integer:
+            {
+                if (!get_varint(data, end, value))
+                    return false;
+
+                out.append(reinterpret_cast<const bl_char*>(&value), sizeof(value));
+                break;
+            }
+            case arg_tag::double_precision:
+            case arg_tag::extended_precision:
+            {
+                size_t size = tag == arg_tag::double_precision ? sizeof(double) : sizeof(long double);
+
+                if (static_cast<size_t>(end - data) < size)
+                    return false;
+
+                out.append(data, size);
+                data += size;
+                break;
+            }
+            case arg_tag::string:
+            {
+                if (!get_varint(data, end, value) || static_cast<uint64_t>(end - data) < value)
+                    return false;
+
+                uint32_t length = static_cast<uint32_t>(value);
+                out.append(reinterpret_cast<const bl_char*>(&length), sizeof(length));
+                out.append(data, length);
+                data += length;
+                break;
+            }
+            case arg_tag::pointer:
+            {
+                if (!get_varint(data, end, value))
+                    return false;
+
+                uintptr_t pointer = static_cast<uintptr_t>(value);
+                out.append(reinterpret_cast<const bl_char*>(&pointer), sizeof(pointer));
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Turns a binary log back into text using
+    // the same patterns as the loggers do
+    class binary_log_reader
+    {
+    private:
+        std::vector<BLoggerString> m_Formats;
+        BLoggerString              m_PatternString;
+        BLoggerString              m_TimestampFormat;
+        BLoggerPattern             m_Pattern;
+        int64_t                    m_LastTimestamp;
+    public:
+        binary_log_reader(
+            BLoggerInString pattern,
+            BLoggerInString timestampFormat = BLOGGER_TIMESTAMP
+        ) : m_Formats(),
+            m_PatternString(pattern.data(), pattern.size()),
+            m_TimestampFormat(timestampFormat.data(), timestampFormat.size()),
+            m_Pattern(),
+            m_LastTimestamp(0)
+        {
+            m_Pattern.set_pattern(m_PatternString, "", m_TimestampFormat);
+        }
+
+        // Calls output with every line, returns false if the data
+        // isn't a binary log, has a malformed record or ends in the
+        // middle of one (e.g. because it's still being written).
+        // Decoding stops at the first bad record.
+        template<typename OutputT>
+        bool read(const bl_char* data, size_t size, OutputT&& output)
+        {
+            const bl_char* end = data + size;
+
+            if (size < BLOGGER_BINARY_MAGIC_SIZE ||
+                memcmp(data, BLOGGER_BINARY_MAGIC, BLOGGER_BINARY_MAGIC_SIZE))
+                return false;
+
+            data += BLOGGER_BINARY_MAGIC_SIZE;
+
+            m_Formats.clear();
+            m_LastTimestamp = 0;
+
+            while (data < end)
+            {
+                if (!read_record(data, end, output))
+                    return false;
+            }
+
+            return true;
+        }
+    private:
+        template<typename OutputT>
+        bool read_record(const bl_char*& data, const bl_char* end, OutputT& output)
+        {
+            binary_record type = static_cast<binary_record>(*data++);
+            uint64_t value;
+
+            switch (type)
+            {
+            case binary_record::format:
+            {
+                uint64_t id;
+
+                if (!get_varint(data, end, id) || !read_string(data, end, value))
+                    return false;
+
+                // the encoder numbers its formats in order,
+                // anything further ahead is garbage
+                if (id > m_Formats.size())
+                    return false;
+
+                if (id == m_Formats.size())
+                    m_Formats.emplace_back();
+
+                m_Formats[static_cast<size_t>(id)].assign(data - value, static_cast<size_t>(value));
+                return true;
+            }
+            case binary_record::tag:
+            {
+                if (!read_string(data, end, value))
+                    return false;
+
+                m_Pattern.set_pattern(
+                    m_PatternString,
+                    BLoggerString(data - value, static_cast<size_t>(value)),
+                    m_TimestampFormat
+                );
+
+                return true;
+            }
+            case binary_record::message:
+            case binary_record::text:
+            {
+                uint64_t id = 0;
+
+                if (type == binary_record::message && !get_varint(data, end, id))
+                    return false;
+
+                uint64_t delta, lvl, thread_id;
+
+                if (!get_varint(data, end, delta) || data == end)
+                    return false;
+
+                lvl = static_cast<uint8_t>(*data++);
+
+                if (lvl > static_cast<uint64_t>(level::crit))
+                    return false;
+
+                if (!get_varint(data, end, thread_id) || !read_string(data, end, value))
+                    return false;
+
+                m_LastTimestamp += unzigzag(delta);
+
+                BLoggerMessageBuffer message;
+
+                if (type == binary_record::text)
+                    message.append(data - value, static_cast<size_t>(value));
+                else if (!format_message(static_cast<size_t>(id), data - value, data, message))
+                    return false;
+
+                BLoggerFormatter::merge_pattern_at(
+                    message,
+                    m_Pattern,
+                    m_LastTimestamp,
+                    static_cast<level>(lvl),
+                    thread_id
+                );
+
+                output(message.data(), message.size());
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        // Skips over a size and that many bytes
+        static bool read_string(const bl_char*& data, const bl_char* end, uint64_t& size)
+        {
+            if (!get_varint(data, end, size) || static_cast<uint64_t>(end - data) < size)
+                return false;
+
+            data += size;
+            return true;
+        }
+
+        bool format_message(size_t id, const bl_char* args, const bl_char* end, BLoggerMessageBuffer& out)
+        {
+            if (id >= m_Formats.size())
+                return false;
+
+            BLoggerMessageBuffer unpacked;
+
+            if (!unpack_binary_args(args, end, unpacked))
+                return false;
+
+            BLoggerFormatter formatter;
+            formatter.process_message(m_Formats[id].data(), m_Formats[id].size());
+
+            read_deferred(unpacked.data(), unpacked.size(),
+                [&formatter](const auto& arg)
+                {
+                    formatter.handle_pack(arg);
+                }
+            );
+
+            out = formatter.release_buffer();
+            return true;
+        }
+    };
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+
+namespace BLogger {
+
+    // Every deferred argument is stored as a tag
+    // followed by its raw bytes, strings are stored
+    // as a 32 bit length followed by the characters.
+    enum class arg_tag : uint8_t
+    {
+        boolean = 1,
+        character,
+        signed_integer,
+        unsigned_integer,
+        double_precision,
+        extended_precision,
+        string,
+        pointer
+    };
+
+    // Only the types that the backend can reproduce
+    // exactly from their bytes can be deferred, the
+    // rest is formatted eagerly on the caller thread.
+    template<typename T, typename = void>
+    struct deferred_arg
+    {
+        static constexpr bool deferrable = false;
+    };
+
+    template<typename T>
+    struct deferred_fixed_arg
+    {
+        static constexpr bool deferrable = true;
+
+        template<typename U>
+        static size_t size(const U&)
+        {
+            return 1 + sizeof(T);
+        }
+
+        static bl_char* write(bl_char* dst, arg_tag tag, T value)
+        {
+            *dst++ = static_cast<bl_char>(tag);
+            memcpy(dst, &value, sizeof(T));
+
+            return dst + sizeof(T);
+        }
+    };
+
+    template<>
+    struct deferred_arg<bool> : deferred_fixed_arg<bool>
+    {
+        static bl_char* write(bl_char* dst, bool value)
+        {
+            return deferred_fixed_arg<bool>::write(dst, arg_tag::boolean, value);
+        }
+    };
+
+    template<typename T>
+    struct deferred_arg<T, typename std::enable_if<
+        std::is_same<T, char>::value ||
+        std::is_same<T, signed char>::value ||
+        std::is_same<T, unsigned char>::value
+    >::type> : deferred_fixed_arg<char>
+    {
+        static bl_char* write(bl_char* dst, T value)
+        {
+            return deferred_fixed_arg<char>::write(dst, arg_tag::character, static_cast<char>(value));
+        }
+    };
+
+    // Pointers to any of them are strings to a stream
+    template<typename T>
+    struct is_narrow_char
+    {
+        typedef typename std::remove_cv<T>::type type;
+
+        static constexpr bool value =
+            std::is_same<type, char>::value ||
+            std::is_same<type, signed char>::value ||
+            std::is_same<type, unsigned char>::value;
+    };
+
+    template<typename T>
+    struct is_deferred_integer
+    {
+        static constexpr bool value =
+            std::is_integral<T>::value &&
+            !std::is_same<T, bool>::value &&
+            !std::is_same<T, char>::value &&
+            !std::is_same<T, signed char>::value &&
+            !std::is_same<T, unsigned char>::value &&
+            !std::is_same<T, wchar_t>::value &&
+            !std::is_same<T, char16_t>::value &&
+            !std::is_same<T, char32_t>::value;
+    };
+
+    template<typename T>
+    struct deferred_arg<T, typename std::enable_if<
+        is_deferred_integer<T>::value && std::is_signed<T>::value
+    >::type> : deferred_fixed_arg<int64_t>
+    {
+        static bl_char* write(bl_char* dst, T value)
+        {
+            return deferred_fixed_arg<int64_t>::write(dst, arg_tag::signed_integer, value);
+        }
+    };
+
+    template<typename T>
+    struct deferred_arg<T, typename std::enable_if<
+        is_deferred_integer<T>::value && std::is_unsigned<T>::value
+    >::type> : deferred_fixed_arg<uint64_t>
+    {
+        static bl_char* write(bl_char* dst, T value)
+        {
+            return deferred_fixed_arg<uint64_t>::write(dst, arg_tag::unsigned_integer, value);
+        }
+    };
+
+    // floats are printed as doubles by streams anyway
+    template<typename T>
+    struct deferred_arg<T, typename std::enable_if<
+        std::is_same<T, float>::value ||
+        std::is_same<T, double>::value
+    >::type> : deferred_fixed_arg<double>
+    {
+        static bl_char* write(bl_char* dst, T value)
+        {
+            return deferred_fixed_arg<double>::write(dst, arg_tag::double_precision, value);
+        }
+    };
+
+    template<>
+    struct deferred_arg<long double> : deferred_fixed_arg<long double>
+    {
+        static bl_char* write(bl_char* dst, long double value)
+        {
+            return deferred_fixed_arg<long double>::write(dst, arg_tag::extended_precision, value);
+        }
+    };
+
+    // function pointers are printed as bools by streams
+    template<typename T>
+    struct deferred_arg<T*, typename std::enable_if<
+        !is_narrow_char<T>::value &&
+        !std::is_function<T>::value
+    >::type> : deferred_fixed_arg<uintptr_t>
+    {
+        static bl_char* write(bl_char* dst, T* value)
+        {
+            return deferred_fixed_arg<uintptr_t>::write(
+                dst,
+                arg_tag::pointer,
+                reinterpret_cast<uintptr_t>(value)
+            );
+        }
+    };
+
+    // What a decoded string argument is handed out as, it points
+    // right into the encoded arguments so nothing is copied
+    struct deferred_string
+    {
+        const bl_char* data;
+        size_t         size;
+    };
+
+    inline std::basic_ostream<bl_char>& operator<<(
+        std::basic_ostream<bl_char>& os,
+        const deferred_string& str
+    )
+    {
+        return os.write(str.data, static_cast<std::streamsize>(str.size));
+    }
+
+    struct deferred_string_arg
+    {
+        static constexpr bool deferrable = true;
+
+        static size_t string_size(const bl_char*, size_t size)
+        {
+            return 1 + sizeof(uint32_t) + size;
+        }
+
+        static bl_char* write_string(bl_char* dst, const bl_char* data, size_t size)
+        {
+            uint32_t length = static_cast<uint32_t>(size);
+
+            *dst++ = static_cast<bl_char>(arg_tag::string);
+            memcpy(dst, &length, sizeof(length));
+            dst += sizeof(length);
+            memcpy(dst, data, size);
+
+            return dst + size;
+        }
+    };
+
+    template<typename T>
+    struct deferred_arg<T*, typename std::enable_if<
+        is_narrow_char<T>::value
+    >::type> : deferred_string_arg
+    {
+        static size_t size(const T* value)
+        {
+            const bl_char* text = reinterpret_cast<const bl_char*>(value);
+            return string_size(text, text ? strlen(text) : 0);
+        }
+
+        static bl_char* write(bl_char* dst, const T* value)
+        {
+            const bl_char* text = reinterpret_cast<const bl_char*>(value);
+            return write_string(dst, text, text ? strlen(text) : 0);
+        }
+    };
+
+    template<>
+    struct deferred_arg<BLoggerString> : deferred_string_arg
+    {
+        static size_t size(const BLoggerString& value)
+        {
+            return string_size(value.data(), value.size());
+        }
+
+        static bl_char* write(bl_char* dst, const BLoggerString& value)
+        {
+            return write_string(dst, value.data(), value.size());
+        }
+    };
+
+#if _MSVC_LANG >= 201703L || __cplusplus >= 201703L
+    template<>
+    struct deferred_arg<std::basic_string_view<bl_char>> : deferred_string_arg
+    {
+        static size_t size(std::basic_string_view<bl_char> value)
+        {
+            return string_size(value.data(), value.size());
+        }
+
+        static bl_char* write(bl_char* dst, std::basic_string_view<bl_char> value)
+        {
+            return write_string(dst, value.data(), value.size());
+        }
+    };
+#endif
+
+    template<typename T>
+    using deferred_arg_for = deferred_arg<typename std::decay<T>::type>;
+
+    template<typename... Args>
+    struct all_deferrable;
+
+    template<>
+    struct all_deferrable<>
+    {
+        static constexpr bool value = true;
+    };
+
+    template<typename T, typename... Args>
+    struct all_deferrable<T, Args...>
+    {
+        static constexpr bool value =
+            deferred_arg_for<T>::deferrable &&
+            all_deferrable<Args...>::value;
+    };
+
+    inline size_t deferred_size()
+    {
+        return 0;
+    }
+
+    template<typename T, typename... Args>
+    size_t deferred_size(const T& arg, const Args& ... args)
+    {
+        return deferred_arg_for<T>::size(arg) + deferred_size(args...);
+    }
+
+    inline bl_char* write_deferred(bl_char* dst)
+    {
+        return dst;
+    }
+
+    template<typename T, typename... Args>
+    bl_char* write_deferred(bl_char* dst, const T& arg, const Args& ... args)
+    {
+        return write_deferred(deferred_arg_for<T>::write(dst, arg), args...);
+    }
+
+    // Decodes the arguments one by one and hands
+    // them to the handler in the original order
+    template<typename HandlerT>
+    void read_deferred(const bl_char* data, size_t size, HandlerT&& handler)
+    {
+        const bl_char* end = data + size;
+
+        while (data < end)
+        {
+            arg_tag tag = static_cast<arg_tag>(*data++);
+
+            switch (tag)
+            {
+            case arg_tag::boolean:
+            {
+                bool value; memcpy(&value, data, sizeof(value));
+                handler(value);
+                data += sizeof(value);
+                break;
+            }
+            case arg_tag::character:
+            {
+                handler(*data++);
+                break;
+            }
+            case arg_tag::signed_integer:
+            {
+                int64_t value; memcpy(&value, data, sizeof(value));
+                handler(value);
+                data += sizeof(value);
+                break;
+            }
+            case arg_tag::unsigned_integer:
+            {
+                uint64_t value; memcpy(&value, data, sizeof(value));
+                handler(value);
+                data += sizeof(value);
+                break;
+            }
+            case arg_tag::double_precision:
+            {
+                double value; memcpy(&value, data, sizeof(value));
+                handler(value);
+                data += sizeof(value);
+                break;
+            }
+            case arg_tag::extended_precision:
+            {
+                long double value; memcpy(&value, data, sizeof(value));
+                handler(value);
+                data += sizeof(value);
+                break;
+            }
+            case arg_tag::string:
+            {
+                uint32_t length; memcpy(&length, data, sizeof(length));
+                data += sizeof(length);
+                handler(deferred_string{ data, length });
+                data += length;
+                break;
+            }
+            case arg_tag::pointer:
+            {
+                uintptr_t value; memcpy(&value, data, sizeof(value));
+                handler(reinterpret_cast<const void*>(value));
+                data += sizeof(value);
+                break;
+            }
+            default:
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+#include "BLogger/Formatter/SmallBuffer.h"
+#include "BLogger/Formatter/Scan.h"
+
+// A logfmt value has to be quoted if it contains a space too
+#define BLOGGER_JSON_CONTROL_MAX   0x1F
+#define BLOGGER_LOGFMT_CONTROL_MAX 0x20
+
+namespace BLogger {
+
+    // The offset of the first character that's either a quote,
+    // a backslash, extra or at most control_max, or size if there
+    // is none, see find_first_of
+    inline size_t find_escape(const bl_char* data, size_t size, uint8_t control_max, bl_char extra)
+    {
+        return find_first_of(
+            data, size, byte_set(static_cast<uint8_t>(control_max + 1), '"', '\\', extra)
+        );
+    }
+
+    // Appends the text as the inside of a JSON string
+    template<typename BufferT>
+    void append_json_escaped(BufferT& out, const bl_char* data, size_t size)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        while (size)
+        {
+            size_t plain = find_escape(data, size, BLOGGER_JSON_CONTROL_MAX, '"');
+
+            out.append(data, plain);
+
+            if (plain == size)
+                return;
+
+            bl_char c = data[plain];
+
+            switch (c)
+            {
+            case '"':  out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\n': out.append("\\n", 2);  break;
+            case '\r': out.append("\\r", 2);  break;
+            case '\t': out.append("\\t", 2);  break;
+            case '\b': out.append("\\b", 2);  break;
+            case '\f': out.append("\\f", 2);  break;
+            default:
+            {
+                bl_char escaped[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+                out.append(escaped, sizeof(escaped));
+                break;
+            }
+            }
+
+            data += plain + 1;
+            size -= plain + 1;
+        }
+    }
+
+    template<typename BufferT>
+    void append_json_string(BufferT& out, const bl_char* data, size_t size)
+    {
+        out.push_back('"');
+        append_json_escaped(out, data, size);
+        out.push_back('"');
+    }
+
+    // Plain if it can be, quoted and escaped like a JSON
+    // string if it's empty or has spaces, quotes, '=' or
+    // control characters in it
+    template<typename BufferT>
+    void append_logfmt_value(BufferT& out, const bl_char* data, size_t size)
+    {
+        if (size && find_escape(data, size, BLOGGER_LOGFMT_CONTROL_MAX, '=') == size)
+            out.append(data, size);
+        else
+            append_json_string(out, data, size);
+    }
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+#include "BLogger/Formatter/SmallBuffer.h"
+#include "BLogger/Formatter/ArgText.h"
+#include "BLogger/Formatter/DeferredArgs.h"
+#include "BLogger/Formatter/NumberFormat.h"
+#include "BLogger/Formatter/Escape.h"
+
+namespace BLogger {
+
+    // A typed key/value pair attached to a message, see field.
+    // The value is only referenced, so a field must not outlive
+    // the logging call it's passed to.
+    template<typename T>
+    struct log_field
+    {
+        const bl_char* key;
+        size_t         key_size;
+        const T&       value;
+    };
+
+    // e.g. logger->Info("request done", field("path", path), field("ms", 12.5))
+    template<typename T>
+    log_field<T> field(const bl_char* key, const T& value)
+    {
+        return { key, strlen(key), value };
+    }
+
+    template<typename T>
+    log_field<T> field(BLoggerInString key, const T& value)
+    {
+        return { key.data(), key.size(), value };
+    }
+
+    template<typename T>
+    struct is_log_field : std::false_type
+    {
+    };
+
+    template<typename T>
+    struct is_log_field<log_field<T>> : std::true_type
+    {
+    };
+
+    template<typename... Args>
+    struct any_log_field;
+
+    template<>
+    struct any_log_field<>
+    {
+        static constexpr bool value = false;
+    };
+
+    template<typename T, typename... Args>
+    struct any_log_field<T, Args...>
+    {
+        static constexpr bool value =
+            is_log_field<typename std::decay<T>::type>::value ||
+            any_log_field<Args...>::value;
+    };
+
+    // Fields are stored behind the text of the message as pairs
+    // of deferred arguments (see DeferredArgs.h): the key as a
+    // string followed by the value. Values that can't be deferred
+    // are stored as their text instead, see arg_text.
+    template<typename BufferT>
+    void append_encoded_key(BufferT& out, const bl_char* key, size_t key_size)
+    {
+        size_t offset = out.size();
+        out.resize(offset + deferred_string_arg::string_size(key, key_size));
+
+        deferred_string_arg::write_string(out.data() + offset, key, key_size);
+    }
+
+    template<typename BufferT, typename T>
+    void append_encoded_value(BufferT& out, const T& value, std::true_type)
+    {
+        size_t offset = out.size();
+        out.resize(offset + deferred_arg_for<T>::size(value));
+
+        deferred_arg_for<T>::write(out.data() + offset, value);
+    }
+
+    template<typename BufferT, typename T>
+    void append_encoded_value(BufferT& out, const T& value, std::false_type)
+    {
+        arg_text_for<T> text(value);
+
+        size_t offset = out.size();
+        out.resize(offset + deferred_string_arg::string_size(text.data(), text.size()));
+
+        deferred_string_arg::write_string(out.data() + offset, text.data(), text.size());
+    }
+
+    template<typename BufferT, typename T>
+    void append_encoded_field(BufferT& out, const log_field<T>& f)
+    {
+        append_encoded_key(out, f.key, f.key_size);
+        append_encoded_value(
+            out, f.value,
+            std::integral_constant<bool, deferred_arg_for<T>::deferrable>()
+        );
+    }
+
+    // Writes a decoded value, strings through string_writer
+    // so that every encoding can quote them its own way
+    template<typename BufferT, typename StringWriterT>
+    class field_value_writer
+    {
+    private:
+        BufferT&      m_Out;
+        StringWriterT m_WriteString;
+    public:
+        field_value_writer(BufferT& out, StringWriterT write_string)
+            : m_Out(out),
+            m_WriteString(write_string)
+        {
+        }
+
+        void operator()(bool value)
+        {
+            if (value)
+                m_Out.append("true", 4);
+            else
+                m_Out.append("false", 5);
+        }
+
+        void operator()(char value)
+        {
+            m_WriteString(m_Out, &value, 1);
+        }
+
+        void operator()(int64_t value)
+        {
+            bl_char text[BLOGGER_NUMBER_SIZE];
+            m_Out.append(text, format_signed(value, text));
+        }
+
+        void operator()(uint64_t value)
+        {
+            bl_char text[BLOGGER_NUMBER_SIZE];
+            m_Out.append(text, format_unsigned(value, text));
+        }
+
+        void operator()(double value)
+        {
+            bl_char text[BLOGGER_NUMBER_SIZE];
+            m_Out.append(text, format_double(value, text));
+        }
+
+        void operator()(long double value)
+        {
+            (*this)(static_cast<double>(value));
+        }
+
+        void operator()(const deferred_string& value)
+        {
+            m_WriteString(m_Out, value.data, value.size);
+        }
+
+        void operator()(const void* value)
+        {
+            bl_char text[BLOGGER_NUMBER_SIZE];
+            m_WriteString(m_Out, text, format_pointer(value, text));
+        }
+    };
+
+    template<typename BufferT, typename StringWriterT>
+    field_value_writer<BufferT, StringWriterT> make_value_writer(BufferT& out, StringWriterT write_string)
+    {
+        return { out, write_string };
+    }
+
+    inline void assign_key(deferred_string& key, const deferred_string& arg)
+    {
+        key = arg;
+    }
+
+    // keys are always strings
+    template<typename T>
+    void assign_key(deferred_string&, const T&)
+    {
+    }
+
+    // Calls handler(key, value) for every encoded field, where
+    // key is a deferred_string and value any decoded argument
+    template<typename HandlerT>
+    void read_fields(const bl_char* data, size_t size, HandlerT&& handler)
+    {
+        deferred_string key = { nullptr, 0 };
+        bool is_key = true;
+
+        read_deferred(data, size,
+            [&](const auto& arg)
+            {
+                if (is_key)
+                    assign_key(key, arg);
+                else
+                    handler(key, arg);
+
+                is_key = !is_key;
+            }
+        );
+    }
+
+    struct json_string_writer
+    {
+        template<typename BufferT>
+        void operator()(BufferT& out, const bl_char* data, size_t size)
+        {
+            append_json_string(out, data, size);
+        }
+    };
+
+    struct logfmt_string_writer
+    {
+        template<typename BufferT>
+        void operator()(BufferT& out, const bl_char* data, size_t size)
+        {
+            append_logfmt_value(out, data, size);
+        }
+    };
+
+    struct plain_string_writer
+    {
+        template<typename BufferT>
+        void operator()(BufferT& out, const bl_char* data, size_t size)
+        {
+            out.append(data, size);
+        }
+    };
+
+    // key=value pairs separated by spaces, keys are written as
+    // they are except for the characters logfmt can't have in them
+    template<typename BufferT>
+    void append_logfmt_fields(BufferT& out, const bl_char* data, size_t size)
+    {
+        bool first = true;
+        auto writer = make_value_writer(out, logfmt_string_writer());
+
+        read_fields(data, size,
+            [&](const deferred_string& key, const auto& value)
+            {
+                if (!first)
+                    out.push_back(' ');
+
+                const byte_set replaced(' ' + 1, '=', '"');
+
+                for (size_t i = 0; i < key.size;)
+                {
+                    size_t plain = find_first_of(key.data + i, key.size - i, replaced);
+                    out.append(key.data + i, plain);
+
+                    i += plain;
+
+                    if (i < key.size)
+                    {
+                        out.push_back('_');
+                        i++;
+                    }
+                }
+
+                out.push_back('=');
+                writer(value);
+
+                first = false;
+            }
+        );
+    }
+
+    // JSON has no nan or inf, they become null
+    template<typename BufferT, typename T>
+    void json_value(BufferT& out, const T& value)
+    {
+        make_value_writer(out, json_string_writer())(value);
+    }
+
+    template<typename BufferT>
+    void json_value(BufferT& out, double value)
+    {
+        if (std::isfinite(value))
+            make_value_writer(out, json_string_writer())(value);
+        else
+            out.append("null", 4);
+    }
+
+    template<typename BufferT>
+    void json_value(BufferT& out, long double value)
+    {
+        json_value(out, static_cast<double>(value));
+    }
+
+    // "key":value members, each preceded by a comma
+    template<typename BufferT>
+    void append_json_fields(BufferT& out, const bl_char* data, size_t size)
+    {
+        read_fields(data, size,
+            [&out](const deferred_string& key, const auto& value)
+            {
+                out.push_back(',');
+                append_json_string(out, key.data, key.size);
+                out.push_back(':');
+
+                json_value(out, value);
+            }
+        );
+    }
+
+    // The value of the first field called key as plain text
+    template<typename BufferT>
+    void append_field_value(BufferT& out, const bl_char* key, size_t key_size, const bl_char* data, size_t size)
+    {
+        bool found = false;
+        auto writer = make_value_writer(out, plain_string_writer());
+
+        read_fields(data, size,
+            [&](const deferred_string& name, const auto& value)
+            {
+                if (found || name.size != key_size || memcmp(name.data, key, key_size))
+                    return;
+
+                writer(value);
+                found = true;
+            }
+        );
+    }
+}
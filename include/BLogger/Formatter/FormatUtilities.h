@@ -1,6 +1,10 @@
 #pragma once
 
 #include <utility>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <mutex>
 
 // ---- Custom BLogger types ----
 typedef char bl_char;
@@ -17,13 +21,12 @@ typedef std::lock_guard<std::mutex> locker;
     #include <string_view>
     typedef std::basic_string_view<bl_char, std::char_traits<bl_char>> BLoggerInString;
 #elif _MSVC_LANG >= 201402L || __cplusplus >= 201402L
-    #define BLOGGER_PROCESS_PACK(formatter, args) int expander[] = { 0, ( (void) formatter.handle_pack(std::forward<Args>(args)), 0) ... }
+    #define BLOGGER_PROCESS_PACK(formatter, args) int expander[] = { 0, ( (void) formatter.handle_pack(std::forward<Args>(args)), 0) ... }; (void) expander
     typedef const std::basic_string<bl_char, std::char_traits<bl_char>>& BLoggerInString;
 #else
     #error "BLogger requires at least /std:c++14"
 #endif
 
 // ---- Some useful defines ----
-#define BLOGGER_BUFFER_SIZE 128
-#define BLOGGER_TIMESTAMP "%H:%M:%S" // should be made customizable later
+#define BLOGGER_TIMESTAMP "%H:%M:%S" // the default, see SetTimestampFormat
 #define BLOGGER_ARG_PATTERN "{}"
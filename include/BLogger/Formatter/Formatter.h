@@ -6,277 +6,276 @@
 #include <sstream>
 #include <vector>
 #include <mutex>
+#include <atomic>
 
 #include "BLogger/LogLevels.h"
 #include "FormatUtilities.h"
+#include "StaticFormat.h"
+#include "Timestamp.h"
+#include "SmallBuffer.h"
+#include "ArgStream.h"
+#include "ArgText.h"
+#include "DeferredArgs.h"
+#include "NumberFormat.h"
+#include "Fields.h"
+#include "Scan.h"
 #include "BLogger/OS/Functions.h"
 
 namespace BLogger
 {
+    enum class pattern_field : uint8_t
+    {
+        literal,
+        timestamp,
+        level,
+        message,
+        thread_id,
+        milliseconds,
+        microseconds,
+
+        // the key/value fields of the message in logfmt
+        fields,
+
+        // the whole message as a JSON object
+        json,
+
+        // the value of the field whose key is the literal
+        named_field
+    };
+
+    struct pattern_segment
+    {
+        pattern_field field;
+
+        // the range inside the literal buffer if the
+        // segment is a literal, or the key of a named_field
+        size_t offset;
+        size_t size;
+    };
+
+    // The pattern is compiled once into a flat list
+    // of literal and field segments, applying it
+    // to a message is then just a series of appends.
     template<typename bufferT>
     class blogger_basic_pattern
     {
     private:
-        bufferT m_Buffer;
-
-        bool m_HasTimestamp;
-        bool m_HasMsg;
-        bool m_MsgFirst;
-        bool m_HasLvl;
-
-        size_t m_TimeOffset;
-        size_t m_TimeSize;
+        bufferT                      m_Literals;
+        std::vector<pattern_segment> m_Segments;
+        BLoggerString                m_TimestampFormat;
+        BLoggerString                m_Tag;
+        bool                         m_RendersFields;
+        uint64_t                     m_Id;
     public:
         blogger_basic_pattern()
-            : m_Buffer(BLOGGER_BUFFER_SIZE),
-            m_HasTimestamp(false),
-            m_HasMsg(false),
-            m_MsgFirst(false),
-            m_HasLvl(false),
-            m_TimeOffset(0),
-            m_TimeSize(0)
-        {
-        }
-
-        void init()
-        {
-            m_Buffer.resize(BLOGGER_BUFFER_SIZE);
-
-            m_HasTimestamp = false;
-            m_HasMsg       = false;
-            m_MsgFirst     = false;
-            m_HasLvl       = false;
-            m_TimeOffset   = 0;
-            m_TimeSize     = 0;
-
-            memset(m_Buffer.data(), 0, m_Buffer.size());
-        }
-
-        bl_char* ts_begin()
-        {
-            return m_Buffer.data() + m_TimeOffset;
-        }
-
-        size_t ts_size()
-        {
-            return m_TimeSize;
-        }
-
-        bl_char last_ts_char()
+            : m_Literals(),
+            m_Segments(),
+            m_TimestampFormat(BLOGGER_TIMESTAMP),
+            m_Tag(),
+            m_RendersFields(false),
+            m_Id(next_id())
         {
-            return m_Buffer[ptr_to_index(ts_begin() + m_TimeSize)];
         }
 
-        bl_char* data()
+        const BLoggerString& tag() const
         {
-            return m_Buffer.data();
+            return m_Tag;
         }
 
-        size_t size()
+        // Whether any of {fields}, {json} or {field:key} is used,
+        // otherwise the fields of a message are appended to {msg}
+        bool renders_fields() const
         {
-            return m_Buffer.size();
+            return m_RendersFields;
         }
 
-        void set_memorized(bl_char symbol)
+        const bl_char* timestamp_format() const
         {
-            m_Buffer[ptr_to_index(ts_begin() + m_TimeSize)] = symbol;
+            return m_TimestampFormat.c_str();
         }
 
-        bool timestamp()
+        // Unique for every pattern ever created,
+        // used as the timestamp cache key
+        uint64_t id() const
         {
-            return m_HasTimestamp;
+            return m_Id;
         }
 
-        bool lvl()
+        void init()
         {
-            return m_HasLvl;
+            m_Literals.clear();
+            m_Segments.clear();
+            m_RendersFields = false;
         }
 
-        bool msg()
+        const std::vector<pattern_segment>& segments() const
         {
-            return m_HasMsg;
+            return m_Segments;
         }
 
-        bool msg_first()
+        const bl_char* literal(const pattern_segment& segment) const
         {
-            return m_MsgFirst;
+            return m_Literals.data() + segment.offset;
         }
 
-        size_t zero_term()
+        // an upper bound of the literal bytes per message
+        size_t literal_size() const
         {
-            auto loc = std::find(m_Buffer.begin(), m_Buffer.end(), '\0');
-
-            return loc != m_Buffer.end() ? ptr_to_index(&*loc) : m_Buffer.size();
+            return m_Literals.size();
         }
 
         bool set_pattern(
             BLoggerInString pattern,
-            BLoggerInString tag
+            BLoggerInString tag,
+            BLoggerInString timestamp_format = BLOGGER_TIMESTAMP
         )
         {
-            if (pattern.empty())
-                return true;
-
             #define BLOGGER_TS_PATTERN  "{ts}"
             #define BLOGGER_TAG_PATTERN "{tag}"
             #define BLOGGER_LVL_PATTERN "{lvl}"
             #define BLOGGER_MSG_PATTERN "{msg}"
-
-            MEMORY_COPY(m_Buffer.data(), m_Buffer.size(), pattern.data(), pattern.size());
-
-            auto ts_offset  = pattern.find(BLOGGER_TS_PATTERN);
-            auto tag_offset = pattern.find(BLOGGER_TAG_PATTERN);
-            auto lvl_offset = pattern.find(BLOGGER_LVL_PATTERN);
-            auto msg_offset = pattern.find(BLOGGER_MSG_PATTERN);
-
-            bool first_arg = true;
-
-            if (msg_offset != BLoggerString::npos && lvl_offset != BLoggerString::npos)
-            {
-                m_MsgFirst = msg_offset < lvl_offset;
-                m_HasMsg = true;
-            }
-            else if (msg_offset != BLoggerString::npos)
+            #define BLOGGER_TID_PATTERN "{tid}"
+            #define BLOGGER_MS_PATTERN  "{ms}"
+            #define BLOGGER_US_PATTERN  "{us}"
+            #define BLOGGER_FIELDS_PATTERN "{fields}"
+            #define BLOGGER_JSON_PATTERN   "{json}"
+            #define BLOGGER_FIELD_PREFIX   "{field:"
+
+            init();
+            m_TimestampFormat = BLoggerString(timestamp_format.data(), timestamp_format.size());
+            m_Tag = BLoggerString(tag.data(), tag.size());
+
+            size_t literal_begin = 0;
+
+            // every field starts with a brace, the text
+            // in between is skipped by find_brace
+            for (size_t i = find_brace(pattern.data(), pattern.size(), 0); i < pattern.size();)
             {
-                m_MsgFirst = true;
-                m_HasMsg = true;
-            }
+                size_t length = 0;
+                pattern_field field = pattern_field::literal;
+                bool is_tag = false;
 
-            for (size_t i = 0; i < pattern.size(); i++)
-            {
-                if (ts_offset != BLoggerString::npos && ts_offset == i)
+                if (matches(pattern, i, BLOGGER_TS_PATTERN))
                 {
-                    m_HasTimestamp = true;
-
-                    m_TimeOffset = first_arg ?
-                       ts_offset :
-                       new_offset(BLOGGER_TS_PATTERN);
-
-                    m_TimeSize = strlen(BLOGGER_TIMESTAMP);
-
-                    set_arg(
-                        first_arg ? 
-                        ts_offset : 
-                        new_offset(BLOGGER_TS_PATTERN),
-                        BLOGGER_TIMESTAMP,
-                        BLOGGER_TS_PATTERN
-                    );
-
-                    first_arg = false;
+                    field = pattern_field::timestamp;
+                    length = strlen(BLOGGER_TS_PATTERN);
                 }
-
-                if (tag_offset != BLoggerString::npos && tag_offset == i)
+                else if (matches(pattern, i, BLOGGER_LVL_PATTERN))
                 {
-                    set_arg(
-                        first_arg ?
-                        tag_offset :
-                        new_offset(BLOGGER_TAG_PATTERN),
-                        tag.data(),
-                        BLOGGER_TAG_PATTERN
-                    );
-
-                    first_arg = false;
+                    field = pattern_field::level;
+                    length = strlen(BLOGGER_LVL_PATTERN);
                 }
-
-                if (lvl_offset != BLoggerString::npos && lvl_offset == i)
+                else if (matches(pattern, i, BLOGGER_MSG_PATTERN))
                 {
-                    m_HasLvl = true;
-
-                    set_arg(
-                        first_arg ?
-                        lvl_offset :
-                        new_offset(BLOGGER_LVL_PATTERN),
-                        "%s", 
-                        BLOGGER_LVL_PATTERN
-                    );
-
-                    first_arg = false;
+                    field = pattern_field::message;
+                    length = strlen(BLOGGER_MSG_PATTERN);
                 }
-
-                if (msg_offset != BLoggerString::npos && msg_offset == i)
+                else if (matches(pattern, i, BLOGGER_TID_PATTERN))
                 {
-                    set_arg(
-                        first_arg ?
-                        msg_offset :
-                        new_offset(BLOGGER_MSG_PATTERN),
-                        "%s",
-                        BLOGGER_MSG_PATTERN
-                    );
+                    field = pattern_field::thread_id;
+                    length = strlen(BLOGGER_TID_PATTERN);
+                }
+                else if (matches(pattern, i, BLOGGER_MS_PATTERN))
+                {
+                    field = pattern_field::milliseconds;
+                    length = strlen(BLOGGER_MS_PATTERN);
+                }
+                else if (matches(pattern, i, BLOGGER_US_PATTERN))
+                {
+                    field = pattern_field::microseconds;
+                    length = strlen(BLOGGER_US_PATTERN);
+                }
+                else if (matches(pattern, i, BLOGGER_TAG_PATTERN))
+                {
+                    is_tag = true;
+                    length = strlen(BLOGGER_TAG_PATTERN);
+                }
+                else if (matches(pattern, i, BLOGGER_FIELDS_PATTERN))
+                {
+                    field = pattern_field::fields;
+                    length = strlen(BLOGGER_FIELDS_PATTERN);
+                }
+                else if (matches(pattern, i, BLOGGER_JSON_PATTERN))
+                {
+                    field = pattern_field::json;
+                    length = strlen(BLOGGER_JSON_PATTERN);
+                }
+                else if (matches(pattern, i, BLOGGER_FIELD_PREFIX))
+                {
+                    size_t key = i + strlen(BLOGGER_FIELD_PREFIX);
+                    size_t end = pattern.find('}', key);
+
+                    if (end != BLoggerString::npos)
+                    {
+                        field = pattern_field::named_field;
+                        length = end + 1 - i;
+                    }
+                }
 
-                    first_arg = false;
+                if (!length)
+                {
+                    i = find_brace(pattern.data(), pattern.size(), i + 1);
+                    continue;
                 }
-            }
 
-            return true;
-        }
+                add_literal(pattern.data() + literal_begin, i - literal_begin);
 
-        blogger_basic_pattern<bufferT>& operator=(const blogger_basic_pattern<bufferT>& other)
-        {
-            this->m_Buffer = other.m_Buffer;
-            this->m_HasTimestamp = other.m_HasTimestamp;
-            this->m_HasMsg = other.m_HasMsg;
-            this->m_MsgFirst = other.m_MsgFirst;
-            this->m_HasLvl = other.m_HasLvl;
-            this->m_TimeOffset = other.m_TimeOffset;
-            this->m_TimeSize = other.m_TimeSize;
+                // the tag is known upfront so it's just a literal
+                if (is_tag)
+                    add_literal(tag.data(), tag.size());
+                else if (field == pattern_field::named_field)
+                {
+                    size_t key = i + strlen(BLOGGER_FIELD_PREFIX);
+                    size_t key_size = length - strlen(BLOGGER_FIELD_PREFIX) - 1;
 
-            return *this;
-        }
+                    m_Segments.push_back({ field, m_Literals.size(), key_size });
+                    m_Literals.insert(m_Literals.end(), pattern.data() + key, pattern.data() + key + key_size);
+                }
+                else
+                    m_Segments.push_back({ field, 0, 0 });
 
-        private:
-            size_t ptr_to_index(bl_char* p)
-            {
-                return (p - m_Buffer.data());
-            }
+                if (field == pattern_field::fields ||
+                    field == pattern_field::json ||
+                    field == pattern_field::named_field)
+                    m_RendersFields = true;
 
-            size_t new_offset(const bl_char* arg)
-            {
-                auto index = std::search(
-                    m_Buffer.begin(),
-                    m_Buffer.end(),
-                    arg,
-                    arg +
-                    std::strlen(arg)
-                );
-
-                return ptr_to_index(&*index);
+                i += length;
+                literal_begin = i;
+                i = find_brace(pattern.data(), pattern.size(), i);
             }
 
-            void set_arg(size_t offset, const bl_char* pattern, const bl_char* arg)
-            {
-                m_Buffer[offset] = '%';
-                m_Buffer[offset + 1] = 's';
+            add_literal(pattern.data() + literal_begin, pattern.size() - literal_begin);
 
-                int32_t extra_size = static_cast<int32_t>(std::strlen(arg) - 2);
+            return true;
+        }
+    private:
+        static uint64_t next_id()
+        {
+            static std::atomic<uint64_t> id(1);
+            return id.fetch_add(1, std::memory_order_relaxed);
+        }
 
-                bl_char* arg_end = (&m_Buffer[offset]) + 2;
+        static bool matches(BLoggerInString pattern, size_t offset, const bl_char* field)
+        {
+            size_t size = strlen(field);
 
-                if (extra_size > 0)
-                {
-                    MEMORY_MOVE(
-                        arg_end,
-                        m_Buffer.size() -
-                        ptr_to_index(arg_end),
-                        arg_end +
-                        extra_size,
-                        m_Buffer.size() -
-                        ptr_to_index(arg_end + extra_size)
-                    );
-                }
+            return pattern.size() - offset >= size &&
+                   memcmp(pattern.data() + offset, field, size) == 0;
+        }
 
-                bl_char copy[BLOGGER_BUFFER_SIZE];
-                MEMORY_COPY(copy, BLOGGER_BUFFER_SIZE, m_Buffer.data(), m_Buffer.size());
+        void add_literal(const bl_char* data, size_t size)
+        {
+            if (!size)
+                return;
 
-                auto size = m_Buffer.size() -
-                    ptr_to_index(arg_end);
+            // merge adjacent literals, e.g. text followed by the tag
+            if (!m_Segments.empty() && m_Segments.back().field == pattern_field::literal)
+                m_Segments.back().size += size;
+            else
+                m_Segments.push_back({ pattern_field::literal, m_Literals.size(), size });
 
-                snprintf(
-                    &m_Buffer[offset],
-                    size,
-                    copy + offset,
-                    pattern
-                );
-            }
+            m_Literals.insert(m_Literals.end(), data, data + size);
+        }
     };
 
     typedef blogger_basic_pattern<BLoggerBuffer>
@@ -284,86 +283,90 @@ namespace BLogger
     typedef std::shared_ptr<BLoggerPattern>
         BLoggerSharedPattern;
 
-    template<typename bufferT>
+    template<size_t inlineCapacity = BLOGGER_INLINE_BUFFER_SIZE>
     class blogger_basic_formatter
     {
+    public:
+        typedef blogger_small_buffer<inlineCapacity>
+            buffer_type;
     protected:
-        bufferT    m_Buffer;
-        bl_char*   m_Cursor;
-        size_t     m_Occupied;
-        size_t     m_ArgCount;
+        buffer_type m_Buffer;
+        size_t      m_ArgCount;
     public:
         blogger_basic_formatter()
-            : m_Buffer(BLOGGER_BUFFER_SIZE),
-            m_Cursor(m_Buffer.data()),
-            m_Occupied(0),
+            : m_Buffer(),
             m_ArgCount(0)
         {
         }
 
+        // Built-in types are formatted without a stream, see arg_text
         template<typename T>
         void handle_pack(T&& arg)
         {
-            BLoggerStringStream ss;
+            arg_text_for<T> text(std::forward<T>(arg));
 
-            *this << *static_cast<BLoggerStringStream*>(&(ss << std::forward<T&&>(arg)));
+            substitute(text.data(), text.size());
         }
 
-        int32_t remaining()
+        // Writes the argument at the cursor
+        template<typename T>
+        void write_arg(const T& arg)
         {
-            return static_cast<int32_t>(m_Buffer.size()) -
-                   static_cast<int32_t>(m_Occupied);
-        }
+            arg_text_for<T> text(arg);
 
-        bl_char* data()
-        {
-            return m_Buffer.data();
+            write_to(text.data(), text.size());
         }
 
-        bl_char* cursor()
+        // A single pass over the format string,
+        // the placeholders were found at compile time
+        template<typename... Args>
+        void format_static(
+            const static_format_layout& layout,
+            const bl_char* format,
+            const Args& ... args
+        )
         {
-            return m_Cursor;
+            size_t offset = 0;
+
+            for (size_t i = 0; i < layout.count; i++)
+            {
+                write_to(format + offset, layout.offsets[i] - offset);
+                write_nth_arg(layout.bindings[i], args...);
+                offset = layout.offsets[i] + layout.lengths[i];
+            }
+
+            write_to(format + offset, layout.size - offset);
         }
 
-        size_t size()
+        bl_char* data()
         {
-            return m_Occupied;
+            return m_Buffer.data();
         }
 
-        void advance_cursor_by(size_t count)
+        size_t size()
         {
-            m_Cursor += count;
-            m_Occupied += count;
+            return m_Buffer.size();
         }
 
-        BLoggerBuffer& get_buffer()
+        buffer_type& get_buffer()
         {
             return m_Buffer;
         }
 
-        BLoggerBuffer&& release_buffer()
+        buffer_type&& release_buffer()
         {
-            m_Buffer.resize(m_Occupied);
             return std::move(m_Buffer);
         }
 
         void reset_buffer()
         {
-            m_Buffer.resize(BLOGGER_BUFFER_SIZE);
-            m_Occupied = 0;
+            m_Buffer.clear();
             m_ArgCount = 0;
-            m_Cursor = m_Buffer.data();
-            memset(m_Buffer.data(), 0, m_Buffer.size());
         }
 
         void write_to(const bl_char* data, size_t size)
         {
-            if ((m_Buffer.size() - m_Occupied) >= size)
-            {
-                MEMORY_COPY(m_Cursor, remaining(), data, size);
-                m_Cursor += size;
-                m_Occupied += size;
-            }
+            m_Buffer.append(data, size);
         }
 
         void process_message(const bl_char* msg, size_t size)
@@ -371,197 +374,249 @@ namespace BLogger
             write_to(msg, size);
         }
 
+        // The last fields_size bytes of formatted_msg
+        // are the encoded fields of the message
         static void merge_pattern(
-            bl_string& formatted_msg,
-            BLoggerSharedPattern global_pattern,
-            std::tm* time_ptr, 
-            level lvl
+            BLoggerMessageBuffer& formatted_msg,
+            const BLoggerPattern& pattern,
+            blogger_timestamp timestamp,
+            level lvl,
+            uint64_t thread_id,
+            size_t fields_size = 0
         )
         {
-            BLoggerPattern ptrn;
-            ptrn = *global_pattern;
+            merge_pattern_at(
+                formatted_msg,
+                pattern,
+                to_wall_clock_ns(timestamp),
+                lvl,
+                thread_id,
+                fields_size
+            );
+        }
+
+        // Same as merge_pattern with the wall clock
+        // time in nanoseconds since epoch
+        static void merge_pattern_at(
+            BLoggerMessageBuffer& formatted_msg,
+            const BLoggerPattern& pattern,
+            int64_t wall_ns,
+            level lvl,
+            uint64_t thread_id,
+            size_t fields_size = 0
+        )
+        {
+            size_t text_size = formatted_msg.size() - fields_size;
+            const bl_char* fields = formatted_msg.data() + text_size;
 
-            size_t message_size = formatted_msg.size() + 1;
-            bl_char* message; STACK_ALLOC(message_size, message);
-            message[message_size - 1] = '\0';
-            MEMORY_COPY(message, message_size, formatted_msg.data(), formatted_msg.size());
+            BLoggerMessageBuffer out;
+            out.reserve(pattern.literal_size() + formatted_msg.size() + 64);
 
-            if (ptrn.timestamp())
+            for (const auto& segment : pattern.segments())
             {
-                bl_char memorized = ptrn.last_ts_char();
-                auto intended_size = strftime(ptrn.ts_begin(), ptrn.size(), BLOGGER_TIMESTAMP, time_ptr);
-                ptrn.set_memorized(memorized);
-
-                if (!ptrn.lvl() && !ptrn.msg())
+                switch (segment.field)
+                {
+                case pattern_field::literal:
+                    out.append(pattern.literal(segment), segment.size);
+                    break;
+                case pattern_field::timestamp:
+                {
+                    bl_char text[64];
+                    size_t size = timestamp_cache::render(
+                        pattern.id(),
+                        pattern.timestamp_format(),
+                        wall_ns,
+                        text,
+                        sizeof(text)
+                    );
+                    out.append(text, size);
+                    break;
+                }
+                case pattern_field::milliseconds:
+                {
+                    bl_char text[3];
+                    timestamp_cache::render_fraction(wall_ns, 3, text);
+                    out.append(text, 3);
+                    break;
+                }
+                case pattern_field::microseconds:
+                {
+                    bl_char text[6];
+                    timestamp_cache::render_fraction(wall_ns, 6, text);
+                    out.append(text, 6);
+                    break;
+                }
+                case pattern_field::level:
                 {
-                    formatted_msg.resize(ptrn.zero_term());
-                    MEMORY_COPY(formatted_msg.data(), formatted_msg.size(), ptrn.data(), formatted_msg.size());
+                    const bl_char* name = LevelToString(lvl);
+                    out.append(name, strlen(name));
+                    break;
+                }
+                case pattern_field::message:
+                    out.append(formatted_msg.data(), text_size);
+
+                    if (fields_size && !pattern.renders_fields())
+                    {
+                        out.push_back(' ');
+                        append_logfmt_fields(out, fields, fields_size);
+                    }
+                    break;
+                case pattern_field::thread_id:
+                {
+                    bl_char text[BLOGGER_NUMBER_SIZE];
+                    out.append(text, format_unsigned(thread_id, text));
+                    break;
+                }
+                case pattern_field::fields:
+                    append_logfmt_fields(out, fields, fields_size);
+                    break;
+                case pattern_field::named_field:
+                    append_field_value(out, pattern.literal(segment), segment.size, fields, fields_size);
+                    break;
+                case pattern_field::json:
+                    append_json_record(out, pattern, formatted_msg.data(), text_size, fields, fields_size, wall_ns, lvl, thread_id);
+                    break;
                 }
             }
 
-            if (ptrn.lvl() && ptrn.msg())
-            {
-                bl_char copy[BLOGGER_BUFFER_SIZE];
-                MEMORY_COPY(copy, BLOGGER_BUFFER_SIZE, ptrn.data(), ptrn.size());
-
-                auto intended_size = snprintf(
-                    ptrn.data(),
-                    ptrn.size(),
-                    copy,
-                    (ptrn.msg_first() ?
-                    message :
-                    LevelToString(lvl)),
-                    (ptrn.msg_first() ?
-                    LevelToString(lvl) :
-                    message)
-                );
-
-                intended_size > BLOGGER_BUFFER_SIZE ?
-                    formatted_msg.resize(BLOGGER_BUFFER_SIZE):
-                    formatted_msg.resize(intended_size);
-
-                MEMORY_COPY(formatted_msg.data(), formatted_msg.size(), ptrn.data(), ptrn.zero_term());
-            }
-            else if(ptrn.lvl())
-            {
-                bl_char copy[BLOGGER_BUFFER_SIZE];
-                MEMORY_COPY(copy, BLOGGER_BUFFER_SIZE, ptrn.data(), ptrn.size());
+            out.push_back('\n');
+            formatted_msg = std::move(out);
+        }
+    private:
+        // {"ts":...,"level":...,"tag":...,"tid":...,"msg":...} followed
+        // by the fields, the timestamp is RFC 3339 in UTC
+        static void append_json_record(
+            BLoggerMessageBuffer& out,
+            const BLoggerPattern& pattern,
+            const bl_char* text,
+            size_t text_size,
+            const bl_char* fields,
+            size_t fields_size,
+            int64_t wall_ns,
+            level lvl,
+            uint64_t thread_id
+        )
+        {
+            bl_char timestamp[BLOGGER_RFC3339_SIZE];
+            timestamp_cache::render_rfc3339(wall_ns, timestamp);
 
-                auto intended_size = snprintf(
-                    ptrn.data(),
-                    ptrn.size(),
-                    copy,
-                    LevelToString(lvl)
-                );
+            out.append("{\"ts\":\"", 7);
+            out.append(timestamp, sizeof(timestamp));
 
-                intended_size > BLOGGER_BUFFER_SIZE ?
-                    formatted_msg.resize(BLOGGER_BUFFER_SIZE):
-                    formatted_msg.resize(intended_size);
+            const bl_char* name = LevelToString(lvl);
+            out.append("\",\"level\":\"", 11);
+            out.append(name, strlen(name));
 
-                MEMORY_COPY(formatted_msg.data(), formatted_msg.size(), ptrn.data(), formatted_msg.size());
-            }
-            else if (ptrn.msg())
-            {
-                bl_char copy[BLOGGER_BUFFER_SIZE];
-                MEMORY_COPY(copy, BLOGGER_BUFFER_SIZE, ptrn.data(), ptrn.size());
+            out.append("\",\"tag\":", 8);
+            append_json_string(out, pattern.tag().data(), pattern.tag().size());
 
-                auto intended_size = snprintf(
-                    ptrn.data(),
-                    ptrn.size(),
-                    copy,
-                    message
-                );
+            bl_char number[BLOGGER_NUMBER_SIZE];
+            out.append(",\"tid\":", 7);
+            out.append(number, format_unsigned(thread_id, number));
 
-                intended_size > BLOGGER_BUFFER_SIZE ?
-                    formatted_msg.resize(BLOGGER_BUFFER_SIZE):
-                    formatted_msg.resize(intended_size);
+            out.append(",\"msg\":", 7);
+            append_json_string(out, text, text_size);
 
-                MEMORY_COPY(formatted_msg.data(), formatted_msg.size(), ptrn.data(), formatted_msg.size());
-            }
-            else if (!ptrn.lvl() && !ptrn.msg() && !ptrn.timestamp())
-            {
-                formatted_msg.resize(ptrn.zero_term());
-                MEMORY_COPY(formatted_msg.data(), formatted_msg.size(), ptrn.data(), formatted_msg.size());
-            }
+            append_json_fields(out, fields, fields_size);
+            out.push_back('}');
+        }
+
+        void write_nth_arg(size_t)
+        {
+        }
 
-            if (formatted_msg.size() < BLOGGER_BUFFER_SIZE)
-                formatted_msg.emplace_back('\n');
+        template<typename T, typename... Args>
+        void write_nth_arg(size_t index, const T& arg, const Args& ... args)
+        {
+            if (index)
+                write_nth_arg(index - 1, args...);
             else
-                formatted_msg[formatted_msg.size() - 1] = '\n';
+                write_arg(arg);
         }
-    private:
-        void operator<<(BLoggerStringStream& ss)
+
+        // Replaces {N} where N is the index of the current
+        // argument, or the first {} if there's no such placeholder
+        void substitute(const bl_char* data, size_t size)
         {
-            BLoggerString pattern = "{";
-            pattern += std::to_string(m_ArgCount++);
-            pattern += "}";
-            bl_char* cursor = get_pos_arg(pattern);
+            size_t length;
+            size_t offset = find_arg(m_ArgCount++, length);
 
-            if (cursor)
-            {
-                cursor[0] = '%';
-                cursor[1] = 's';
+            if (offset != m_Buffer.size())
+                m_Buffer.replace(offset, length, data, size);
+        }
 
-                size_t offset = cursor - m_Buffer.data() + 2;
-                bl_char* begin = m_Buffer.data() + offset + pattern.size() - 2;
-                size_t end = m_Buffer.size() - offset + pattern.size() - 2;
+        // One pass over the occupied part of the buffer that only
+        // stops at braces, the offset of the placeholder is returned
+        // and its size written to length. The size of the buffer is
+        // returned if there's neither {index} nor {}.
+        size_t find_arg(size_t index, size_t& length)
+        {
+            const bl_char* data = m_Buffer.data();
+            size_t size = m_Buffer.size();
 
-                MEMORY_MOVE(m_Buffer.data() + offset, m_Buffer.size(), begin, end);
-            }
-            else
-            {
-                cursor = get_next_arg();
+            bl_char digits[BLOGGER_NUMBER_SIZE];
+            size_t digit_count = format_unsigned(index, digits);
 
-                if (!cursor) return;
+            size_t first_empty = size;
+
+            for (size_t i = find_brace(data, size, 0); i < size; i = find_brace(data, size, i + 1))
+            {
+                size_t rest = size - i - 1;
 
-                *cursor = '%';
-                *(cursor + 1) = 's';
+                if (rest && data[i + 1] == '}')
+                {
+                    if (first_empty == size)
+                        first_empty = i;
+                }
+                else if (rest > digit_count && data[i + 1 + digit_count] == '}' &&
+                         memcmp(data + i + 1, digits, digit_count) == 0)
+                {
+                    length = digit_count + 2;
+                    return i;
+                }
             }
 
-            bl_char format[BLOGGER_BUFFER_SIZE];
-            MEMORY_COPY(format, BLOGGER_BUFFER_SIZE, m_Buffer.data(), m_Buffer.size());
+            length = strlen(BLOGGER_ARG_PATTERN);
+            return first_empty;
+        }
+    };
 
-            auto intended_size =
-                snprintf(
-                    m_Buffer.data(),
-                    m_Buffer.size(),
-                    format,
-                    ss.str().c_str()
-                );
+    typedef blogger_basic_formatter<>
+        BLoggerFormatter;
 
-            // if snprintf returned more bytes than we have
-            // that means that our buffer is full
-            // so we just set the capacity to zero
-            intended_size > m_Buffer.size() ?
-                m_Occupied = m_Buffer.size() :
-                m_Occupied = intended_size;
-            m_Cursor = m_Buffer.data() + m_Occupied;
+    // Hands the arguments to the formatter and
+    // encodes the fields on the side
+    template<typename FormatterT>
+    class field_collector
+    {
+    private:
+        FormatterT&          m_Formatter;
+        BLoggerMessageBuffer m_Fields;
+    public:
+        explicit field_collector(FormatterT& formatter)
+            : m_Formatter(formatter),
+            m_Fields()
+        {
         }
 
-        void write_to_enclosed(const bl_char* data, size_t size, bl_char opening = '[', bl_char closing = ']')
+        template<typename T>
+        typename std::enable_if<!is_log_field<typename std::decay<T>::type>::value>::type
+        handle_pack(T&& arg)
         {
-            if ((m_Buffer.size() - m_Occupied) >= size + 2)
-            {
-                *(m_Cursor++) = opening;
-                ++m_Occupied;
-                MEMORY_COPY(m_Cursor, remaining(), data, size);
-                m_Occupied += size;
-                m_Cursor += size;
-                *(m_Cursor++) = closing;
-                ++m_Occupied;
-            }
+            m_Formatter.handle_pack(std::forward<T>(arg));
         }
 
-        bl_char* get_next_arg()
+        template<typename T>
+        void handle_pack(const log_field<T>& f)
         {
-            auto index = std::search(
-                m_Buffer.begin(),
-                m_Buffer.end(),
-                BLOGGER_ARG_PATTERN,
-                BLOGGER_ARG_PATTERN +
-                std::strlen(BLOGGER_ARG_PATTERN)
-            );
-
-            return (index != m_Buffer.end() ? &(*index) : nullptr);
+            append_encoded_field(m_Fields, f);
         }
 
-        bl_char* get_pos_arg(BLoggerInString pos)
+        BLoggerMessageBuffer& fields()
         {
-            auto cursor = std::search(
-                m_Buffer.begin(),
-                m_Buffer.end(),
-                pos.data(),
-                pos.data() +
-                pos.size()
-            );
-
-            return (cursor != m_Buffer.end() ? &(*cursor) : nullptr);
+            return m_Fields;
         }
     };
-
-    typedef blogger_basic_formatter<BLoggerBuffer>
-        BLoggerFormatter;
 }
 
-#undef BLOGGER_BUFFER_SIZE
 #undef BLOGGER_ARG_PATTERN
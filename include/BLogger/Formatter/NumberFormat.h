@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if _MSVC_LANG >= 201703L || __cplusplus >= 201703L
+    #include <charconv>
+#endif
+
+#include "BLogger/Formatter/FormatUtilities.h"
+
+// Enough for any of the formats below
+#define BLOGGER_NUMBER_SIZE 32
+
+namespace BLogger {
+
+    // Writes the digits of value to out, which must have room
+    // for 20 characters, and returns how many were written.
+    // Two digits at a time from a lookup table.
+    inline size_t format_unsigned(uint64_t value, bl_char* out)
+    {
+        static const char digits[] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        bl_char text[20];
+        size_t size = sizeof(text);
+
+        while (value >= 100)
+        {
+            size_t pair = static_cast<size_t>(value % 100) * 2;
+            value /= 100;
+
+            text[--size] = digits[pair + 1];
+            text[--size] = digits[pair];
+        }
+
+        if (value >= 10)
+        {
+            size_t pair = static_cast<size_t>(value) * 2;
+
+            text[--size] = digits[pair + 1];
+            text[--size] = digits[pair];
+        }
+        else
+            text[--size] = static_cast<bl_char>('0' + value);
+
+        memcpy(out, text + size, sizeof(text) - size);
+
+        return sizeof(text) - size;
+    }
+
+    // Room for 21 characters
+    inline size_t format_signed(int64_t value, bl_char* out)
+    {
+        if (value >= 0)
+            return format_unsigned(static_cast<uint64_t>(value), out);
+
+        *out = '-';
+
+        // negated as unsigned so that INT64_MIN doesn't overflow
+        return 1 + format_unsigned(0 - static_cast<uint64_t>(value), out + 1);
+    }
+
+    // The shortest text that reads back as the same double when the
+    // standard library has floating point to_chars, 17 significant
+    // digits otherwise. Non finite values are written as nan/inf.
+    // Room for BLOGGER_NUMBER_SIZE characters.
+    inline size_t format_double(double value, bl_char* out)
+    {
+        if (std::isnan(value))
+        {
+            memcpy(out, "nan", 3);
+            return 3;
+        }
+
+        if (std::isinf(value))
+        {
+            size_t size = value < 0 ? 4 : 3;
+            memcpy(out, value < 0 ? "-inf" : "inf", size);
+            return size;
+        }
+
+#if defined(__cpp_lib_to_chars)
+        std::to_chars_result result = std::to_chars(out, out + BLOGGER_NUMBER_SIZE, value);
+        return static_cast<size_t>(result.ptr - out);
+#else
+        int size = snprintf(out, BLOGGER_NUMBER_SIZE, "%.17g", value);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+#endif
+    }
+
+    // The same as a stream with its default flags (printf's %g),
+    // room for BLOGGER_NUMBER_SIZE characters
+    inline size_t format_general(double value, bl_char* out)
+    {
+#if defined(__cpp_lib_to_chars)
+        std::to_chars_result result = std::to_chars(
+            out, out + BLOGGER_NUMBER_SIZE, value, std::chars_format::general, 6
+        );
+        return static_cast<size_t>(result.ptr - out);
+#else
+        int size = snprintf(out, BLOGGER_NUMBER_SIZE, "%g", value);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+#endif
+    }
+
+    inline size_t format_general(float value, bl_char* out)
+    {
+        return format_general(static_cast<double>(value), out);
+    }
+
+    inline size_t format_general(long double value, bl_char* out)
+    {
+#if defined(__cpp_lib_to_chars)
+        std::to_chars_result result = std::to_chars(
+            out, out + BLOGGER_NUMBER_SIZE, value, std::chars_format::general, 6
+        );
+        return static_cast<size_t>(result.ptr - out);
+#else
+        int size = snprintf(out, BLOGGER_NUMBER_SIZE, "%Lg", value);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+#endif
+    }
+
+    // 0x followed by the lowercase hex digits, room for 18 characters
+    inline size_t format_pointer(const void* value, bl_char* out)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        uintptr_t bits = reinterpret_cast<uintptr_t>(value);
+
+        bl_char text[2 * sizeof(uintptr_t)];
+        size_t size = sizeof(text);
+
+        do
+        {
+            text[--size] = hex[bits & 0xF];
+            bits >>= 4;
+        } while (bits);
+
+        out[0] = '0';
+        out[1] = 'x';
+        memcpy(out + 2, text + size, sizeof(text) - size);
+
+        return 2 + sizeof(text) - size;
+    }
+
+    // What a stream writes for a pointer: 0x and the
+    // hex digits, or just 0 for null, with libstdc++/libc++,
+    // all of the uppercase digits with the msvc runtime
+    inline size_t format_stream_pointer(const void* value, bl_char* out)
+    {
+#ifdef _MSC_VER
+        static const char hex[] = "0123456789ABCDEF";
+
+        uintptr_t bits = reinterpret_cast<uintptr_t>(value);
+        size_t size = 2 * sizeof(uintptr_t);
+
+        for (size_t i = size; i > 0; i--)
+        {
+            out[i - 1] = hex[bits & 0xF];
+            bits >>= 4;
+        }
+
+        return size;
+#else
+        if (!value)
+        {
+            out[0] = '0';
+            return 1;
+        }
+
+        return format_pointer(value, out);
+#endif
+    }
+}
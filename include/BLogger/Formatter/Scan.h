@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define BLOGGER_HAS_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define BLOGGER_HAS_SSE2
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define BLOGGER_HAS_NEON
+#endif
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+#include "BLogger/Formatter/FormatUtilities.h"
+
+namespace BLogger {
+
+    // The bytes a scan stops at: every byte below `below`
+    // (none if it's 0) and up to three other characters
+    struct byte_set
+    {
+        uint8_t below;
+        uint8_t count;
+        bl_char chars[3];
+
+        // unused slots repeat the last character so
+        // that the vector loops can always compare all three
+        byte_set(uint8_t limit, bl_char a)
+            : below(limit), count(1), chars{ a, a, a }
+        {
+        }
+
+        byte_set(uint8_t limit, bl_char a, bl_char b)
+            : below(limit), count(2), chars{ a, b, b }
+        {
+        }
+
+        byte_set(uint8_t limit, bl_char a, bl_char b, bl_char c)
+            : below(limit), count(3), chars{ a, b, c }
+        {
+        }
+
+        bool contains(bl_char c) const
+        {
+            if (static_cast<uint8_t>(c) < below)
+                return true;
+
+            for (uint8_t i = 0; i < count; i++)
+            {
+                if (c == chars[i])
+                    return true;
+            }
+
+            return false;
+        }
+    };
+
+    inline size_t first_set_bit(uint64_t bits)
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+    #if defined(_M_X64) || defined(_M_ARM64)
+        unsigned long first;
+        _BitScanForward64(&first, bits);
+        return first;
+    #else
+        unsigned long first;
+
+        if (_BitScanForward(&first, static_cast<unsigned long>(bits)))
+            return first;
+
+        _BitScanForward(&first, static_cast<unsigned long>(bits >> 32));
+        return 32 + first;
+    #endif
+#else
+        return static_cast<size_t>(__builtin_ctzll(bits));
+#endif
+    }
+
+    // The offset of the first byte of data that's in the set, or
+    // size if there is none. Only the given size is ever read, 32
+    // bytes at a time with AVX2 and 16 with SSE2 or NEON, so plain
+    // text is skipped without looking at every byte.
+    inline size_t find_first_of(const bl_char* data, size_t size, const byte_set& set)
+    {
+        size_t i = 0;
+
+#ifdef BLOGGER_HAS_AVX2
+        {
+            // unsigned chunk < below is max(chunk, below - 1) == below - 1,
+            // with below == 0 there's nothing to look for
+            const __m256i limit = _mm256_set1_epi8(static_cast<char>(set.below - 1));
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i use_limit = set.below ? _mm256_cmpeq_epi8(zero, zero) : zero;
+
+            const __m256i a = _mm256_set1_epi8(set.chars[0]);
+            const __m256i b = _mm256_set1_epi8(set.chars[1]);
+            const __m256i c = _mm256_set1_epi8(set.chars[2]);
+
+            for (; i + 32 <= size; i += 32)
+            {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+
+                __m256i mask = _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, limit), limit), use_limit
+                );
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chunk, a));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chunk, b));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chunk, c));
+
+                uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+
+                if (bits)
+                    return i + first_set_bit(bits);
+            }
+        }
+#endif
+
+#ifdef BLOGGER_HAS_SSE2
+        {
+            const __m128i limit = _mm_set1_epi8(static_cast<char>(set.below - 1));
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i use_limit = set.below ? _mm_cmpeq_epi8(zero, zero) : zero;
+
+            const __m128i a = _mm_set1_epi8(set.chars[0]);
+            const __m128i b = _mm_set1_epi8(set.chars[1]);
+            const __m128i c = _mm_set1_epi8(set.chars[2]);
+
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+                __m128i mask = _mm_and_si128(
+                    _mm_cmpeq_epi8(_mm_max_epu8(chunk, limit), limit), use_limit
+                );
+                mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, a));
+                mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, b));
+                mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, c));
+
+                uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(mask));
+
+                if (bits)
+                    return i + first_set_bit(bits);
+            }
+        }
+#elif defined(BLOGGER_HAS_NEON)
+        {
+            const uint8x16_t limit = vdupq_n_u8(set.below);
+            const uint8x16_t a = vdupq_n_u8(static_cast<uint8_t>(set.chars[0]));
+            const uint8x16_t b = vdupq_n_u8(static_cast<uint8_t>(set.chars[1]));
+            const uint8x16_t c = vdupq_n_u8(static_cast<uint8_t>(set.chars[2]));
+
+            for (; i + 16 <= size; i += 16)
+            {
+                uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+
+                uint8x16_t mask = vcltq_u8(chunk, limit);
+                mask = vorrq_u8(mask, vceqq_u8(chunk, a));
+                mask = vorrq_u8(mask, vceqq_u8(chunk, b));
+                mask = vorrq_u8(mask, vceqq_u8(chunk, c));
+
+                // narrowed to four bits per byte, there's no movemask
+                uint64_t bits = vget_lane_u64(
+                    vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(mask), 4)), 0
+                );
+
+                if (bits)
+                    return i + first_set_bit(bits) / 4;
+            }
+        }
+#endif
+
+        for (; i < size; i++)
+        {
+            if (set.contains(data[i]))
+                return i;
+        }
+
+        return size;
+    }
+
+    // The offset of the next '{' at or after offset, or size
+    inline size_t find_brace(const bl_char* data, size_t size, size_t offset)
+    {
+        return offset + find_first_of(data + offset, size - offset, byte_set(0, '{'));
+    }
+}
@@ -0,0 +1,449 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+
+#define BLOGGER_INLINE_BUFFER_SIZE 256
+#define BLOGGER_CHUNK_CLASSES 8
+#define BLOGGER_MIN_CHUNK_SIZE 512
+#define BLOGGER_CACHED_CHUNKS 64
+#define BLOGGER_DEPOT_BATCHES 512 // of BLOGGER_CACHED_CHUNKS / 2 chunks, per size class
+
+namespace BLogger {
+
+    // Power of two sized chunks from 512 bytes to 64 KB
+    // recycled through per thread free lists, larger
+    // buffers go straight to the heap.
+    //
+    // Messages are usually allocated by the logging thread
+    // and freed by a backend thread, so a thread that caches
+    // too many chunks hands half of them over to a global depot
+    // in one go, and a thread that runs out takes a whole batch
+    // back. Once the depot is warmed up nothing hits malloc,
+    // and the depot mutex is taken once per batch.
+    class overflow_pool
+    {
+    private:
+        struct free_chunk
+        {
+            free_chunk* next;
+
+            // only valid for the first chunk of a batch in the depot
+            free_chunk* next_batch;
+        };
+
+        struct local_cache
+        {
+            free_chunk* heads[BLOGGER_CHUNK_CLASSES];
+            size_t      counts[BLOGGER_CHUNK_CLASSES];
+
+            local_cache()
+                : heads(),
+                counts()
+            {
+            }
+
+            ~local_cache()
+            {
+                for (auto head : heads)
+                    free_list(head);
+
+                cache_destroyed() = true;
+            }
+        };
+
+        struct depot
+        {
+            std::mutex  access;
+            free_chunk* batches[BLOGGER_CHUNK_CLASSES];
+            size_t      counts[BLOGGER_CHUNK_CLASSES];
+
+            depot()
+                : access(),
+                batches(),
+                counts()
+            {
+            }
+        };
+    public:
+        // Rounds capacity up to the size of the chunk returned
+        static bl_char* allocate(size_t& capacity)
+        {
+            size_t size_class = class_of(capacity);
+
+            if (size_class == BLOGGER_CHUNK_CLASSES)
+                return checked(malloc(capacity));
+
+            capacity = size_of(size_class);
+
+            local_cache* cache = get_cache();
+
+            if (!cache)
+                return checked(malloc(capacity));
+
+            if (!cache->heads[size_class])
+                take_batch(*cache, size_class);
+
+            free_chunk* chunk = cache->heads[size_class];
+
+            if (chunk)
+            {
+                cache->heads[size_class] = chunk->next;
+                --cache->counts[size_class];
+
+                return reinterpret_cast<bl_char*>(chunk);
+            }
+
+            return checked(malloc(capacity));
+        }
+
+        static void deallocate(bl_char* data, size_t capacity)
+        {
+            size_t size_class = class_of(capacity);
+
+            if (size_class == BLOGGER_CHUNK_CLASSES)
+            {
+                free(data);
+                return;
+            }
+
+            local_cache* cache = get_cache();
+
+            if (!cache)
+            {
+                free(data);
+                return;
+            }
+
+            if (cache->counts[size_class] == BLOGGER_CACHED_CHUNKS)
+                give_batch(*cache, size_class);
+
+            free_chunk* chunk = reinterpret_cast<free_chunk*>(data);
+            chunk->next = cache->heads[size_class];
+            cache->heads[size_class] = chunk;
+            ++cache->counts[size_class];
+        }
+    private:
+        // Null once the thread is exiting and its cache is
+        // gone, e.g. when a static is destroyed after main
+        static local_cache* get_cache()
+        {
+            if (cache_destroyed())
+                return nullptr;
+
+            static thread_local local_cache cache;
+            return &cache;
+        }
+
+        static bool& cache_destroyed()
+        {
+            static thread_local bool destroyed = false;
+            return destroyed;
+        }
+
+        // Never destroyed, buffers owned by other
+        // statics can still be freed during exit
+        static depot& get_depot()
+        {
+            static depot* d = new depot();
+            return *d;
+        }
+
+        static void take_batch(local_cache& cache, size_t size_class)
+        {
+            depot& d = get_depot();
+            locker lock(d.access);
+
+            free_chunk* batch = d.batches[size_class];
+
+            if (!batch)
+                return;
+
+            d.batches[size_class] = batch->next_batch;
+            --d.counts[size_class];
+
+            cache.heads[size_class] = batch;
+            cache.counts[size_class] = BLOGGER_CACHED_CHUNKS / 2;
+        }
+
+        // Detaches the first half of the local list
+        static void give_batch(local_cache& cache, size_t size_class)
+        {
+            free_chunk* batch = cache.heads[size_class];
+            free_chunk* last = batch;
+
+            for (size_t i = 1; i < BLOGGER_CACHED_CHUNKS / 2; i++)
+                last = last->next;
+
+            cache.heads[size_class] = last->next;
+            cache.counts[size_class] -= BLOGGER_CACHED_CHUNKS / 2;
+            last->next = nullptr;
+
+            depot& d = get_depot();
+            {
+                locker lock(d.access);
+
+                if (d.counts[size_class] < BLOGGER_DEPOT_BATCHES)
+                {
+                    batch->next_batch = d.batches[size_class];
+                    d.batches[size_class] = batch;
+                    ++d.counts[size_class];
+
+                    return;
+                }
+            }
+
+            free_list(batch);
+        }
+
+        static void free_list(free_chunk* head)
+        {
+            while (head)
+            {
+                free_chunk* next = head->next;
+                free(head);
+                head = next;
+            }
+        }
+
+        static size_t size_of(size_t size_class)
+        {
+            return static_cast<size_t>(BLOGGER_MIN_CHUNK_SIZE) << size_class;
+        }
+
+        static size_t class_of(size_t capacity)
+        {
+            size_t size_class = 0;
+
+            while (size_class < BLOGGER_CHUNK_CLASSES && size_of(size_class) < capacity)
+                ++size_class;
+
+            return size_class;
+        }
+
+        static bl_char* checked(void* data)
+        {
+            if (!data)
+                throw std::bad_alloc();
+
+            return static_cast<bl_char*>(data);
+        }
+    };
+
+    // A byte buffer that keeps up to inlineCapacity bytes
+    // inside of itself and only moves to a pooled overflow
+    // chunk for larger messages. Never zero-fills its contents.
+    template<size_t inlineCapacity>
+    class blogger_small_buffer
+    {
+    private:
+        template<size_t otherCapacity>
+        friend class blogger_small_buffer;
+
+        bl_char* m_Data;
+        size_t   m_Size;
+        size_t   m_Capacity;
+        bl_char  m_Inline[inlineCapacity];
+    public:
+        blogger_small_buffer()
+            : m_Data(m_Inline),
+            m_Size(0),
+            m_Capacity(inlineCapacity)
+        {
+        }
+
+        explicit blogger_small_buffer(size_t size)
+            : blogger_small_buffer()
+        {
+            resize(size);
+        }
+
+        blogger_small_buffer(const blogger_small_buffer& other)
+            : blogger_small_buffer()
+        {
+            append(other.data(), other.size());
+        }
+
+        template<size_t otherCapacity>
+        blogger_small_buffer(blogger_small_buffer<otherCapacity>&& other)
+            : blogger_small_buffer()
+        {
+            take(other);
+        }
+
+        blogger_small_buffer(blogger_small_buffer&& other)
+            : blogger_small_buffer()
+        {
+            take(other);
+        }
+
+        blogger_small_buffer& operator=(const blogger_small_buffer& other)
+        {
+            if (this != &other)
+            {
+                clear();
+                append(other.data(), other.size());
+            }
+
+            return *this;
+        }
+
+        template<size_t otherCapacity>
+        blogger_small_buffer& operator=(blogger_small_buffer<otherCapacity>&& other)
+        {
+            release();
+            take(other);
+
+            return *this;
+        }
+
+        blogger_small_buffer& operator=(blogger_small_buffer&& other)
+        {
+            if (this != &other)
+            {
+                release();
+                take(other);
+            }
+
+            return *this;
+        }
+
+        bl_char* data()
+        {
+            return m_Data;
+        }
+
+        const bl_char* data() const
+        {
+            return m_Data;
+        }
+
+        size_t size() const
+        {
+            return m_Size;
+        }
+
+        size_t capacity() const
+        {
+            return m_Capacity;
+        }
+
+        bool empty() const
+        {
+            return m_Size == 0;
+        }
+
+        bool is_inline() const
+        {
+            return m_Data == m_Inline;
+        }
+
+        bl_char& operator[](size_t index)
+        {
+            return m_Data[index];
+        }
+
+        void clear()
+        {
+            m_Size = 0;
+        }
+
+        void reserve(size_t capacity)
+        {
+            if (capacity <= m_Capacity)
+                return;
+
+            size_t new_capacity = m_Capacity * 2;
+
+            if (new_capacity < capacity)
+                new_capacity = capacity;
+
+            size_t size = m_Size;
+
+            bl_char* new_data = overflow_pool::allocate(new_capacity);
+            memcpy(new_data, m_Data, size);
+
+            release();
+
+            m_Data = new_data;
+            m_Size = size;
+            m_Capacity = new_capacity;
+        }
+
+        // The new bytes are left uninitialized
+        void resize(size_t size)
+        {
+            reserve(size);
+            m_Size = size;
+        }
+
+        void append(const bl_char* data, size_t size)
+        {
+            reserve(m_Size + size);
+            memcpy(m_Data + m_Size, data, size);
+            m_Size += size;
+        }
+
+        void push_back(bl_char c)
+        {
+            reserve(m_Size + 1);
+            m_Data[m_Size++] = c;
+        }
+
+        // Replaces count bytes at offset with size bytes of data
+        void replace(size_t offset, size_t count, const bl_char* data, size_t size)
+        {
+            size_t tail = m_Size - offset - count;
+
+            if (size > count)
+                reserve(m_Size + size - count);
+
+            memmove(m_Data + offset + size, m_Data + offset + count, tail);
+            memcpy(m_Data + offset, data, size);
+
+            m_Size = m_Size - count + size;
+        }
+
+        ~blogger_small_buffer()
+        {
+            release();
+        }
+    private:
+        void release()
+        {
+            if (!is_inline())
+                overflow_pool::deallocate(m_Data, m_Capacity);
+
+            m_Data = m_Inline;
+            m_Size = 0;
+            m_Capacity = inlineCapacity;
+        }
+
+        template<size_t otherCapacity>
+        void take(blogger_small_buffer<otherCapacity>& other)
+        {
+            if (other.is_inline())
+                append(other.m_Data, other.m_Size);
+            else
+            {
+                m_Data = other.m_Data;
+                m_Size = other.m_Size;
+                m_Capacity = other.m_Capacity;
+
+                other.m_Data = other.m_Inline;
+                other.m_Capacity = otherCapacity;
+            }
+
+            other.m_Size = 0;
+        }
+    };
+
+    typedef blogger_small_buffer<BLOGGER_INLINE_BUFFER_SIZE>
+        BLoggerMessageBuffer;
+}
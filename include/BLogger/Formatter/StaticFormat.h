@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+
+#define BLOGGER_MAX_STATIC_ARGS 16
+
+// Wraps a string literal into a format string
+// that is parsed at compile time, e.g.
+// logger->Info(BLOGGER_FMT("{1} / {0} = {}"), 4, 8, 2);
+// A mismatch between the placeholders and the
+// arguments passed is reported as a compile error.
+#define BLOGGER_FMT(str)                                                 \
+    ([] {                                                                \
+        struct blogger_format_holder                                     \
+        {                                                                \
+            static constexpr const bl_char* value() { return str; }      \
+        };                                                               \
+        return ::BLogger::static_format<blogger_format_holder>();        \
+    }())
+
+namespace BLogger {
+
+    struct static_format_layout
+    {
+        size_t size;
+        size_t count;
+
+        // offset/length of each placeholder in the format string
+        // and the index of the argument it's substituted with
+        size_t offsets[BLOGGER_MAX_STATIC_ARGS];
+        size_t lengths[BLOGGER_MAX_STATIC_ARGS];
+        size_t bindings[BLOGGER_MAX_STATIC_ARGS];
+        bool   positional[BLOGGER_MAX_STATIC_ARGS];
+        size_t positions[BLOGGER_MAX_STATIC_ARGS];
+
+        bool valid;
+    };
+
+    constexpr bool is_format_digit(bl_char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // Follows the same rules as the runtime formatter:
+    // argument N goes to the first {N} if there is one,
+    // and to the first unused {} otherwise.
+    constexpr static_format_layout parse_static_format(const bl_char* format)
+    {
+        static_format_layout out{};
+        out.valid = true;
+
+        size_t i = 0;
+
+        for (; format[i]; i++)
+        {
+            if (format[i] != '{')
+                continue;
+
+            size_t end = i + 1;
+            size_t position = 0;
+
+            while (is_format_digit(format[end]))
+            {
+                position = position * 10 + static_cast<size_t>(format[end] - '0');
+                ++end;
+            }
+
+            if (format[end] != '}')
+                continue;
+
+            if (out.count == BLOGGER_MAX_STATIC_ARGS)
+            {
+                out.valid = false;
+                break;
+            }
+
+            out.offsets[out.count]    = i;
+            out.lengths[out.count]    = end - i + 1;
+            out.positional[out.count] = end != i + 1;
+            out.positions[out.count]  = position;
+            out.bindings[out.count]   = BLOGGER_MAX_STATIC_ARGS;
+            ++out.count;
+
+            i = end;
+        }
+
+        out.size = i;
+
+        for (size_t arg = 0; arg < out.count; arg++)
+        {
+            size_t target = out.count;
+
+            for (size_t p = 0; p < out.count && target == out.count; p++)
+            {
+                if (out.positional[p] && out.positions[p] == arg &&
+                    out.bindings[p] == BLOGGER_MAX_STATIC_ARGS)
+                    target = p;
+            }
+
+            for (size_t p = 0; p < out.count && target == out.count; p++)
+            {
+                if (!out.positional[p] && out.bindings[p] == BLOGGER_MAX_STATIC_ARGS)
+                    target = p;
+            }
+
+            if (target == out.count)
+            {
+                out.valid = false;
+                break;
+            }
+
+            out.bindings[target] = arg;
+        }
+
+        return out;
+    }
+
+    template<typename HolderT>
+    struct static_format
+    {
+        static constexpr static_format_layout layout =
+            parse_static_format(HolderT::value());
+
+        static_assert(layout.valid,
+            "BLogger: invalid format string, every placeholder "
+            "must map to exactly one argument and there can't be "
+            "more than BLOGGER_MAX_STATIC_ARGS of them");
+
+        static const bl_char* data()
+        {
+            return HolderT::value();
+        }
+
+        static constexpr size_t arg_count()
+        {
+            return layout.count;
+        }
+    };
+
+    template<typename HolderT>
+    constexpr static_format_layout static_format<HolderT>::layout;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <cstring>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+#include "BLogger/OS/Functions.h"
+
+#define BLOGGER_TIMESTAMP_CACHE_SIZE 4
+#define BLOGGER_CALIBRATION_INTERVAL_NS 1000000000ll
+#define BLOGGER_RFC3339_SIZE 27
+
+namespace BLogger {
+
+    typedef int64_t blogger_timestamp;
+
+    // All the caller thread does is read the steady clock,
+    // the conversion to wall time happens when the
+    // message is formatted.
+    inline blogger_timestamp capture_timestamp()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    inline int64_t wall_clock_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    // Converts a captured timestamp into nanoseconds since epoch.
+    // Every formatting thread keeps its own steady->wall offset
+    // and refreshes it once per second to follow clock adjustments.
+    inline int64_t to_wall_clock_ns(blogger_timestamp timestamp)
+    {
+        struct calibration
+        {
+            int64_t offset;
+            int64_t next;
+        };
+
+        static thread_local calibration current = { 0, 0 };
+
+        if (timestamp >= current.next)
+        {
+            blogger_timestamp steady_now = capture_timestamp();
+
+            current.offset = wall_clock_ns() - steady_now;
+            current.next = steady_now + BLOGGER_CALIBRATION_INTERVAL_NS;
+        }
+
+        return timestamp + current.offset;
+    }
+
+    // Renders the strftime part of the timestamp only when the
+    // second changes, the rest of the messages within the same
+    // second just copy the cached string.
+    class timestamp_cache
+    {
+    private:
+        struct entry
+        {
+            uint64_t pattern_id;
+            int64_t  second;
+            size_t   size;
+            bl_char  text[64];
+        };
+    public:
+        static size_t render(
+            uint64_t pattern_id,
+            const bl_char* format,
+            int64_t wall_ns,
+            bl_char* out,
+            size_t out_size
+        )
+        {
+            static thread_local entry entries[BLOGGER_TIMESTAMP_CACHE_SIZE] = {};
+            static thread_local size_t next_victim = 0;
+
+            int64_t second = floor_div(wall_ns, 1000000000ll);
+
+            for (auto& cached : entries)
+            {
+                if (cached.pattern_id == pattern_id && cached.second == second)
+                    return copy(cached, out, out_size);
+            }
+
+            entry& victim = entries[next_victim++ % BLOGGER_TIMESTAMP_CACHE_SIZE];
+
+            std::tm time_point;
+            time_t time_now = static_cast<time_t>(second);
+            UPDATE_TIME(time_point, time_now);
+
+            victim.pattern_id = pattern_id;
+            victim.second = second;
+            victim.size = strftime(victim.text, sizeof(victim.text), format, &time_point);
+
+            return copy(victim, out, out_size);
+        }
+
+        // RFC 3339 in UTC with microseconds, always
+        // BLOGGER_RFC3339_SIZE characters
+        static size_t render_rfc3339(int64_t wall_ns, bl_char* out)
+        {
+            static thread_local int64_t cached_second = INT64_MIN;
+            static thread_local bl_char cached_text[32];
+
+            int64_t second = floor_div(wall_ns, 1000000000ll);
+
+            if (second != cached_second)
+            {
+                std::tm time_point;
+                time_t raw = static_cast<time_t>(second);
+                UPDATE_UTC_TIME(time_point, raw);
+
+                strftime(cached_text, sizeof(cached_text), "%Y-%m-%dT%H:%M:%S", &time_point);
+                cached_second = second;
+            }
+
+            memcpy(out, cached_text, 19);
+            out[19] = '.';
+            render_fraction(wall_ns, 6, out + 20);
+            out[26] = 'Z';
+
+            return BLOGGER_RFC3339_SIZE;
+        }
+
+        // Writes exactly digits characters of the sub-second
+        // part, e.g. 3 for milliseconds and 6 for microseconds
+        static void render_fraction(int64_t wall_ns, size_t digits, bl_char* out)
+        {
+            int64_t fraction = wall_ns - floor_div(wall_ns, 1000000000ll) * 1000000000ll;
+
+            for (size_t i = digits; i < 9; i++)
+                fraction /= 10;
+
+            for (size_t i = digits; i > 0; i--)
+            {
+                out[i - 1] = static_cast<bl_char>('0' + fraction % 10);
+                fraction /= 10;
+            }
+        }
+    private:
+        static int64_t floor_div(int64_t value, int64_t divisor)
+        {
+            int64_t out = value / divisor;
+            return (value % divisor < 0) ? out - 1 : out;
+        }
+
+        static size_t copy(const entry& cached, bl_char* out, size_t out_size)
+        {
+            size_t size = cached.size < out_size ? cached.size : out_size;
+            memcpy(out, cached.text, size);
+
+            return size;
+        }
+    };
+}
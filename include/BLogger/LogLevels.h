@@ -12,6 +12,17 @@ enum class level : int
     crit
 };
 
+// The same values for the preprocessor, see BLOGGER_ACTIVE_LEVEL
+#define BLOGGER_LEVEL_TRACE 0
+#define BLOGGER_LEVEL_DEBUG 1
+#define BLOGGER_LEVEL_INFO  2
+#define BLOGGER_LEVEL_WARN  3
+#define BLOGGER_LEVEL_ERROR 4
+#define BLOGGER_LEVEL_CRIT  5
+#define BLOGGER_LEVEL_OFF   6
+
+static_assert(static_cast<int>(level::crit) == BLOGGER_LEVEL_CRIT, "BLogger: level values changed");
+
 inline const char* LevelToString(level lvl)
 {
     switch (lvl)
@@ -32,3 +43,20 @@ inline const char* LevelToString(level lvl)
 #define BLOGGER_WARN_COLOR  BLOGGER_YELLOW
 #define BLOGGER_ERROR_COLOR BLOGGER_RED
 #define BLOGGER_CRIT_COLOR  BLOGGER_MAGENTA
+
+// Used by BufferedStdoutSink
+#ifdef _WIN32
+    #define BLOGGER_ANSI_TRACE_COLOR BLOGGER_ANSI_WHITE
+    #define BLOGGER_ANSI_DEBUG_COLOR BLOGGER_ANSI_GREEN
+    #define BLOGGER_ANSI_INFO_COLOR  BLOGGER_ANSI_BLUE
+    #define BLOGGER_ANSI_WARN_COLOR  BLOGGER_ANSI_YELLOW
+    #define BLOGGER_ANSI_ERROR_COLOR BLOGGER_ANSI_RED
+    #define BLOGGER_ANSI_CRIT_COLOR  BLOGGER_ANSI_MAGENTA
+#else
+    #define BLOGGER_ANSI_TRACE_COLOR BLOGGER_TRACE_COLOR
+    #define BLOGGER_ANSI_DEBUG_COLOR BLOGGER_DEBUG_COLOR
+    #define BLOGGER_ANSI_INFO_COLOR  BLOGGER_INFO_COLOR
+    #define BLOGGER_ANSI_WARN_COLOR  BLOGGER_WARN_COLOR
+    #define BLOGGER_ANSI_ERROR_COLOR BLOGGER_ERROR_COLOR
+    #define BLOGGER_ANSI_CRIT_COLOR  BLOGGER_CRIT_COLOR
+#endif
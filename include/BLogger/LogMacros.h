@@ -0,0 +1,58 @@
+#pragma once
+
+#include "BLogger/LogLevels.h"
+
+// Calls below this level are compiled out entirely, arguments
+// included, e.g. -DBLOGGER_ACTIVE_LEVEL=BLOGGER_LEVEL_INFO for
+// a release build that never needs the trace/debug messages.
+#ifndef BLOGGER_ACTIVE_LEVEL
+    #define BLOGGER_ACTIVE_LEVEL BLOGGER_LEVEL_TRACE
+#endif
+
+// Checks the runtime filter before anything else, so a disabled
+// call costs a single load and branch and doesn't evaluate its
+// arguments either. The logger can be a pointer or a shared_ptr.
+#define BLOGGER_LOG(logger, lvl, ...)             \
+    do                                            \
+    {                                             \
+        if ((logger)->ShouldLog(lvl))             \
+            (logger)->Log(lvl, __VA_ARGS__);      \
+    } while (0)
+
+#define BLOGGER_DISABLED_LOG(logger, ...) ((void)0)
+
+#if BLOGGER_ACTIVE_LEVEL <= BLOGGER_LEVEL_TRACE
+    #define BLOGGER_TRACE(logger, ...) BLOGGER_LOG(logger, level::trace, __VA_ARGS__)
+#else
+    #define BLOGGER_TRACE(logger, ...) BLOGGER_DISABLED_LOG(logger, __VA_ARGS__)
+#endif
+
+#if BLOGGER_ACTIVE_LEVEL <= BLOGGER_LEVEL_DEBUG
+    #define BLOGGER_DEBUG(logger, ...) BLOGGER_LOG(logger, level::debug, __VA_ARGS__)
+#else
+    #define BLOGGER_DEBUG(logger, ...) BLOGGER_DISABLED_LOG(logger, __VA_ARGS__)
+#endif
+
+#if BLOGGER_ACTIVE_LEVEL <= BLOGGER_LEVEL_INFO
+    #define BLOGGER_INFO(logger, ...) BLOGGER_LOG(logger, level::info, __VA_ARGS__)
+#else
+    #define BLOGGER_INFO(logger, ...) BLOGGER_DISABLED_LOG(logger, __VA_ARGS__)
+#endif
+
+#if BLOGGER_ACTIVE_LEVEL <= BLOGGER_LEVEL_WARN
+    #define BLOGGER_WARNING(logger, ...) BLOGGER_LOG(logger, level::warn, __VA_ARGS__)
+#else
+    #define BLOGGER_WARNING(logger, ...) BLOGGER_DISABLED_LOG(logger, __VA_ARGS__)
+#endif
+
+#if BLOGGER_ACTIVE_LEVEL <= BLOGGER_LEVEL_ERROR
+    #define BLOGGER_ERROR(logger, ...) BLOGGER_LOG(logger, level::error, __VA_ARGS__)
+#else
+    #define BLOGGER_ERROR(logger, ...) BLOGGER_DISABLED_LOG(logger, __VA_ARGS__)
+#endif
+
+#if BLOGGER_ACTIVE_LEVEL <= BLOGGER_LEVEL_CRIT
+    #define BLOGGER_CRITICAL(logger, ...) BLOGGER_LOG(logger, level::crit, __VA_ARGS__)
+#else
+    #define BLOGGER_CRITICAL(logger, ...) BLOGGER_DISABLED_LOG(logger, __VA_ARGS__)
+#endif
@@ -2,109 +2,346 @@
 
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <chrono>
 
 #include <vector>
-#include <deque>
 #include <unordered_map>
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <atomic>
 
 #include "BLogger/Formatter/FormatUtilities.h"
 #include "BLogger/Loggers/BaseLogger.h"
+#include "BLogger/Loggers/CrashJournal.h"
+#include "BLogger/Loggers/LoggerRegistry.h"
+#include "BLogger/Loggers/RingBuffer.h"
+#include "BLogger/OS/EventCount.h"
+#include "BLogger/OS/Numa.h"
 #include "BLogger/Sinks/FileSink.h"
 #include "BLogger/Sinks/StdoutSink.h"
 #include "BLogger/Sinks/ColoredStdoutSink.h"
+#include "BLogger/Stats/Stats.h"
 #include "BLogger/LogLevels.h"
 
 namespace BLogger {
 
     enum class task_type : uint16_t
     {
+        none  = 0,
         flush = 1,
         log   = 2
     };
 
-    class task
+    // Set by the worker once the flush task carrying it has
+    // flushed the sinks, see thread_pool::flush
+    struct flush_ack
     {
-    private:
-        task_type t;
-        BLoggerSharedSinkList log_sinks;
-    protected:
+        std::atomic<bool> done;
+
+        flush_ack()
+            : done(false)
+        {
+        }
+    };
+
+    // Stored inline inside the ring buffer slots,
+    // so posting a task never allocates. The sinks
+    // and the pattern are looked up through the
+    // logger handle once the task is dequeued.
+    struct task
+    {
+        task_type                  type;
+        logger_handle              logger;
+        uint64_t                   journal;
+        std::shared_ptr<flush_ack> ack;
+        bool                       requeued;
+        BLoggerLogMessage          message;
+
+        task()
+            : type(task_type::none),
+            logger(0),
+            journal(BLOGGER_NO_JOURNAL),
+            ack(),
+            requeued(false),
+            message()
+        {
+        }
+
         task(
             task_type t,
-            BLoggerSharedSinkList& sinks
-        ) : t(t),
-            log_sinks(sinks)
+            logger_handle logger,
+            std::shared_ptr<flush_ack> ack = nullptr
+        ) : type(t),
+            logger(logger),
+            journal(BLOGGER_NO_JOURNAL),
+            ack(std::move(ack)),
+            requeued(false),
+            message()
         {
         }
-    public:
-        task_type type()
+
+        task(
+            BLoggerLogMessage&& msg,
+            logger_handle logger
+        ) : type(task_type::log),
+            logger(logger),
+            journal(BLOGGER_NO_JOURNAL),
+            ack(),
+            requeued(false),
+            message(std::move(msg))
         {
-            return t;
         }
 
-        BLoggerSharedSinkList& sinks()
+        task(task&& other) = default;
+        task& operator=(task&& other) = default;
+    };
+
+    #define BLOGGER_TASK_LIMIT 10000
+    #define BLOGGER_HARDWARE_CONCURRENCY 0
+    #define BLOGGER_SINGLE_CONSUMER 1
+    #define BLOGGER_NO_AFFINITY -1
+    #define BLOGGER_BATCH_SIZE 64
+    #define BLOGGER_IDLE_SPIN 2000
+    #define BLOGGER_IDLE_YIELD 20
+    #define BLOGGER_PRODUCER_SPIN 256
+    #define BLOGGER_DEFAULT_SAMPLE_RATE 10
+    #define BLOGGER_WORKER_IDLE SIZE_MAX
+    #define BLOGGER_SHUTDOWN_TIMEOUT_MS 5000
+
+    // What to do with a message once
+    // the queue is full.
+    enum class overflow_policy : uint8_t
+    {
+        // spin for a bit and then park the producer
+        // until the queue has some free space
+        block,
+
+        // discard the message being posted
+        drop_newest,
+
+        // discard the oldest message in the queue
+        drop_oldest,
+
+        // while the queue is at least half full only 1 in N
+        // trace/debug messages are accepted, once it's full
+        // everything below error is dropped, error/crit block
+        sample
+    };
+
+    // A snapshot of overflow_control counters
+    struct overflow_stats
+    {
+        size_t dropped_newest;
+        size_t dropped_oldest;
+        size_t sampled_out;
+        size_t blocked;
+
+        size_t dropped() const
         {
-            return log_sinks;
+            return dropped_newest + dropped_oldest + sampled_out;
         }
     };
 
-    class log_task : public task
+    // Per logger overflow settings and counters.
+    // Oldest messages discarded by drop_oldest are counted
+    // on behalf of the logger that posted the new message.
+    struct overflow_control
     {
-    private:
-        BLoggerLogMessage msg;
-    public:
-        log_task(
-            BLoggerLogMessage&& msg,
-            BLoggerSharedSinkList& sinks
-        ) : task(task_type::log, sinks),
-            msg(std::move(msg))
+        overflow_policy     policy;
+        size_t              sample_rate;
+        std::atomic<size_t> dropped_newest;
+        std::atomic<size_t> dropped_oldest;
+        std::atomic<size_t> sampled_out;
+        std::atomic<size_t> blocked;
+
+        overflow_control(
+            overflow_policy policy = overflow_policy::drop_oldest,
+            size_t sample_rate = BLOGGER_DEFAULT_SAMPLE_RATE
+        ) : policy(policy),
+            sample_rate(sample_rate ? sample_rate : 1),
+            dropped_newest(0),
+            dropped_oldest(0),
+            sampled_out(0),
+            blocked(0)
         {
         }
 
-        BLoggerLogMessage& message()
+        overflow_stats stats()
         {
-            return msg;
+            return {
+                dropped_newest.load(std::memory_order_relaxed),
+                dropped_oldest.load(std::memory_order_relaxed),
+                sampled_out.load(std::memory_order_relaxed),
+                blocked.load(std::memory_order_relaxed)
+            };
         }
     };
 
-    class flush_task : public task
+    // ---- thread_pool properties struct ----
+    // Must be passed to thread_pool::configure
+    // before the first AsyncLogger is created,
+    // or to thread_pool::create for a named pool.
+    struct thread_pool_props
     {
-    public:
-        flush_task(BLoggerSharedSinkList& sinks)
-            : task(task_type::flush, sinks)
+        // rounded up to the next power of two
+        size_t queue_capacity;
+
+        // BLOGGER_SINGLE_CONSUMER starts one backend thread
+        // that owns all sinks, which then skip their locking,
+        // and writes messages in the order they were posted
+        uint16_t thread_count;
+
+        // worker N is pinned to core (cpu_affinity + N)
+        int32_t cpu_affinity;
+
+        // The queue is placed on this NUMA node and the workers
+        // may run on any of its cores (unless cpu_affinity
+        // pins them), so that the memory they touch is local
+        int32_t numa_node;
+
+        // maximum number of tasks a worker dequeues at once
+        size_t batch_size;
+
+        // An idle worker spins idle_spin times, then yields idle_yield
+        // times and then parks until a task is posted. Larger values
+        // lower the wakeup latency at the cost of burning more CPU.
+        size_t idle_spin;
+        size_t idle_yield;
+
+        // Every message is also copied into a crash_journal at this
+        // path (none if empty) until it's written, so the ones still
+        // queued when the process dies can be recovered. 0 slots
+        // makes the journal twice as large as the queue.
+        BLoggerString journal_path;
+        size_t        journal_slots;
+
+        thread_pool_props()
+            : queue_capacity(BLOGGER_TASK_LIMIT),
+            thread_count(BLOGGER_HARDWARE_CONCURRENCY),
+            cpu_affinity(BLOGGER_NO_AFFINITY),
+            numa_node(BLOGGER_NO_NUMA_NODE),
+            batch_size(BLOGGER_BATCH_SIZE),
+            idle_spin(BLOGGER_IDLE_SPIN),
+            idle_yield(BLOGGER_IDLE_YIELD),
+            journal_path(),
+            journal_slots(0)
         {
         }
     };
 
-    #define BLOGGER_TASK_LIMIT 10000
-
     class thread_pool
     {
     private:
-        typedef std::shared_ptr<task>
-            task_ptr;
-        typedef std::lock_guard<std::mutex>
-            locker;
         typedef std::unique_ptr<thread_pool>
             thread_pool_ptr;
+
+        typedef std::unordered_map<BLoggerString, thread_pool_ptr>
+            named_pool_map;
+
+        // The queue position of the first task a worker might
+        // be holding, or BLOGGER_WORKER_IDLE between batches
+        struct worker_marker
+        {
+            std::atomic<size_t> position;
+            char                pad[BLOGGER_CACHE_LINE - sizeof(std::atomic<size_t>)];
+        };
+
+        // Freed once every task that was queued before it
+        // was retired has been dequeued and processed
+        struct retired_object
+        {
+            size_t                ticket;
+            std::shared_ptr<void> object;
+            bool                  owns_handle;
+            logger_handle         handle;
+        };
     private:
-        static thread_pool_ptr   s_Instance;
-        std::vector<std::thread> m_Pool;
-        std::deque<task_ptr>     m_TaskQueue;
-        std::mutex               m_QueueAccess;
-        std::condition_variable  m_Notifier;
-        bool                     m_Running;
+        static thread_pool_ptr           s_Instance;
+        std::vector<std::thread>         m_Pool;
+        std::unique_ptr<worker_marker[]> m_Markers;
+        uint16_t                         m_WorkerCount;
+        ring_buffer<task>                m_TaskQueue;
+        event_count                      m_TaskPosted;
+        event_count                      m_SpaceFreed;
+        event_count                      m_BatchDone;
+        logger_registry                  m_Loggers;
+        std::mutex                       m_RetiredAccess;
+        std::vector<retired_object>      m_Retired;
+        std::atomic<size_t>              m_RetiredCount;
+        std::atomic<size_t>              m_Requeued;
+        size_t                           m_BatchSize;
+        size_t                           m_IdleSpin;
+        size_t                           m_IdleYield;
+        std::atomic<bool>                m_Running;
+        std::atomic<bool>                m_Stopped;
+        std::atomic<int64_t>             m_Deadline;
+        std::mutex                       m_ShutdownAccess;
+        std::unique_ptr<crash_journal>   m_Journal;
+        striped_counter                  m_Posted;
+        striped_counter                  m_Dropped;
+        std::atomic<size_t>              m_HighWater;
+        std::atomic<uint64_t>            m_Written;
     private:
-        thread_pool(uint16_t thread_count)
-            : m_Running(true)
+        thread_pool(const thread_pool_props& props)
+            : m_WorkerCount(0),
+            m_TaskQueue(props.queue_capacity),
+            m_RetiredCount(0),
+            m_Requeued(0),
+            m_BatchSize(props.batch_size ? props.batch_size : 1),
+            m_IdleSpin(props.idle_spin),
+            m_IdleYield(props.idle_yield),
+            m_Running(true),
+            m_Stopped(false),
+            m_Deadline(0),
+            m_Journal(),
+            m_HighWater(0),
+            m_Written(0)
         {
+            if (!props.journal_path.empty())
+            {
+                m_Journal.reset(new crash_journal());
+
+                size_t slots = props.journal_slots ? props.journal_slots : 2 * m_TaskQueue.capacity();
+
+                if (!m_Journal->open(props.journal_path, slots))
+                    m_Journal.reset();
+            }
+
+            // the slots were touched by this thread when the queue was
+            // created, so they're moved over to the node if they have to
+            if (props.numa_node != BLOGGER_NO_NUMA_NODE)
+                bind_to_numa_node(m_TaskQueue.memory(), m_TaskQueue.memory_size(), props.numa_node);
+
+            std::vector<size_t> node_cores = numa_node_cores(props.numa_node);
+
+            uint16_t thread_count = props.thread_count;
+
+            if (thread_count == BLOGGER_HARDWARE_CONCURRENCY)
+                thread_count = static_cast<uint16_t>(std::thread::hardware_concurrency());
+
+            if (!thread_count)
+                thread_count = BLOGGER_SINGLE_CONSUMER;
+
+            m_Markers.reset(new worker_marker[thread_count]);
+            m_WorkerCount = thread_count;
+
+            for (uint16_t i = 0; i < thread_count; i++)
+                m_Markers[i].position.store(BLOGGER_WORKER_IDLE, std::memory_order_relaxed);
+
             m_Pool.reserve(thread_count);
 
             for (uint16_t i = 0; i < thread_count; i++)
-                m_Pool.emplace_back(std::bind(&thread_pool::worker, this));
+            {
+                m_Pool.emplace_back(std::bind(&thread_pool::worker, this, i));
+
+                if (props.cpu_affinity != BLOGGER_NO_AFFINITY)
+                    set_thread_affinity(m_Pool.back(), props.cpu_affinity + i);
+                else if (!node_cores.empty())
+                    set_thread_affinity(m_Pool.back(), node_cores);
+            }
         }
 
         thread_pool(const thread_pool& other) = delete;
@@ -113,104 +350,782 @@ namespace BLogger {
         thread_pool& operator=(const thread_pool& other) = delete;
         thread_pool& operator=(thread_pool&& other) = delete;
 
-        void worker()
+        static thread_pool_props& default_props()
+        {
+            static thread_pool_props props;
+            return props;
+        }
+
+        static std::mutex& instance_access()
+        {
+            static std::mutex access;
+            return access;
+        }
+
+        static named_pool_map& named_pools()
+        {
+            static named_pool_map pools;
+            return pools;
+        }
+
+        void worker(uint16_t index)
         {
             bool did_work = true;
-            std::mutex worker_lock;
-            std::unique_lock<std::mutex> task_waiter(worker_lock);
+            worker_marker& marker = m_Markers[index];
+
+            std::vector<task> batch(m_BatchSize);
+            std::vector<BLoggerLogMessage*> messages;
+            std::vector<BLoggerLogMessage*> filtered;
+            messages.reserve(m_BatchSize);
+            filtered.reserve(m_BatchSize);
 
-            while (m_Running || did_work)
+            // once shut down, keeps draining until the queue is
+            // empty or the deadline passes, a batch at a time
+            while (m_Running.load(std::memory_order_acquire) || (did_work && !past_deadline()))
             {
                 if (!did_work)
-                    m_Notifier.wait_for(
-                        task_waiter,
-                        std::chrono::seconds(5)
-                    );
+                    wait_for_tasks();
+
+                did_work = do_work(batch, messages, filtered, marker);
+            }
+        }
+
+        bool past_deadline()
+        {
+            return std::chrono::steady_clock::now().time_since_epoch().count() >=
+                   m_Deadline.load(std::memory_order_relaxed);
+        }
+
+        bool should_wake()
+        {
+            return !m_TaskQueue.empty_approx() ||
+                   !m_Running.load(std::memory_order_acquire);
+        }
+
+        void wait_for_tasks()
+        {
+            for (size_t i = 0; i < m_IdleSpin; i++)
+            {
+                if (should_wake())
+                    return;
+
+                BLOGGER_CPU_RELAX();
+            }
+
+            for (size_t i = 0; i < m_IdleYield; i++)
+            {
+                if (should_wake())
+                    return;
+
+                std::this_thread::yield();
+            }
+
+            uint32_t key = m_TaskPosted.prepare_wait();
+
+            if (should_wake())
+                m_TaskPosted.cancel_wait();
+            else
+                m_TaskPosted.wait(key);
+        }
+
+        bool do_work(
+            std::vector<task>& batch,
+            std::vector<BLoggerLogMessage*>& messages,
+            std::vector<BLoggerLogMessage*>& filtered,
+            worker_marker& marker
+        )
+        {
+            // Announce the lowest position this worker could claim
+            // before claiming anything, see safe_position
+            marker.position.store(m_TaskQueue.dequeue_position(), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            // the queue is at its fullest right before it's drained
+            atomic_raise(m_HighWater, m_TaskQueue.size_approx());
+
+            size_t count = m_TaskQueue.try_pop_bulk(batch.data(), batch.size());
+
+            if (!count)
+            {
+                marker.position.store(BLOGGER_WORKER_IDLE, std::memory_order_release);
+                m_BatchDone.notify_all();
+                return false;
+            }
+
+            notify_space();
+
+            // consecutive log tasks of the same logger
+            // are handed to its sinks as a single batch
+            for (size_t i = 0; i < count;)
+            {
+                task& first = batch[i];
+                const logger_state* state = m_Loggers.resolve(first.logger);
+
+                // the logger is gone, nothing to do for its tasks
+                if (!state)
+                {
+                    ++i;
+                    continue;
+                }
+
+                // a flush somebody waits for (see flush) has
+                // to reach the disk
+                if (first.type == task_type::flush)
+                {
+                    for (auto sink : state->raw_sinks)
+                    {
+                        if (first.ack) sink->timed_sync();
+                        else           sink->timed_flush();
+                    }
+
+                    for (auto sink : state->sinks)
+                    {
+                        if (first.ack) sink->timed_sync();
+                        else           sink->timed_flush();
+                    }
+
+                    // the waiter is woken up once the batch is done
+                    if (first.ack)
+                        first.ack->done.store(true, std::memory_order_release);
+
+                    ++i;
+                    continue;
+                }
+
+                messages.clear();
+
+                size_t end = i;
+                for (; end < count; end++)
+                {
+                    if (batch[end].type != task_type::log ||
+                        batch[end].logger != first.logger)
+                        break;
+
+                    messages.push_back(&batch[end].message);
+                }
+
+                m_Written.fetch_add(messages.size(), std::memory_order_relaxed);
+
+                for (auto sink : state->raw_sinks)
+                {
+                    sink->write_filtered(messages, filtered);
+                }
+
+                if (!state->sinks.empty())
+                {
+                    // only what at least one of the sinks accepts
+                    level lowest = level::crit;
+
+                    for (auto sink : state->sinks)
+                        lowest = (std::min)(lowest, sink->filter());
+
+                    for (auto message : messages)
+                    {
+                        if (message->log_level() >= lowest)
+                            message->finalize_format(*state->pattern);
+                    }
+
+                    for (auto sink : state->sinks)
+                    {
+                        sink->write_filtered(messages, filtered);
+                    }
+                }
+
+                i = end;
+            }
+
+            if (m_Journal)
+            {
+                for (size_t i = 0; i < count; i++)
+                    m_Journal->release(batch[i].journal);
+            }
+
+            size_t requeued = 0;
+
+            for (size_t i = 0; i < count; i++)
+                requeued += batch[i].requeued;
+
+            marker.position.store(BLOGGER_WORKER_IDLE, std::memory_order_release);
+
+            // only once this batch is done with the logger states
+            if (requeued)
+                m_Requeued.fetch_sub(requeued, std::memory_order_release);
+
+            m_BatchDone.notify_all();
 
-                did_work = do_work();
+            reclaim();
+
+            return true;
+        }
+
+        // Every task below the returned position has been dequeued,
+        // and no worker is still processing any of them.
+        //
+        // A worker publishes its marker before the CAS that claims
+        // its tasks, so once that CAS (or a later one) is visible
+        // here through the dequeue position, so is the marker.
+        size_t safe_position()
+        {
+            size_t safe = m_TaskQueue.dequeue_position();
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            for (uint16_t i = 0; i < m_WorkerCount; i++)
+            {
+                size_t position = m_Markers[i].position.load(std::memory_order_acquire);
+
+                if (position < safe)
+                    safe = position;
+            }
+
+            return safe;
+        }
+
+        void retire(std::shared_ptr<void> object, bool owns_handle, logger_handle handle)
+        {
+            // seq_cst so that the ticket is read after the new
+            // state of the logger has been published
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            size_t ticket = m_TaskQueue.enqueue_position();
+
+            {
+                locker lock(m_RetiredAccess);
+
+                m_Retired.push_back({ ticket, std::move(object), owns_handle, handle });
+                m_RetiredCount.store(m_Retired.size(), std::memory_order_relaxed);
+            }
+
+            reclaim();
+        }
+
+        void reclaim()
+        {
+            if (!m_RetiredCount.load(std::memory_order_relaxed))
+                return;
+
+            size_t safe = safe_position();
+
+            // a requeued task sits behind the tickets of loggers that
+            // were retired in the meantime, see push_dropping_oldest
+            if (m_Requeued.load(std::memory_order_acquire))
+                return;
+
+            std::vector<retired_object> ready;
+
+            {
+                locker lock(m_RetiredAccess);
+
+                auto first_pending = std::partition(
+                    m_Retired.begin(),
+                    m_Retired.end(),
+                    [safe](const retired_object& retired)
+                    {
+                        return retired.ticket <= safe;
+                    }
+                );
+
+                ready.assign(
+                    std::make_move_iterator(m_Retired.begin()),
+                    std::make_move_iterator(first_pending)
+                );
+
+                m_Retired.erase(m_Retired.begin(), first_pending);
+                m_RetiredCount.store(m_Retired.size(), std::memory_order_relaxed);
             }
+
+            for (auto& retired : ready)
+            {
+                if (retired.owns_handle)
+                    m_Loggers.remove(retired.handle);
+            }
+        }
+
+        void notify_space()
+        {
+            m_SpaceFreed.notify_all();
         }
 
-        bool do_work()
+        // Only messages are evicted, any other task that's popped
+        // goes back to the queue. It's counted in m_Requeued (before
+        // it's popped, like a worker marker) until a worker is done
+        // with it, which holds off reclaim: the task now comes after
+        // the retire tickets of its logger.
+        void push_dropping_oldest(task& t, overflow_control& overflow)
         {
-            task_ptr p;
+            while (!m_TaskQueue.try_push(std::move(t)))
             {
-                locker lock(m_QueueAccess);
+                task oldest;
 
-                if (!m_TaskQueue.empty())
+                m_Requeued.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (!m_TaskQueue.try_pop(oldest))
                 {
-                    p = m_TaskQueue.front();
-                    m_TaskQueue.pop_front();
+                    m_Requeued.fetch_sub(1, std::memory_order_release);
+                    continue;
                 }
-                else
+
+                if (oldest.type != task_type::log)
+                {
+                    // popped again, it's already counted
+                    if (oldest.requeued)
+                        m_Requeued.fetch_sub(1, std::memory_order_release);
+
+                    oldest.requeued = true;
+
+                    if (!push_keeping(oldest))
+                        m_Requeued.fetch_sub(1, std::memory_order_release);
+
+                    continue;
+                }
+
+                m_Requeued.fetch_sub(1, std::memory_order_release);
+
+                overflow.dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+                m_Dropped.add();
+                release_journal(oldest);
+            }
+        }
+
+        // Parks until the task fits, returns false
+        // if the pool was shut down in the meantime
+        bool wait_for_space(task& t)
+        {
+            for (;;)
+            {
+                uint32_t key = m_SpaceFreed.prepare_wait();
+
+                if (m_TaskQueue.try_push(std::move(t)))
+                {
+                    m_SpaceFreed.cancel_wait();
+                    return true;
+                }
+
+                // nothing is going to make space anymore
+                if (m_Stopped.load(std::memory_order_acquire))
+                {
+                    m_SpaceFreed.cancel_wait();
                     return false;
+                }
+
+                m_SpaceFreed.wait(key);
             }
+        }
 
-            if (p->type() == task_type::log)
+        bool spin_push(task& t)
+        {
+            for (size_t i = 0; i < BLOGGER_PRODUCER_SPIN; i++)
             {
-                log_task* task = static_cast<log_task*>(p.get());
+                if (m_TaskQueue.try_push(std::move(t)))
+                    return true;
+
+                BLOGGER_CPU_RELAX();
+            }
+
+            return false;
+        }
+
+        void push_blocking(task& t, overflow_control& overflow)
+        {
+            if (spin_push(t))
+                return;
+
+            overflow.blocked.fetch_add(1, std::memory_order_relaxed);
+
+            if (!wait_for_space(t))
+            {
+                m_Dropped.add();
+                release_journal(t);
+            }
+        }
+
+        // For the tasks that aren't messages, which no overflow
+        // policy drops. Only lost if the pool is shut down.
+        bool push_keeping(task& t)
+        {
+            return spin_push(t) || wait_for_space(t);
+        }
+
+        bool should_sample_out(level lvl, overflow_control& overflow)
+        {
+            static thread_local size_t tick = 0;
 
-                task->message().finalize_format();
+            if (lvl > level::debug)
+                return false;
 
-                for (auto& sink : *task->sinks())
+            if (m_TaskQueue.size_approx() < m_TaskQueue.capacity() / 2)
+                return false;
+
+            return (tick++ % overflow.sample_rate) != 0;
+        }
+
+        void push(task& t, overflow_control& overflow)
+        {
+            if (m_TaskQueue.try_push(std::move(t)))
+                return;
+
+            switch (overflow.policy)
+            {
+            case overflow_policy::block:
+                push_blocking(t, overflow);
+                return;
+            case overflow_policy::drop_newest:
+                overflow.dropped_newest.fetch_add(1, std::memory_order_relaxed);
+                m_Dropped.add();
+                release_journal(t);
+                return;
+            case overflow_policy::drop_oldest:
+                push_dropping_oldest(t, overflow);
+                return;
+            case overflow_policy::sample:
+                if (t.message.log_level() >= level::error)
+                    push_blocking(t, overflow);
+                else
                 {
-                    sink->write(task->message());
+                    overflow.dropped_newest.fetch_add(1, std::memory_order_relaxed);
+                    m_Dropped.add();
+                    release_journal(t);
                 }
+                return;
             }
-            else if (p->type() == task_type::flush)
+        }
+
+        // Dropped messages aren't worth recovering
+        void release_journal(task& t)
+        {
+            if (m_Journal)
+                m_Journal->release(t.journal);
+        }
+
+        // Waits until done() is true, which is
+        // checked every time a batch is finished
+        template<typename ConditionT>
+        bool wait_for_batches(ConditionT done, std::chrono::steady_clock::time_point deadline)
+        {
+            for (;;)
             {
-                flush_task* task = static_cast<flush_task*>(p.get());
+                uint32_t key = m_BatchDone.prepare_wait();
 
-                for (auto& sink : *task->sinks())
+                if (done())
                 {
-                    sink->flush();
+                    m_BatchDone.cancel_wait();
+                    return true;
+                }
+
+                if (m_Stopped.load(std::memory_order_acquire))
+                {
+                    m_BatchDone.cancel_wait();
+                    return false;
                 }
+
+                if (!m_BatchDone.wait_until(key, deadline))
+                    return done();
             }
-            return true;
         }
 
-        void shutdown()
+        void begin_shutdown(std::chrono::steady_clock::time_point deadline)
+        {
+            locker lock(m_ShutdownAccess);
+
+            if (!m_Running.load(std::memory_order_relaxed))
+                return;
+
+            m_Deadline.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+            m_Running.store(false, std::memory_order_release);
+            m_TaskPosted.notify_all();
+        }
+
+        size_t finish_shutdown()
         {
-            m_Running = false;
-            m_Notifier.notify_all();
+            locker lock(m_ShutdownAccess);
+
+            if (m_Stopped.load(std::memory_order_relaxed))
+                return 0;
 
             for (auto& worker : m_Pool)
                 worker.join();
+
+            m_Stopped.store(true, std::memory_order_release);
+            m_SpaceFreed.notify_all();
+            m_BatchDone.notify_all();
+
+            // the sinks are only flushed when they're destroyed
+            // otherwise, which might never happen for a static logger
+            m_Loggers.for_each(
+                [](const logger_state& state)
+                {
+                    for (auto sink : state.raw_sinks)
+                        sink->timed_flush();
+
+                    for (auto sink : state.sinks)
+                        sink->timed_flush();
+                }
+            );
+
+            // they're kept in the journal, if there is one
+            size_t undrained = 0;
+            task leftover;
+
+            while (m_TaskQueue.try_pop(leftover))
+            {
+                if (leftover.type == task_type::log)
+                    undrained++;
+            }
+
+            m_Dropped.add(undrained);
+
+            return undrained;
         }
     public:
+        // Returns false if the pool is already running,
+        // in which case the properties are ignored.
+        static bool configure(const thread_pool_props& props)
+        {
+            locker lock(instance_access());
+
+            if (s_Instance)
+                return false;
+
+            default_props() = props;
+
+            return true;
+        }
+
+        // Loggers are expected to cache the result
         static thread_pool_ptr& get()
         {
+            locker lock(instance_access());
+
             if (!s_Instance)
-            {
-                s_Instance.reset(new thread_pool(std::thread::hardware_concurrency()));
-            }
+                s_Instance.reset(new thread_pool(default_props()));
 
             return s_Instance;
         }
 
-        void post_message(BLoggerLogMessage&& message, BLoggerSharedSinkList& sinks)
+        // Starts a pool of its own with a queue and workers that
+        // aren't shared with the default one, loggers are attached
+        // to it with get(name). Returns false if there already is
+        // a pool with that name, in which case the properties are
+        // ignored.
+        static bool create(BLoggerInString name, const thread_pool_props& props)
         {
-            {
-                locker lock(m_QueueAccess);
+            locker lock(instance_access());
+
+            BLoggerString key(name.data(), name.size());
+            named_pool_map& pools = named_pools();
+
+            if (pools.find(key) != pools.end())
+                return false;
 
-                if (m_TaskQueue.size() == BLOGGER_TASK_LIMIT)
-                    m_TaskQueue.pop_front();
+            pools.emplace(std::move(key), thread_pool_ptr(new thread_pool(props)));
+
+            return true;
+        }
 
-                m_TaskQueue.emplace_back(new log_task(std::move(message), sinks));
+        // The pool created with that name, which is started with the
+        // properties passed to configure if it doesn't exist yet.
+        // An empty name is the default pool. Pools live until exit.
+        static thread_pool* get(BLoggerInString name)
+        {
+            if (name.empty())
+                return get().get();
+
+            locker lock(instance_access());
+
+            thread_pool_ptr& pool = named_pools()[BLoggerString(name.data(), name.size())];
+
+            if (!pool)
+                pool.reset(new thread_pool(default_props()));
+
+            return pool.get();
+        }
+
+        // Stops the workers once every message posted so far is
+        // written or the timeout passes, whichever comes first. The
+        // workers stop in between batches, so the one being written
+        // is always finished. Returns the number of messages that
+        // were left in the queue, those stay in the crash journal if
+        // there is one. Messages posted afterwards are dropped.
+        size_t shutdown(std::chrono::milliseconds timeout)
+        {
+            begin_shutdown(std::chrono::steady_clock::now() + timeout);
+            return finish_shutdown();
+        }
+
+        // Shuts the default and every named pool down at once,
+        // all of them draining in parallel against the same deadline.
+        // Returns the number of messages that were left undrained.
+        static size_t shutdown_all(std::chrono::milliseconds timeout)
+        {
+            locker lock(instance_access());
+
+            std::vector<thread_pool*> pools;
+
+            for (auto& named : named_pools())
+                pools.push_back(named.second.get());
+
+            if (s_Instance)
+                pools.push_back(s_Instance.get());
+
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+
+            for (auto pool : pools)
+                pool->begin_shutdown(deadline);
+
+            size_t undrained = 0;
+
+            for (auto pool : pools)
+                undrained += pool->finish_shutdown();
+
+            return undrained;
+        }
+
+        bool single_consumer()
+        {
+            return m_Pool.size() == BLOGGER_SINGLE_CONSUMER;
+        }
+
+        void post_message(
+            BLoggerLogMessage&& message,
+            logger_handle logger,
+            overflow_control& overflow,
+            BLoggerInString tag
+        )
+        {
+            m_Posted.add();
+
+            if (!m_Running.load(std::memory_order_relaxed))
+            {
+                m_Dropped.add();
+                return;
             }
 
-            m_Notifier.notify_one();
+            if (overflow.policy == overflow_policy::sample &&
+                should_sample_out(message.log_level(), overflow))
+            {
+                overflow.sampled_out.fetch_add(1, std::memory_order_relaxed);
+                m_Dropped.add();
+                return;
+            }
+
+            task t(std::move(message), logger);
+
+            if (m_Journal)
+                t.journal = m_Journal->record(t.message, tag);
+
+            push(t, overflow);
+
+            m_TaskPosted.notify_one();
+        }
+
+        // Never evicted by drop_oldest, see push_keeping.
+        // The ack is set once the sinks are flushed.
+        void post_flush(logger_handle logger, std::shared_ptr<flush_ack> ack = nullptr)
+        {
+            if (!m_Running.load(std::memory_order_relaxed))
+                return;
+
+            task t(task_type::flush, logger, std::move(ack));
+            push_keeping(t);
+
+            m_TaskPosted.notify_all();
+        }
+
+        // Waits until the messages posted before the call are written
+        // and then the sinks of the logger are flushed, returns false
+        // if that took longer than timeout or the pool was shut down.
+        //
+        // Another worker might still be writing the messages in front
+        // of a flush task when it's picked up, so it's only posted once
+        // all of them are done.
+        bool flush(logger_handle logger, std::chrono::milliseconds timeout)
+        {
+            if (!m_Running.load(std::memory_order_relaxed))
+                return false;
+
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            size_t ticket = m_TaskQueue.enqueue_position();
+
+            bool written = wait_for_batches(
+                [this, ticket]() { return safe_position() >= ticket; },
+                deadline
+            );
+
+            if (!written)
+                return false;
+
+            // shared, the task might outlive this call if it times out
+            auto ack = std::make_shared<flush_ack>();
+            post_flush(logger, ack);
+
+            return wait_for_batches(
+                [&ack]() { return ack->done.load(std::memory_order_acquire); },
+                deadline
+            );
+        }
+
+        size_t queue_capacity()
+        {
+            return m_TaskQueue.capacity();
+        }
+
+        // Counters are summed up on every call, meant to be
+        // polled every now and then (see prometheus_exporter).
+        // Every posted message is eventually either written
+        // or dropped (by any of the overflow policies).
+        thread_pool_stats stats()
+        {
+            return {
+                m_TaskQueue.capacity(),
+                m_TaskQueue.size_approx(),
+                m_HighWater.load(std::memory_order_relaxed),
+                m_Posted.load(),
+                m_Dropped.load(),
+                m_Written.load(std::memory_order_relaxed),
+                m_WorkerCount
+            };
+        }
+
+        // Whether thread_pool_props::journal_path could be opened
+        bool journaling()
+        {
+            return m_Journal != nullptr;
         }
 
-        void post_flush(BLoggerSharedSinkList& sinks)
+        logger_handle add_logger(const logger_state* state)
         {
-            locker lock(m_QueueAccess);
-            m_TaskQueue.emplace_back(new flush_task(sinks));
+            return m_Loggers.add(state);
         }
 
+        // Tasks that are already queued might still
+        // be written with the previous state
+        void update_logger(logger_handle logger, const logger_state* state)
+        {
+            m_Loggers.update(logger, state);
+        }
+
+        // Keeps the object alive until the tasks that
+        // were queued before this call are processed
+        void retire(std::shared_ptr<void> object)
+        {
+            retire(std::move(object), false, 0);
+        }
+
+        // The handle is released, and may be reused, only
+        // after every task that refers to it is processed
+        void remove_logger(logger_handle logger)
+        {
+            retire(nullptr, true, logger);
+        }
+
+        // Whatever can't be written within BLOGGER_SHUTDOWN_TIMEOUT_MS
+        // is left behind instead of holding up the exit
         ~thread_pool()
         {
-            shutdown();
+            shutdown(std::chrono::milliseconds(BLOGGER_SHUTDOWN_TIMEOUT_MS));
+
+            m_Retired.clear();
         }
     };
 
@@ -218,26 +1133,118 @@ namespace BLogger {
 
     class AsyncLogger : public BaseLogger
     {
+    private:
+        thread_pool*                  m_Pool;
+        overflow_control              m_Overflow;
+        std::shared_ptr<logger_state> m_State;
+        logger_handle                 m_Handle;
     public:
+        // Uses the default pool unless given
+        // one, see thread_pool::get(name)
         AsyncLogger(
             BLoggerInString tag,
             level lvl,
-            bool default_pattern = true
+            bool default_pattern = true,
+            thread_pool* pool = nullptr
         )
-            : BaseLogger(tag, lvl, default_pattern)
+            : BaseLogger(tag, lvl, default_pattern),
+            m_Pool(pool ? pool : thread_pool::get().get()),
+            m_Overflow(),
+            m_State(make_state()),
+            m_Handle(m_Pool->add_logger(m_State.get()))
         {
         }
 
+        // Doesn't wait for the flush to happen
         void Flush() override
         {
-            thread_pool::get()->post_flush(m_Sinks);
+            m_Pool->post_flush(m_Handle);
         }
 
-        ~AsyncLogger() {}
+        bool Flush(std::chrono::milliseconds timeout) override
+        {
+            return m_Pool->flush(m_Handle, timeout);
+        }
+
+        // Not thread safe, meant to be called
+        // right after the logger is created.
+        void SetOverflowPolicy(
+            overflow_policy policy,
+            size_t sample_rate = BLOGGER_DEFAULT_SAMPLE_RATE
+        )
+        {
+            m_Overflow.policy = policy;
+            m_Overflow.sample_rate = sample_rate ? sample_rate : 1;
+        }
+
+        // Formats the messages on the backend instead of the
+        // caller thread whenever all of the arguments can be
+        // copied as raw bytes. Unless copy_formats is set the
+        // const char* format overloads then only keep the pointer,
+        // so the format string must outlive the message (e.g. be
+        // a string literal).
+        void SetDeferredFormatting(bool deferred, bool copy_formats = false)
+        {
+            m_DeferFormatting = deferred;
+            m_CopyFormats = copy_formats;
+        }
+
+        overflow_stats OverflowStats()
+        {
+            return m_Overflow.stats();
+        }
+
+        // Messages that are still queued are written
+        // before the sinks are actually destroyed
+        ~AsyncLogger()
+        {
+            m_Pool->retire(std::move(m_State));
+            m_Pool->retire(m_Sinks);
+            m_Pool->retire(m_CurrentPattern);
+            m_Pool->remove_logger(m_Handle);
+        }
     private:
         void Post(BLoggerLogMessage&& msg) override
         {
-            thread_pool::get()->post_message(std::move(msg), m_Sinks);
+            m_Pool->post_message(std::move(msg), m_Handle, m_Overflow, m_Tag);
+        }
+
+        std::shared_ptr<logger_state> make_state()
+        {
+            std::shared_ptr<logger_state> state(new logger_state());
+
+            for (auto& sink : *m_Sinks)
+            {
+                if (sink->wants_raw_messages())
+                    state->raw_sinks.push_back(sink.get());
+                else
+                    state->sinks.push_back(sink.get());
+            }
+
+            state->pattern = m_CurrentPattern.get();
+
+            return state;
+        }
+
+        void publish_state()
+        {
+            std::shared_ptr<logger_state> old_state = std::move(m_State);
+
+            m_State = make_state();
+            m_Pool->update_logger(m_Handle, m_State.get());
+            m_Pool->retire(std::move(old_state));
+        }
+
+        void OnSinkAdded(BaseSink& sink) override
+        {
+            sink.set_single_writer(m_Pool->single_consumer());
+            publish_state();
+        }
+
+        void OnPatternChanged(BLoggerSharedPattern& old_pattern) override
+        {
+            publish_state();
+            m_Pool->retire(old_pattern);
         }
     };
 }
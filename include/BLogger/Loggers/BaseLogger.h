@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <ctime>
 #include <list>
+#include <vector>
 
 #include "BLogger/LogLevels.h"
 #include "BLogger/Formatter/Formatter.h"
@@ -24,9 +27,19 @@ namespace BLogger {
     protected:
         BLoggerString         m_Tag;
         BLoggerString         m_CachedPattern;
+        BLoggerString         m_TimestampFormat;
         BLoggerSharedPattern  m_CurrentPattern;
         BLoggerSharedSinkList m_Sinks;
-        level                 m_Filter;
+        std::atomic<level>    m_Filter;
+        bool                  m_DeferFormatting;
+        bool                  m_CopyFormats;
+    private:
+        // The lowest level that's logged, or BLOGGER_LEVEL_OFF while
+        // there's no pattern or sink. Read by every logging call,
+        // so it gets a cache line of its own.
+        char                  m_Pad0[BLOGGER_CACHE_LINE];
+        std::atomic<int>      m_Threshold;
+        char                  m_Pad1[BLOGGER_CACHE_LINE - sizeof(std::atomic<int>)];
     public:
         BaseLogger(
             BLoggerInString tag,
@@ -34,9 +47,13 @@ namespace BLogger {
             bool default_pattern
         ) : m_Tag(tag),
             m_CachedPattern(""),
+            m_TimestampFormat(BLOGGER_TIMESTAMP),
             m_CurrentPattern(new BLoggerPattern()),
             m_Sinks(new sink_list()),
-            m_Filter(lvl)
+            m_Filter(lvl),
+            m_DeferFormatting(false),
+            m_CopyFormats(false),
+            m_Threshold(BLOGGER_LEVEL_OFF)
         {
             if (default_pattern)
             {
@@ -57,13 +74,36 @@ namespace BLogger {
             m_CachedPattern = pattern;
             BLoggerPattern* newPattern = new BLoggerPattern();
             newPattern->init();
-            newPattern->set_pattern(pattern, m_Tag);
+            newPattern->set_pattern(pattern, m_Tag, m_TimestampFormat);
 
+            BLoggerSharedPattern oldPattern = std::move(m_CurrentPattern);
             m_CurrentPattern.reset(newPattern);
+
+            OnPatternChanged(oldPattern);
+            UpdateThreshold();
+        }
+
+        // Sets the strftime format used by {ts}
+        void SetTimestampFormat(BLoggerInString format)
+        {
+            m_TimestampFormat = BLoggerString(format.data(), format.size());
+
+            if (!m_CachedPattern.empty())
+                SetPattern(BLoggerString(m_CachedPattern));
         }
 
         virtual void Flush() = 0;
 
+        // Waits until every message logged before the call is
+        // written and the sinks are synced to disk (see
+        // BaseSink::sync), returns false if that didn't
+        // happen within timeout
+        virtual bool Flush(std::chrono::milliseconds)
+        {
+            Flush();
+            return true;
+        }
+
         void Log(level lvl, BLoggerInString message)
         {
             if (!ShouldLog(lvl))
@@ -76,14 +116,8 @@ namespace BLogger {
                 message.size()
             );
 
-            std::tm time_point;
-            auto time_now = std::time(nullptr);
-            UPDATE_TIME(time_point, time_now);
-
             Post({
                 formatter.release_buffer(),
-                m_CurrentPattern,
-                time_point,
                 lvl
             });
         }
@@ -100,43 +134,25 @@ namespace BLogger {
                 strlen(message)
             );
 
-            std::tm time_point;
-            auto time_now = std::time(nullptr);
-            UPDATE_TIME(time_point, time_now);
-
             Post({
-                formatter.release_buffer(), 
-                m_CurrentPattern,
-                time_point,
+                formatter.release_buffer(),
                 lvl
             });
         }
 
+        // Any of the arguments can be a field (see Fields.h),
+        // the rest fill in the placeholders as usual
         template<typename... Args>
         void Log(level lvl, BLoggerInString formattedMsg, Args&& ... args)
         {
             if (!ShouldLog(lvl))
                 return;
 
-            BLoggerFormatter formatter;
-
-            formatter.process_message(
-                formattedMsg.data(), 
-                formattedMsg.size()
+            LogArgs(
+                std::integral_constant<bool, any_log_field<Args...>::value>(),
+                lvl, formattedMsg.data(), formattedMsg.size(), true,
+                std::forward<Args>(args)...
             );
-
-            BLOGGER_PROCESS_PACK(formatter, args);
-
-            std::tm time_point;
-            auto time_now = std::time(nullptr);
-            UPDATE_TIME(time_point, time_now);
-
-            Post({
-                formatter.release_buffer(),
-                m_CurrentPattern,
-                time_point,
-                lvl
-            });
         }
 
         template<typename... Args>
@@ -145,23 +161,47 @@ namespace BLogger {
             if (!ShouldLog(lvl))
                 return;
 
-            BLoggerFormatter formatter;
+            LogArgs(
+                std::integral_constant<bool, any_log_field<Args...>::value>(),
+                lvl, formattedMsg, strlen(formattedMsg), false,
+                std::forward<Args>(args)...
+            );
+        }
 
-            formatter.process_message(
-                formattedMsg,
-                strlen(formattedMsg)
+        template<typename FormatT, typename... Args>
+        void Log(level lvl, static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            static_assert(
+                static_format<FormatT>::arg_count() == sizeof...(Args),
+                "BLogger: the number of arguments doesn't match the format string"
             );
 
-            BLOGGER_PROCESS_PACK(formatter, args);
+            if (!ShouldLog(lvl))
+                return;
 
-            std::tm time_point;
-            auto time_now = std::time(nullptr);
-            UPDATE_TIME(time_point, time_now);
+            // the format is a string literal, so
+            // it's always safe to keep the pointer
+            if (m_DeferFormatting &&
+                TryDefer(
+                    std::integral_constant<bool, all_deferrable<Args...>::value>(),
+                    lvl,
+                    formattedMsg.data(),
+                    static_format<FormatT>::layout.size,
+                    false,
+                    args...
+                ))
+                return;
+
+            BLoggerFormatter formatter;
+
+            formatter.format_static(
+                static_format<FormatT>::layout,
+                formattedMsg.data(),
+                args...
+            );
 
             Post({
                 formatter.release_buffer(),
-                m_CurrentPattern,
-                time_point,
                 lvl
             });
         }
@@ -298,9 +338,59 @@ namespace BLogger {
             Log(level::crit, formattedMsg, std::forward<Args>(args)...);
         }
 
+        template<typename FormatT, typename... Args>
+        void Trace(static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            Log(level::trace, formattedMsg, std::forward<Args>(args)...);
+        }
+
+        template<typename FormatT, typename... Args>
+        void Debug(static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            Log(level::debug, formattedMsg, std::forward<Args>(args)...);
+        }
+
+        template<typename FormatT, typename... Args>
+        void Info(static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            Log(level::info, formattedMsg, std::forward<Args>(args)...);
+        }
+
+        template<typename FormatT, typename... Args>
+        void Warning(static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            Log(level::warn, formattedMsg, std::forward<Args>(args)...);
+        }
+
+        template<typename FormatT, typename... Args>
+        void Error(static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            Log(level::error, formattedMsg, std::forward<Args>(args)...);
+        }
+
+        template<typename FormatT, typename... Args>
+        void Critical(static_format<FormatT> formattedMsg, Args&& ... args)
+        {
+            Log(level::crit, formattedMsg, std::forward<Args>(args)...);
+        }
+
+        // Safe to call while other threads are logging
         void SetFilter(level lvl)
         {
-            m_Filter = lvl;
+            m_Filter.store(lvl, std::memory_order_relaxed);
+            UpdateThreshold();
+        }
+
+        level GetFilter() const
+        {
+            return m_Filter.load(std::memory_order_relaxed);
+        }
+
+        // A single relaxed load, see the BLOGGER_TRACE... macros
+        // for skipping the call (and the arguments) altogether
+        bool ShouldLog(level lvl) const
+        {
+            return static_cast<int>(lvl) >= m_Threshold.load(std::memory_order_relaxed);
         }
 
         void SetTag(BLoggerInString tag)
@@ -311,28 +401,142 @@ namespace BLogger {
             }
         }
 
+        // The stats of the sinks added so far, see prometheus_exporter
+        std::vector<std::shared_ptr<sink_stats>> SinkStats() const
+        {
+            std::vector<std::shared_ptr<sink_stats>> out;
+
+            for (auto& sink : *m_Sinks)
+                out.push_back(sink->stats());
+
+            return out;
+        }
+
         void AddSink(BaseSink* sink)
         {
             m_Sinks->emplace_back(std::unique_ptr<BaseSink>(sink));
             m_Sinks->back()->set_tag(m_Tag);
+
+            OnSinkAdded(*m_Sinks->back());
+            UpdateThreshold();
         }
 
         virtual ~BaseLogger() {}
     protected:
-        bool ShouldLog(level lvl)
+        void UpdateThreshold()
         {
-            if (m_Filter > lvl)
-                return false;
+            bool ready = !m_Sinks->empty() && !m_CachedPattern.empty();
 
-            if (m_Sinks->empty())
-                return false;
+            m_Threshold.store(
+                ready ? static_cast<int>(m_Filter.load(std::memory_order_relaxed)) : BLOGGER_LEVEL_OFF,
+                std::memory_order_relaxed
+            );
+        }
 
-            if (m_CachedPattern.empty())
-                return false;
+        virtual void Post(BLoggerLogMessage&& msg) = 0;
+
+        template<typename... Args>
+        void LogArgs(
+            std::false_type,
+            level lvl,
+            const bl_char* format,
+            size_t format_size,
+            bool copy_format,
+            Args&& ... args
+        )
+        {
+            if (m_DeferFormatting &&
+                TryDefer(
+                    std::integral_constant<bool, all_deferrable<Args...>::value>(),
+                    lvl, format, format_size, copy_format || m_CopyFormats, args...
+                ))
+                return;
+
+            BLoggerFormatter formatter;
+
+            formatter.process_message(format, format_size);
+
+            BLOGGER_PROCESS_PACK(formatter, args);
+
+            Post({
+                formatter.release_buffer(),
+                lvl
+            });
+        }
+
+        // Messages with fields are never deferred, the fields
+        // are encoded behind the text as the arguments go by
+        template<typename... Args>
+        void LogArgs(
+            std::true_type,
+            level lvl,
+            const bl_char* format,
+            size_t format_size,
+            bool,
+            Args&& ... args
+        )
+        {
+            BLoggerFormatter formatter;
+            field_collector<BLoggerFormatter> collector(formatter);
+
+            formatter.process_message(format, format_size);
+
+            BLOGGER_PROCESS_PACK(collector, args);
+
+            size_t fields_size = collector.fields().size();
+            formatter.write_to(collector.fields().data(), fields_size);
+
+            Post({
+                formatter.release_buffer(),
+                fields_size,
+                lvl
+            });
+        }
+
+        // Only copies the raw bytes of the arguments,
+        // the formatting itself happens in finalize_format.
+        // With copy_format = false only the pointer to the
+        // format string is kept, so it has to outlive the message.
+        template<typename... Args>
+        bool TryDefer(
+            std::true_type,
+            level lvl,
+            const bl_char* format,
+            size_t format_size,
+            bool copy_format,
+            const Args& ... args
+        )
+        {
+            size_t prefix = copy_format ? format_size : 0;
+
+            BLoggerMessageBuffer buffer(prefix + deferred_size(args...));
+
+            if (copy_format)
+                MEMORY_COPY(buffer.data(), buffer.size(), format, format_size);
+
+            write_deferred(buffer.data() + prefix, args...);
+
+            Post({
+                copy_format ? nullptr : format,
+                format_size,
+                std::move(buffer),
+                lvl
+            });
 
             return true;
         }
 
-        virtual void Post(BLoggerLogMessage&& msg) = 0;
+        template<typename... Args>
+        bool TryDefer(std::false_type, level, const bl_char*, size_t, bool, const Args& ...)
+        {
+            return false;
+        }
+
+        virtual void OnSinkAdded(BaseSink&) {}
+
+        // Called with the pattern that was just replaced,
+        // which is destroyed once this function returns
+        // unless the callee keeps a reference to it
+        virtual void OnPatternChanged(BLoggerSharedPattern&) {}
     };
 }
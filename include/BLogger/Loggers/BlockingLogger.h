@@ -1,13 +1,201 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "BLogger/Loggers/BaseLogger.h"
 #include "BLogger/LogLevels.h"
 #include "BLogger/Sinks/BaseSink.h"
 
+#define BLOGGER_STAGING_DELAY_MS 100
+
+// How many times per max_delay the staging timer checks
+// the buffers, a message waits at most max_delay plus
+// max_delay / BLOGGER_STAGING_TICKS
+#define BLOGGER_STAGING_TICKS 4
+
 namespace BLogger {
 
+    // A single background thread shared by the blocking loggers
+    // that stage their messages, publishes the staged messages that
+    // are older than max_delay even if their thread never logs again.
+    // Not the housekeeper, writing to a file sink can wait for it.
+    class staging_timer
+    {
+    private:
+        struct job
+        {
+            std::chrono::steady_clock::time_point next;
+            std::chrono::nanoseconds              interval;
+            std::function<bool()>                 run;
+        };
+    private:
+        std::mutex              m_Access;
+        std::condition_variable m_Notifier;
+        std::vector<job>        m_Jobs;
+        std::thread             m_Thread;
+    public:
+        // Never destroyed, like the housekeeper
+        static staging_timer& get()
+        {
+            static staging_timer* instance = new staging_timer();
+            return *instance;
+        }
+
+        // Runs fn every interval until it returns false
+        void schedule(std::chrono::nanoseconds interval, std::function<bool()> fn)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Access);
+                m_Jobs.push_back({ std::chrono::steady_clock::now() + interval, interval, std::move(fn) });
+            }
+
+            m_Notifier.notify_one();
+        }
+    private:
+        staging_timer()
+            : m_Access(),
+            m_Notifier(),
+            m_Jobs(),
+            m_Thread(std::bind(&staging_timer::run, this))
+        {
+        }
+
+        staging_timer(const staging_timer& other) = delete;
+        staging_timer& operator=(const staging_timer& other) = delete;
+
+        void run()
+        {
+            std::vector<job> due;
+            std::unique_lock<std::mutex> lock(m_Access);
+
+            for (;;)
+            {
+                if (m_Jobs.empty())
+                {
+                    m_Notifier.wait(lock);
+                    continue;
+                }
+
+                auto next = std::min_element(m_Jobs.begin(), m_Jobs.end(),
+                    [](const job& a, const job& b) { return a.next < b.next; }
+                )->next;
+
+                if (m_Notifier.wait_until(lock, next) == std::cv_status::no_timeout)
+                    continue;
+
+                auto now = std::chrono::steady_clock::now();
+
+                // the jobs run unlocked so that they can take
+                // their time, the ones that are done are dropped
+                auto split = std::partition(m_Jobs.begin(), m_Jobs.end(),
+                    [now](const job& j) { return j.next > now; }
+                );
+
+                due.assign(std::make_move_iterator(split), std::make_move_iterator(m_Jobs.end()));
+                m_Jobs.erase(split, m_Jobs.end());
+
+                lock.unlock();
+
+                for (auto& j : due)
+                    j.next = now + j.interval;
+
+                due.erase(
+                    std::remove_if(due.begin(), due.end(), [](job& j) { return !j.run(); }),
+                    due.end()
+                );
+
+                lock.lock();
+
+                std::move(due.begin(), due.end(), std::back_inserter(m_Jobs));
+                due.clear();
+            }
+        }
+    };
+
     class BlockingLogger : public BaseLogger
     {
+    private:
+        // The messages a thread logged that haven't
+        // been handed to the sinks yet
+        struct staging_buffer
+        {
+            std::mutex                     access;
+            std::vector<BLoggerLogMessage> messages;
+            size_t                         bytes;
+            blogger_timestamp              first;
+
+            staging_buffer()
+                : access(),
+                messages(),
+                bytes(0),
+                first(0)
+            {
+            }
+        };
+
+        // Every staging buffer of a logger, so that any thread can
+        // publish them. The owner is cleared once the logger is gone.
+        struct staging_area
+        {
+            std::mutex                                   access;
+            std::vector<std::shared_ptr<staging_buffer>> buffers;
+            BlockingLogger*                              owner;
+            blogger_timestamp                            delay;
+            bool                                         timed;
+        };
+
+        // The buffers of a thread, one per logger it used,
+        // published when the thread exits
+        struct thread_staging
+        {
+            struct entry
+            {
+                uint64_t                        logger;
+                std::weak_ptr<staging_area>     area;
+                std::shared_ptr<staging_buffer> buffer;
+            };
+
+            std::vector<entry> entries;
+
+            ~thread_staging()
+            {
+                for (auto& e : entries)
+                    release(e);
+            }
+
+            static void release(entry& e)
+            {
+                std::shared_ptr<staging_area> area = e.area.lock();
+
+                if (!area)
+                    return;
+
+                locker lock(area->access);
+
+                if (area->owner)
+                {
+                    locker buffer_lock(e.buffer->access);
+                    area->owner->Publish(*e.buffer);
+                }
+
+                auto& buffers = area->buffers;
+                buffers.erase(std::remove(buffers.begin(), buffers.end(), e.buffer), buffers.end());
+            }
+        };
+    private:
+        uint64_t                      m_Id;
+        std::shared_ptr<staging_area> m_Staging;
+        size_t                        m_StagingBytes;
+        blogger_timestamp             m_StagingDelay;
     public:
         BlockingLogger(
             BLoggerInString tag,
@@ -17,26 +205,265 @@ namespace BLogger {
             tag,
             lvl,
             default_pattern
+        ),
+            m_Id(next_id()),
+            m_Staging(new staging_area()),
+            m_StagingBytes(0),
+            m_StagingDelay(0)
+        {
+            m_Staging->owner = this;
+            m_Staging->delay = 0;
+            m_Staging->timed = false;
+        }
+
+        // Makes every thread collect its messages and hand them to
+        // the sinks as a single batch once they add up to bytes, the
+        // first one is older than max_delay (checked when the thread
+        // logs and by the staging_timer), on Flush or as soon as an
+        // error/crit message is logged. Messages of different threads
+        // are then interleaved in chunks. 0 bytes writes every message
+        // right away (default).
+        //
+        // Not thread safe, meant to be called
+        // right after the logger is created.
+        void SetStaging(
+            size_t bytes,
+            std::chrono::milliseconds max_delay = std::chrono::milliseconds(BLOGGER_STAGING_DELAY_MS)
         )
         {
+            m_StagingBytes = bytes;
+            m_StagingDelay = std::chrono::duration_cast<std::chrono::nanoseconds>(max_delay).count();
+
+            locker lock(m_Staging->access);
+            m_Staging->delay = m_StagingDelay;
+
+            if (!bytes || m_Staging->timed)
+                return;
+
+            m_Staging->timed = true;
+
+            std::chrono::nanoseconds tick = max_delay / BLOGGER_STAGING_TICKS;
+
+            if (tick < std::chrono::milliseconds(1))
+                tick = std::chrono::milliseconds(1);
+
+            std::weak_ptr<staging_area> area = m_Staging;
+
+            staging_timer::get().schedule(tick, [area]() { return PublishExpired(area); });
         }
 
         void Flush() override
         {
+            PublishAll();
+
             for (auto& sink : *m_Sinks)
             {
-                sink->flush();
+                sink->timed_flush();
             }
         }
+
+        // Done on the calling thread, so it never times out
+        bool Flush(std::chrono::milliseconds) override
+        {
+            PublishAll();
+
+            for (auto& sink : *m_Sinks)
+            {
+                sink->timed_sync();
+            }
+
+            return true;
+        }
+
+        ~BlockingLogger()
+        {
+            locker lock(m_Staging->access);
+
+            for (auto& buffer : m_Staging->buffers)
+            {
+                locker buffer_lock(buffer->access);
+                Publish(*buffer);
+            }
+
+            m_Staging->owner = nullptr;
+        }
     private:
         void Post(BLoggerLogMessage&& msg) override
         {
-            msg.finalize_format();
+            if (m_StagingBytes)
+            {
+                Stage(std::move(msg));
+                return;
+            }
+
+            bool formatted_sinks = false;
+
+            for (auto& sink : *m_Sinks)
+            {
+                if (!sink->accepts(msg.log_level()))
+                    continue;
+
+                if (sink->wants_raw_messages())
+                    sink->timed_write(msg);
+                else
+                    formatted_sinks = true;
+            }
+
+            if (!formatted_sinks)
+                return;
+
+            msg.finalize_format(*m_CurrentPattern);
+
+            for (auto& sink : *m_Sinks)
+            {
+                if (!sink->wants_raw_messages() && sink->accepts(msg.log_level()))
+                    sink->timed_write(msg);
+            }
+        }
+
+        void Stage(BLoggerLogMessage&& msg)
+        {
+            staging_buffer& buffer = LocalBuffer();
+            locker lock(buffer.access);
+
+            if (buffer.messages.empty())
+                buffer.first = msg.log_timestamp();
+
+            level lvl = msg.log_level();
+            blogger_timestamp timestamp = msg.log_timestamp();
+
+            buffer.bytes += msg.size();
+            buffer.messages.push_back(std::move(msg));
+
+            if (buffer.bytes >= m_StagingBytes ||
+                lvl >= level::error ||
+                timestamp - buffer.first >= m_StagingDelay)
+                Publish(buffer);
+        }
+
+        // The caller must hold the lock of the buffer
+        void Publish(staging_buffer& buffer)
+        {
+            if (buffer.messages.empty())
+                return;
+
+            std::vector<BLoggerLogMessage*> messages;
+            std::vector<BLoggerLogMessage*> filtered;
+
+            messages.reserve(buffer.messages.size());
+
+            for (auto& message : buffer.messages)
+                messages.push_back(&message);
+
+            level lowest = level::crit;
+            bool formatted_sinks = false;
 
             for (auto& sink : *m_Sinks)
             {
-                sink->write(msg);
+                if (sink->wants_raw_messages())
+                    sink->write_filtered(messages, filtered);
+                else
+                {
+                    lowest = (std::min)(lowest, sink->filter());
+                    formatted_sinks = true;
+                }
+            }
+
+            if (formatted_sinks)
+            {
+                for (auto message : messages)
+                {
+                    if (message->log_level() >= lowest)
+                        message->finalize_format(*m_CurrentPattern);
+                }
+
+                for (auto& sink : *m_Sinks)
+                {
+                    if (!sink->wants_raw_messages())
+                        sink->write_filtered(messages, filtered);
+                }
+            }
+
+            buffer.messages.clear();
+            buffer.bytes = 0;
+        }
+
+        // Run by the staging_timer, false once the logger is gone
+        static bool PublishExpired(const std::weak_ptr<staging_area>& weak_area)
+        {
+            std::shared_ptr<staging_area> area = weak_area.lock();
+
+            if (!area)
+                return false;
+
+            locker lock(area->access);
+
+            if (!area->owner)
+                return false;
+
+            blogger_timestamp now = capture_timestamp();
+
+            for (auto& buffer : area->buffers)
+            {
+                locker buffer_lock(buffer->access);
+
+                if (!buffer->messages.empty() && now - buffer->first >= area->delay)
+                    area->owner->Publish(*buffer);
+            }
+
+            return true;
+        }
+
+        void PublishAll()
+        {
+            locker lock(m_Staging->access);
+
+            for (auto& buffer : m_Staging->buffers)
+            {
+                locker buffer_lock(buffer->access);
+                Publish(*buffer);
+            }
+        }
+
+        staging_buffer& LocalBuffer()
+        {
+            static thread_local thread_staging local;
+
+            for (auto& e : local.entries)
+            {
+                if (e.logger == m_Id)
+                    return *e.buffer;
             }
+
+            // forget the loggers that are gone
+            local.entries.erase(
+                std::remove_if(
+                    local.entries.begin(),
+                    local.entries.end(),
+                    [](const thread_staging::entry& e)
+                    {
+                        return e.area.expired();
+                    }
+                ),
+                local.entries.end()
+            );
+
+            std::shared_ptr<staging_buffer> buffer(new staging_buffer());
+
+            {
+                locker lock(m_Staging->access);
+                m_Staging->buffers.push_back(buffer);
+            }
+
+            local.entries.push_back({ m_Id, m_Staging, buffer });
+
+            return *buffer;
+        }
+
+        static uint64_t next_id()
+        {
+            static std::atomic<uint64_t> id(0);
+            return id.fetch_add(1, std::memory_order_relaxed);
         }
     };
 }
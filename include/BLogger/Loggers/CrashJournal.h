@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BLogger/Formatter/BinaryFormat.h"
+#include "BLogger/Loggers/LogMessage.h"
+#include "BLogger/OS/Functions.h"
+
+#define BLOGGER_JOURNAL_MAGIC "BLOGJRN2"
+#define BLOGGER_JOURNAL_MAGIC_SIZE 8
+#define BLOGGER_JOURNAL_SLOT_SIZE 512
+#define BLOGGER_JOURNAL_PREVIOUS_SUFFIX ".prev"
+#define BLOGGER_NO_JOURNAL 0
+
+// The most a text record adds on top of its text:
+// the record type, the level and three varints
+#define BLOGGER_TEXT_RECORD_OVERHEAD 32
+
+namespace BLogger {
+
+    // A memory mapped file the async loggers copy every message into
+    // before queueing it, so the messages that were still queued when
+    // the process died can be recovered afterwards (see recover and
+    // blogger-decode -j). Nothing is ever synced: the pages of a shared
+    // mapping belong to the kernel and outlive the process, so this
+    // survives a crash, but not a power loss.
+    //
+    // The file is a header followed by a ring of fixed size slots. Each
+    // slot holds a standalone binary log (see BinaryFormat.h) with the
+    // tag and a single message, messages that don't fit are stored as
+    // clipped text. A slot stays pending from the moment it's written
+    // until the backend has handed its message to every sink.
+    //
+    // Not implemented for windows yet, open always fails there.
+    class crash_journal
+    {
+    private:
+        struct header
+        {
+            char                  magic[BLOGGER_JOURNAL_MAGIC_SIZE];
+            uint32_t              slot_size;
+            uint32_t              reserved;
+            uint64_t              slot_count;
+            std::atomic<uint64_t> next;
+        };
+
+        // state is (sequence << 1) | 1 while pending, sequence << 1
+        // once written, 0 if never used and filling while a writer
+        // owns it. The checksum covers the size bytes after the header.
+        struct slot_header
+        {
+            std::atomic<uint64_t> state;
+            uint32_t              size;
+            uint32_t              checksum;
+        };
+
+        static constexpr uint64_t filling = ~static_cast<uint64_t>(1);
+
+        static_assert(sizeof(header) <= BLOGGER_CACHE_LINE, "The journal header must fit in a cache line");
+    private:
+        int      m_File;
+        bl_char* m_Mapping;
+        size_t   m_MappingSize;
+        header*  m_Header;
+        uint64_t m_Mask;
+    public:
+        crash_journal()
+            : m_File(-1),
+            m_Mapping(nullptr),
+            m_MappingSize(0),
+            m_Header(nullptr),
+            m_Mask(0)
+        {
+        }
+
+        crash_journal(const crash_journal& other) = delete;
+        crash_journal& operator=(const crash_journal& other) = delete;
+
+        // Creates a journal of at least the given number of slots
+        // (rounded up to a power of two). A journal already at path
+        // that still has pending messages is the one of a process
+        // that crashed, it's kept as path + BLOGGER_JOURNAL_PREVIOUS_SUFFIX.
+        bool open(BLoggerInString path, size_t slots)
+        {
+#ifdef _WIN32
+            (void)path;
+            (void)slots;
+            return false;
+#else
+            BLoggerString file_path(path.data(), path.size());
+
+            if (pending(file_path))
+            {
+                BLoggerString previous = file_path + BLOGGER_JOURNAL_PREVIOUS_SUFFIX;
+                std::rename(file_path.c_str(), previous.c_str());
+            }
+
+            uint64_t count = 1;
+            while (count < slots)
+                count <<= 1;
+
+            size_t size = BLOGGER_CACHE_LINE + static_cast<size_t>(count) * BLOGGER_JOURNAL_SLOT_SIZE;
+
+            int file = ::open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+            if (file == -1)
+                return false;
+
+            // allocated upfront so that a full disk can't
+            // turn a store into the mapping into a SIGBUS
+            if (posix_fallocate(file, 0, static_cast<off_t>(size)))
+            {
+                ::close(file);
+                return false;
+            }
+
+            void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+
+            if (mapping == MAP_FAILED)
+            {
+                ::close(file);
+                return false;
+            }
+
+            m_File = file;
+            m_Mapping = static_cast<bl_char*>(mapping);
+            m_MappingSize = size;
+            m_Mask = count - 1;
+
+            m_Header = new (m_Mapping) header();
+            memcpy(m_Header->magic, BLOGGER_JOURNAL_MAGIC, BLOGGER_JOURNAL_MAGIC_SIZE);
+            m_Header->slot_size = BLOGGER_JOURNAL_SLOT_SIZE;
+            m_Header->reserved = 0;
+            m_Header->slot_count = count;
+            m_Header->next.store(1, std::memory_order_relaxed);
+
+            for (uint64_t i = 0; i < count; i++)
+                new (slot_at(i)) slot_header();
+
+            return true;
+#endif
+        }
+
+        bool is_open()
+        {
+            return m_Mapping != nullptr;
+        }
+
+        // Copies the message into the next slot, the returned
+        // sequence releases it. Returns BLOGGER_NO_JOURNAL if the
+        // tag alone doesn't fit into a slot, or if the slot is still
+        // owned by a writer that wrapped around the ring (or holds a
+        // newer message), in which case the message isn't journaled.
+        uint64_t record(BLoggerLogMessage& msg, BLoggerInString tag)
+        {
+            static thread_local binary_log_encoder encoder;
+            static thread_local bl_string out;
+
+            const size_t capacity = BLOGGER_JOURNAL_SLOT_SIZE - sizeof(slot_header);
+
+            out.clear();
+            encoder.reset();
+            encoder.put_header(out, tag);
+
+            size_t header_size = out.size();
+
+            if (header_size + BLOGGER_TEXT_RECORD_OVERHEAD > capacity)
+                return BLOGGER_NO_JOURNAL;
+
+            encoder.put_message(out, msg);
+
+            if (out.size() > capacity)
+            {
+                out.resize(header_size);
+                encoder.reset();
+
+                BLoggerMessageBuffer text = msg.message_text();
+                size_t room = capacity - header_size - BLOGGER_TEXT_RECORD_OVERHEAD;
+
+                encoder.put_text(out, msg, text.data(), (std::min)(text.size(), room));
+            }
+
+            uint64_t sequence = m_Header->next.fetch_add(1, std::memory_order_relaxed);
+            slot_header* slot = slot_at(sequence & m_Mask);
+
+            uint64_t state = slot->state.load(std::memory_order_relaxed);
+
+            if (state == filling || (state >> 1) >= sequence ||
+                !slot->state.compare_exchange_strong(state, filling, std::memory_order_acquire))
+                return BLOGGER_NO_JOURNAL;
+
+            std::atomic_thread_fence(std::memory_order_release);
+
+            memcpy(reinterpret_cast<bl_char*>(slot + 1), out.data(), out.size());
+            slot->size = static_cast<uint32_t>(out.size());
+            slot->checksum = checksum_of(out.data(), out.size());
+
+            slot->state.store((sequence << 1) | 1, std::memory_order_release);
+
+            return sequence;
+        }
+
+        // The message made it to the sinks. Does nothing if the
+        // slot has been reused in the meantime.
+        void release(uint64_t sequence)
+        {
+            if (sequence == BLOGGER_NO_JOURNAL)
+                return;
+
+            uint64_t state = (sequence << 1) | 1;
+
+            slot_at(sequence & m_Mask)->state.compare_exchange_strong(
+                state, sequence << 1, std::memory_order_relaxed
+            );
+        }
+
+        // Whatever is left pending is only left because the process
+        // died, by the time the journal is closed the backend has
+        // written (and released) everything that was queued
+        void close()
+        {
+#ifndef _WIN32
+            if (!m_Mapping)
+                return;
+
+            munmap(m_Mapping, m_MappingSize);
+            ::close(m_File);
+
+            m_Mapping = nullptr;
+            m_Header = nullptr;
+            m_File = -1;
+#endif
+        }
+
+        ~crash_journal()
+        {
+            close();
+        }
+
+        // Calls output with every line of the messages still pending
+        // in the journal at path, oldest first, formatted with the
+        // given pattern. Returns false if the file isn't a journal.
+        // Slots torn by the crash (a bad size or checksum) are
+        // skipped and counted in broken.
+        template<typename OutputT>
+        static bool recover(
+            BLoggerInString path,
+            BLoggerInString pattern,
+            BLoggerInString timestampFormat,
+            OutputT&& output,
+            size_t* broken = nullptr
+        )
+        {
+            std::vector<bl_char> data;
+            std::vector<std::pair<uint64_t, size_t>> slots;
+
+            if (!load(path, data, slots))
+                return false;
+
+            size_t broken_slots = 0;
+
+            for (auto& slot : slots)
+            {
+                const bl_char* at = data.data() + slot.second;
+                const bl_char* body = at + sizeof(slot_header);
+                uint32_t size, checksum;
+
+                memcpy(&size, at + offsetof(slot_header, size), sizeof(size));
+                memcpy(&checksum, at + offsetof(slot_header, checksum), sizeof(checksum));
+
+                if (size > BLOGGER_JOURNAL_SLOT_SIZE - sizeof(slot_header) ||
+                    checksum_of(body, size) != checksum)
+                {
+                    broken_slots++;
+                    continue;
+                }
+
+                binary_log_reader reader(pattern, timestampFormat);
+
+                if (!reader.read(body, size, output))
+                    broken_slots++;
+            }
+
+            if (broken)
+                *broken = broken_slots;
+
+            return true;
+        }
+
+        // Whether the file at path is a journal with pending messages
+        static bool pending(BLoggerInString path)
+        {
+            std::vector<bl_char> data;
+            std::vector<std::pair<uint64_t, size_t>> slots;
+
+            return load(path, data, slots) && !slots.empty();
+        }
+    private:
+        slot_header* slot_at(uint64_t index)
+        {
+            return reinterpret_cast<slot_header*>(
+                m_Mapping + BLOGGER_CACHE_LINE + index * BLOGGER_JOURNAL_SLOT_SIZE
+            );
+        }
+
+        // FNV-1a folded to 32 bits
+        static uint32_t checksum_of(const bl_char* data, size_t size)
+        {
+            uint64_t hash = 14695981039346656037ull;
+
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= static_cast<uint8_t>(data[i]);
+                hash *= 1099511628211ull;
+            }
+
+            return static_cast<uint32_t>(hash ^ (hash >> 32));
+        }
+
+        // Reads the journal and finds the sequence and
+        // offset of every pending slot, sorted by sequence
+        static bool load(
+            BLoggerInString path,
+            std::vector<bl_char>& data,
+            std::vector<std::pair<uint64_t, size_t>>& slots
+        )
+        {
+            std::ifstream file(BLoggerString(path.data(), path.size()), std::ios::binary);
+
+            if (!file)
+                return false;
+
+            data.assign(
+                (std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>()
+            );
+
+            if (data.size() < BLOGGER_CACHE_LINE ||
+                memcmp(data.data(), BLOGGER_JOURNAL_MAGIC, BLOGGER_JOURNAL_MAGIC_SIZE))
+                return false;
+
+            uint32_t slot_size;
+            uint64_t slot_count;
+
+            memcpy(&slot_size, data.data() + offsetof(header, slot_size), sizeof(slot_size));
+            memcpy(&slot_count, data.data() + offsetof(header, slot_count), sizeof(slot_count));
+
+            if (slot_size != BLOGGER_JOURNAL_SLOT_SIZE ||
+                (data.size() - BLOGGER_CACHE_LINE) / slot_size < slot_count)
+                return false;
+
+            for (uint64_t i = 0; i < slot_count; i++)
+            {
+                size_t offset = BLOGGER_CACHE_LINE + static_cast<size_t>(i) * slot_size;
+                uint64_t state;
+
+                memcpy(&state, data.data() + offset, sizeof(state));
+
+                if (state & 1)
+                    slots.emplace_back(state >> 1, offset);
+            }
+
+            std::sort(slots.begin(), slots.end());
+
+            return true;
+        }
+    };
+}
@@ -2,37 +2,108 @@
 
 #include "BLogger/LogLevels.h"
 #include "BLogger/Formatter/Formatter.h"
+#include "BLogger/Formatter/DeferredArgs.h"
 
 namespace BLogger {
 
     struct BLoggerLogMessage
     {
     private:
-        bl_string formatted_msg;
-        BLoggerSharedPattern ptrn;
-        std::tm time_point;
+        BLoggerMessageBuffer formatted_msg;
+        blogger_timestamp timestamp;
         level lvl;
+        uint64_t thread_id;
+
+        // If the message is deferred, formatted_msg holds the
+        // encoded arguments, preceded by the format string
+        // itself if it wasn't safe to just keep the pointer.
+        const bl_char* deferred_format;
+        size_t deferred_format_size;
+        bool deferred;
+
+        // The encoded key/value fields at the end of
+        // formatted_msg, until finalize_format merges them
+        size_t fields_size;
     public:
+        BLoggerLogMessage()
+            : formatted_msg(),
+            timestamp(0),
+            lvl(level::trace),
+            thread_id(0),
+            deferred_format(nullptr),
+            deferred_format_size(0),
+            deferred(false),
+            fields_size(0)
+        {
+        }
+
         BLoggerLogMessage(
-            bl_string&& formatted_msg,
-            BLoggerSharedPattern& ptrn,
-            std::tm tp,
+            BLoggerMessageBuffer&& formatted_msg,
             level lvl
         ) : formatted_msg(std::move(formatted_msg)),
-            ptrn(ptrn),
-            time_point(tp),
-            lvl(lvl)
+            timestamp(capture_timestamp()),
+            lvl(lvl),
+            thread_id(get_thread_id()),
+            deferred_format(nullptr),
+            deferred_format_size(0),
+            deferred(false),
+            fields_size(0)
         {
         }
 
-        void finalize_format()
+        // Pass a null format to store a copy of it in front
+        // of the arguments, deferred_args must already
+        // contain format_size bytes of it in that case.
+        BLoggerLogMessage(
+            const bl_char* format,
+            size_t format_size,
+            BLoggerMessageBuffer&& deferred_args,
+            level lvl
+        ) : formatted_msg(std::move(deferred_args)),
+            timestamp(capture_timestamp()),
+            lvl(lvl),
+            thread_id(get_thread_id()),
+            deferred_format(format),
+            deferred_format_size(format_size),
+            deferred(true),
+            fields_size(0)
         {
+        }
+
+        // formatted_msg is the text followed by
+        // fields_size bytes of encoded fields (see Fields.h)
+        BLoggerLogMessage(
+            BLoggerMessageBuffer&& formatted_msg,
+            size_t fields_size,
+            level lvl
+        ) : formatted_msg(std::move(formatted_msg)),
+            timestamp(capture_timestamp()),
+            lvl(lvl),
+            thread_id(get_thread_id()),
+            deferred_format(nullptr),
+            deferred_format_size(0),
+            deferred(false),
+            fields_size(fields_size)
+        {
+        }
+
+        // The pattern isn't stored in the message, the logger
+        // (or the backend on its behalf) passes its current one
+        void finalize_format(const BLoggerPattern& pattern)
+        {
+            if (deferred)
+                format_deferred();
+
             BLoggerFormatter::merge_pattern(
                 formatted_msg,
-                ptrn,
-                time_point_ptr(),
-                lvl
+                pattern,
+                timestamp,
+                lvl,
+                thread_id,
+                fields_size
             );
+
+            fields_size = 0;
         }
 
         bl_char* data()
@@ -40,19 +111,119 @@ namespace BLogger {
             return formatted_msg.data();
         }
 
+        // Without the fields, see message_text
         size_t size()
         {
-            return formatted_msg.size();
+            return formatted_msg.size() - fields_size;
+        }
+
+        bool has_fields()
+        {
+            return fields_size != 0;
+        }
+
+        const bl_char* fields_data()
+        {
+            return formatted_msg.data() + formatted_msg.size() - fields_size;
+        }
+
+        size_t fields_length()
+        {
+            return fields_size;
         }
 
         level log_level()
         {
             return lvl;
         }
+
+        // Steady clock, see to_wall_clock_ns
+        blogger_timestamp log_timestamp()
+        {
+            return timestamp;
+        }
+
+        uint64_t log_thread_id()
+        {
+            return thread_id;
+        }
+
+        // Until finalize_format is called a deferred message holds
+        // the format string and the encoded arguments (see
+        // DeferredArgs.h), otherwise data() is already the text
+        bool is_deferred()
+        {
+            return deferred;
+        }
+
+        const bl_char* deferred_format_data()
+        {
+            return deferred_format ? deferred_format : formatted_msg.data();
+        }
+
+        size_t deferred_format_length()
+        {
+            return deferred_format_size;
+        }
+
+        const bl_char* deferred_args_data()
+        {
+            return formatted_msg.data() + (deferred_format ? 0 : deferred_format_size);
+        }
+
+        size_t deferred_args_size()
+        {
+            return formatted_msg.size() - (deferred_format ? 0 : deferred_format_size);
+        }
+
+        // Only pointers to formats known to outlive the message
+        // are kept, a copied format lives inside of the message
+        bool has_static_format()
+        {
+            return deferred_format != nullptr;
+        }
+
+        // The message without the pattern followed by its fields
+        // in logfmt, a deferred message is formatted into a copy
+        BLoggerMessageBuffer message_text()
+        {
+            if (deferred)
+                return format_arguments();
+
+            if (!fields_size)
+                return formatted_msg;
+
+            BLoggerMessageBuffer text;
+            text.append(formatted_msg.data(), size());
+            text.push_back(' ');
+            append_logfmt_fields(text, fields_data(), fields_size);
+
+            return text;
+        }
     private:
-        std::tm* time_point_ptr()
+        void format_deferred()
         {
-            return &time_point;
+            formatted_msg = format_arguments();
+            deferred = false;
+        }
+
+        BLoggerMessageBuffer format_arguments()
+        {
+            BLoggerFormatter formatter;
+
+            const bl_char* args = deferred_args_data();
+            size_t args_size = deferred_args_size();
+
+            formatter.process_message(deferred_format_data(), deferred_format_size);
+
+            read_deferred(args, args_size,
+                [&formatter](const auto& arg)
+                {
+                    formatter.handle_pack(arg);
+                }
+            );
+
+            return formatter.release_buffer();
         }
     };
 }
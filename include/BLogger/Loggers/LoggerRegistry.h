@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "BLogger/Formatter/Formatter.h"
+#include "BLogger/Sinks/BaseSink.h"
+
+#define BLOGGER_REGISTRY_CHUNK_SIZE 256
+#define BLOGGER_REGISTRY_CHUNKS 1024
+
+namespace BLogger {
+
+    typedef uint32_t logger_handle;
+
+    // Everything the backend needs to write the messages of a logger.
+    // Never modified once it's published, changing the sinks or the
+    // pattern publishes a new state and retires the old one.
+    struct logger_state
+    {
+        std::vector<BaseSink*> sinks;
+        std::vector<BaseSink*> raw_sinks;
+        const BLoggerPattern*  pattern;
+    };
+
+    // Maps small integer handles to the current state of every
+    // async logger, so a queued task only has to carry the handle.
+    // Slots live in chunks that are never moved or freed, resolving
+    // a handle is two loads and never takes the lock.
+    class logger_registry
+    {
+    private:
+        typedef std::atomic<const logger_state*> slot;
+    private:
+        std::atomic<slot*>         m_Chunks[BLOGGER_REGISTRY_CHUNKS];
+        std::mutex                 m_Access;
+        std::vector<logger_handle> m_FreeHandles;
+        logger_handle              m_NextHandle;
+    public:
+        logger_registry()
+            : m_Access(),
+            m_FreeHandles(),
+            m_NextHandle(0)
+        {
+            for (auto& chunk : m_Chunks)
+                chunk.store(nullptr, std::memory_order_relaxed);
+        }
+
+        logger_registry(const logger_registry& other) = delete;
+        logger_registry& operator=(const logger_registry& other) = delete;
+
+        logger_handle add(const logger_state* state)
+        {
+            locker lock(m_Access);
+
+            logger_handle handle;
+
+            if (!m_FreeHandles.empty())
+            {
+                handle = m_FreeHandles.back();
+                m_FreeHandles.pop_back();
+            }
+            else
+            {
+                if (m_NextHandle == BLOGGER_REGISTRY_CHUNKS * BLOGGER_REGISTRY_CHUNK_SIZE)
+                    throw std::length_error("BLogger: too many async loggers");
+
+                handle = m_NextHandle++;
+
+                auto& chunk = m_Chunks[handle / BLOGGER_REGISTRY_CHUNK_SIZE];
+
+                if (!chunk.load(std::memory_order_relaxed))
+                {
+                    slot* slots = new slot[BLOGGER_REGISTRY_CHUNK_SIZE];
+
+                    for (size_t i = 0; i < BLOGGER_REGISTRY_CHUNK_SIZE; i++)
+                        slots[i].store(nullptr, std::memory_order_relaxed);
+
+                    chunk.store(slots, std::memory_order_release);
+                }
+            }
+
+            get_slot(handle).store(state, std::memory_order_release);
+
+            return handle;
+        }
+
+        // The previous state might still be in use by the backend
+        void update(logger_handle handle, const logger_state* state)
+        {
+            get_slot(handle).store(state, std::memory_order_release);
+        }
+
+        // Only safe once no queued task refers to the handle anymore
+        void remove(logger_handle handle)
+        {
+            locker lock(m_Access);
+
+            get_slot(handle).store(nullptr, std::memory_order_relaxed);
+            m_FreeHandles.push_back(handle);
+        }
+
+        // Calls f with the state of every logger that has one,
+        // loggers can't be added or removed in the meantime
+        template<typename FunctionT>
+        void for_each(FunctionT f)
+        {
+            locker lock(m_Access);
+
+            for (logger_handle handle = 0; handle < m_NextHandle; handle++)
+            {
+                const logger_state* state = get_slot(handle).load(std::memory_order_acquire);
+
+                if (state)
+                    f(*state);
+            }
+        }
+
+        const logger_state* resolve(logger_handle handle)
+        {
+            return get_slot(handle).load(std::memory_order_acquire);
+        }
+
+        ~logger_registry()
+        {
+            for (auto& chunk : m_Chunks)
+                delete[] chunk.load(std::memory_order_relaxed);
+        }
+    private:
+        slot& get_slot(logger_handle handle)
+        {
+            slot* chunk = m_Chunks[handle / BLOGGER_REGISTRY_CHUNK_SIZE].load(std::memory_order_acquire);
+            return chunk[handle % BLOGGER_REGISTRY_CHUNK_SIZE];
+        }
+    };
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "BLogger/OS/Functions.h"
+
+namespace BLogger {
+
+    inline size_t round_to_power_of_two(size_t value)
+    {
+        size_t out = 2;
+
+        while (out < value)
+            out <<= 1;
+
+        return out;
+    }
+
+    // A bounded multi-producer/multi-consumer queue
+    // of preallocated inline slots (D. Vyukov's design).
+    // Claiming a slot is a single CAS on the position
+    // counter, no locks and no allocations are involved.
+    template<typename T>
+    class ring_buffer
+    {
+    private:
+        struct cell
+        {
+            std::atomic<size_t> sequence;
+            T                   data;
+        };
+    private:
+        std::unique_ptr<cell[]> m_Cells;
+        size_t                  m_Mask;
+        char                    m_Pad0[BLOGGER_CACHE_LINE];
+        std::atomic<size_t>     m_EnqueuePos;
+        char                    m_Pad1[BLOGGER_CACHE_LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t>     m_DequeuePos;
+        char                    m_Pad2[BLOGGER_CACHE_LINE - sizeof(std::atomic<size_t>)];
+    public:
+        // capacity is rounded up to the next power of two
+        explicit ring_buffer(size_t capacity)
+            : m_Cells(new cell[round_to_power_of_two(capacity)]),
+            m_Mask(round_to_power_of_two(capacity) - 1),
+            m_EnqueuePos(0),
+            m_DequeuePos(0)
+        {
+            for (size_t i = 0; i <= m_Mask; i++)
+                m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        ring_buffer(const ring_buffer& other) = delete;
+        ring_buffer& operator=(const ring_buffer& other) = delete;
+
+        bool try_push(T&& value)
+        {
+            cell* target;
+            size_t pos = m_EnqueuePos.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                target = &m_Cells[pos & m_Mask];
+                size_t seq = target->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (m_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = m_EnqueuePos.load(std::memory_order_relaxed);
+            }
+
+            target->data = std::move(value);
+            target->sequence.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool try_pop(T& out)
+        {
+            cell* target;
+            size_t pos = m_DequeuePos.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                target = &m_Cells[pos & m_Mask];
+                size_t seq = target->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (m_DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = m_DequeuePos.load(std::memory_order_relaxed);
+            }
+
+            out = std::move(target->data);
+            target->sequence.store(pos + m_Mask + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // Claims up to max_count consecutive tasks with a single CAS,
+        // returns the number of tasks moved into out
+        size_t try_pop_bulk(T* out, size_t max_count)
+        {
+            size_t ready;
+            size_t pos = m_DequeuePos.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                for (ready = 0; ready < max_count; ready++)
+                {
+                    cell& target = m_Cells[(pos + ready) & m_Mask];
+
+                    if (target.sequence.load(std::memory_order_acquire) != pos + ready + 1)
+                        break;
+                }
+
+                if (ready)
+                {
+                    if (m_DequeuePos.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed))
+                        break;
+
+                    continue;
+                }
+
+                size_t seq = m_Cells[pos & m_Mask].sequence.load(std::memory_order_acquire);
+
+                if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0)
+                    return 0;
+
+                pos = m_DequeuePos.load(std::memory_order_relaxed);
+            }
+
+            for (size_t i = 0; i < ready; i++)
+            {
+                cell& target = m_Cells[(pos + i) & m_Mask];
+
+                out[i] = std::move(target.data);
+                target.sequence.store(pos + i + m_Mask + 1, std::memory_order_release);
+            }
+
+            return ready;
+        }
+
+        size_t capacity()
+        {
+            return m_Mask + 1;
+        }
+
+        // The preallocated slots, e.g. to place them on a NUMA node
+        const void* memory()
+        {
+            return m_Cells.get();
+        }
+
+        size_t memory_size()
+        {
+            return (m_Mask + 1) * sizeof(cell);
+        }
+
+        // Every task pushed so far has a position below this one
+        size_t enqueue_position()
+        {
+            return m_EnqueuePos.load(std::memory_order_relaxed);
+        }
+
+        // Every task below this position has been claimed by a consumer
+        size_t dequeue_position()
+        {
+            return m_DequeuePos.load(std::memory_order_relaxed);
+        }
+
+        // Only a snapshot, the value might
+        // change right after it was read
+        size_t size_approx()
+        {
+            size_t enqueued = m_EnqueuePos.load(std::memory_order_relaxed);
+            size_t dequeued = m_DequeuePos.load(std::memory_order_relaxed);
+
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+
+        bool empty_approx()
+        {
+            return size_approx() == 0;
+        }
+    };
+}
@@ -2,6 +2,19 @@
 
 #include <iostream>
 
+// Escape sequences for sinks that write the colors inline
+// with the text, on every platform
+#define BLOGGER_ANSI_BLACK   "\033[0;30m"
+#define BLOGGER_ANSI_RED     "\033[1;31m"
+#define BLOGGER_ANSI_ORANGE  "\033[0;33m"
+#define BLOGGER_ANSI_BLUE    "\033[1;34m"
+#define BLOGGER_ANSI_GREEN   "\033[1;32m"
+#define BLOGGER_ANSI_CYAN    "\033[1;36m"
+#define BLOGGER_ANSI_MAGENTA "\033[1;35m"
+#define BLOGGER_ANSI_YELLOW  "\033[1;33m"
+#define BLOGGER_ANSI_WHITE   "\033[1;37m"
+#define BLOGGER_ANSI_RESET   "\033[0m"
+
 #ifdef _WIN32
     #define BLOGGER_BLACK   0
     #define BLOGGER_RED     4
@@ -15,16 +28,16 @@
     #define BLOGGER_RESET   0xffff
     #define BLOGGER_DEFAULT BLOGGER_RESET
 #else
-    #define BLOGGER_BLACK   "\033[0;30m"
-    #define BLOGGER_RED     "\033[1;31m"
-    #define BLOGGER_ORANGE  "\033[0;33m"
-    #define BLOGGER_BLUE    "\033[1;34m"
-    #define BLOGGER_GREEN   "\033[1;32m"
-    #define BLOGGER_CYAN    "\033[1;36m"
-    #define BLOGGER_MAGENTA "\033[1;35m"
-    #define BLOGGER_YELLOW  "\033[1;33m"
-    #define BLOGGER_WHITE   "\033[1;37m"
-    #define BLOGGER_RESET   "\033[0m"
+    #define BLOGGER_BLACK   BLOGGER_ANSI_BLACK
+    #define BLOGGER_RED     BLOGGER_ANSI_RED
+    #define BLOGGER_ORANGE  BLOGGER_ANSI_ORANGE
+    #define BLOGGER_BLUE    BLOGGER_ANSI_BLUE
+    #define BLOGGER_GREEN   BLOGGER_ANSI_GREEN
+    #define BLOGGER_CYAN    BLOGGER_ANSI_CYAN
+    #define BLOGGER_MAGENTA BLOGGER_ANSI_MAGENTA
+    #define BLOGGER_YELLOW  BLOGGER_ANSI_YELLOW
+    #define BLOGGER_WHITE   BLOGGER_ANSI_WHITE
+    #define BLOGGER_RESET   BLOGGER_ANSI_RESET
     #define BLOGGER_DEFAULT BLOGGER_RESET
 #endif
 
@@ -35,6 +48,10 @@
         #define NOMINMAX
         #define WIN32_MEAN_AND_LEAN
     #endif
+
+    // Windows.h would pull in the old winsock.h otherwise,
+    // which can't coexist with the one NetworkSink uses
+    #include <winsock2.h>
     #include <Windows.h>
 
     typedef WORD blogger_color;
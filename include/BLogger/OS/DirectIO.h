@@ -0,0 +1,407 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+    #if __has_include(<linux/io_uring.h>) && !defined(BLOGGER_NO_IO_URING)
+        #include <linux/io_uring.h>
+        #ifdef __NR_io_uring_setup
+            #define BLOGGER_HAS_IO_URING
+        #endif
+    #endif
+#endif
+
+namespace BLogger {
+
+    // Submits writes and syncs that complete asynchronously.
+    // Only ever used by one thread at a time, and the caller
+    // never has more than capacity() operations in flight.
+    class io_queue
+    {
+    public:
+        // Ordered operations start only after
+        // everything submitted before them completed
+        virtual bool submit_write(uint64_t tag, int file, const iovec* vec, uint64_t offset, bool ordered) = 0;
+
+        // Always ordered
+        virtual bool submit_sync(uint64_t tag, int file) = 0;
+
+        // Returns false if nothing completed and wait is false,
+        // result is the number of bytes written or -errno
+        virtual bool reap(uint64_t& tag, int64_t& result, bool wait) = 0;
+
+        virtual size_t capacity() = 0;
+
+        virtual ~io_queue() {}
+    };
+
+    // Writes on a dedicated thread with pwritev, in submission order
+    class thread_io_queue : public io_queue
+    {
+    private:
+        struct request
+        {
+            uint64_t     tag;
+            int          file;
+            const iovec* vec;
+            uint64_t     offset;
+            int64_t      result;
+        };
+    private:
+        std::mutex              m_Access;
+        std::condition_variable m_Submitted;
+        std::condition_variable m_Completed;
+        std::deque<request>     m_Pending;
+        std::deque<request>     m_Done;
+        size_t                  m_Capacity;
+        bool                    m_Running;
+        std::thread             m_Thread;
+
+        typedef std::lock_guard<std::mutex>
+            locker;
+        typedef std::unique_lock<std::mutex>
+            unique_locker;
+    public:
+        explicit thread_io_queue(size_t capacity)
+            : m_Access(),
+            m_Submitted(),
+            m_Completed(),
+            m_Pending(),
+            m_Done(),
+            m_Capacity(capacity),
+            m_Running(true),
+            m_Thread(std::bind(&thread_io_queue::run, this))
+        {
+        }
+
+        bool submit_write(uint64_t tag, int file, const iovec* vec, uint64_t offset, bool) override
+        {
+            push({ tag, file, vec, offset, 0 });
+            return true;
+        }
+
+        bool submit_sync(uint64_t tag, int file) override
+        {
+            push({ tag, file, nullptr, 0, 0 });
+            return true;
+        }
+
+        bool reap(uint64_t& tag, int64_t& result, bool wait) override
+        {
+            unique_locker lock(m_Access);
+
+            if (wait)
+                m_Completed.wait(lock, [this] { return !m_Done.empty(); });
+            else if (m_Done.empty())
+                return false;
+
+            tag = m_Done.front().tag;
+            result = m_Done.front().result;
+            m_Done.pop_front();
+
+            return true;
+        }
+
+        size_t capacity() override
+        {
+            return m_Capacity;
+        }
+
+        ~thread_io_queue()
+        {
+            {
+                locker lock(m_Access);
+                m_Running = false;
+            }
+
+            m_Submitted.notify_one();
+            m_Thread.join();
+        }
+    private:
+        void push(const request& req)
+        {
+            {
+                locker lock(m_Access);
+                m_Pending.push_back(req);
+            }
+
+            m_Submitted.notify_one();
+        }
+
+        void run()
+        {
+            for (;;)
+            {
+                request req;
+
+                {
+                    unique_locker lock(m_Access);
+                    m_Submitted.wait(lock, [this] { return !m_Pending.empty() || !m_Running; });
+
+                    if (m_Pending.empty())
+                        return;
+
+                    req = m_Pending.front();
+                    m_Pending.pop_front();
+                }
+
+                if (req.vec)
+                    req.result = pwritev(req.file, req.vec, 1, static_cast<off_t>(req.offset));
+                else
+                    req.result = fdatasync(req.file);
+
+                if (req.result < 0)
+                    req.result = -errno;
+
+                {
+                    locker lock(m_Access);
+                    m_Done.push_back(req);
+                }
+
+                m_Completed.notify_one();
+            }
+        }
+    };
+
+#ifdef BLOGGER_HAS_IO_URING
+    // A minimal io_uring driven through the raw syscalls, so that
+    // there's no dependency on liburing. Uses IORING_OP_WRITEV and
+    // IORING_OP_FSYNC which are available since Linux 5.1/5.2.
+    class uring_io_queue : public io_queue
+    {
+    private:
+        int                    m_Ring;
+        size_t                 m_Capacity;
+
+        void*                  m_SubmissionMapping;
+        size_t                 m_SubmissionSize;
+        void*                  m_CompletionMapping;
+        size_t                 m_CompletionSize;
+        io_uring_sqe*          m_Entries;
+        size_t                 m_EntriesSize;
+
+        std::atomic<uint32_t>* m_SubmissionTail;
+        uint32_t               m_SubmissionMask;
+        uint32_t*              m_SubmissionArray;
+
+        std::atomic<uint32_t>* m_CompletionHead;
+        std::atomic<uint32_t>* m_CompletionTail;
+        uint32_t               m_CompletionMask;
+        io_uring_cqe*          m_Completions;
+    public:
+        // Returns null if io_uring isn't available, e.g. an older
+        // kernel or a seccomp profile that doesn't allow it
+        static io_queue* create(size_t capacity)
+        {
+            std::unique_ptr<uring_io_queue> queue(new uring_io_queue(capacity));
+            return queue->m_Ring >= 0 ? queue.release() : nullptr;
+        }
+
+        bool submit_write(uint64_t tag, int file, const iovec* vec, uint64_t offset, bool ordered) override
+        {
+            io_uring_sqe& entry = next_entry();
+
+            entry.opcode = IORING_OP_WRITEV;
+            entry.flags = ordered ? IOSQE_IO_DRAIN : 0;
+            entry.fd = file;
+            entry.addr = reinterpret_cast<uint64_t>(vec);
+            entry.len = 1;
+            entry.off = offset;
+            entry.user_data = tag;
+
+            return submit();
+        }
+
+        bool submit_sync(uint64_t tag, int file) override
+        {
+            io_uring_sqe& entry = next_entry();
+
+            entry.opcode = IORING_OP_FSYNC;
+            entry.flags = IOSQE_IO_DRAIN;
+            entry.fd = file;
+            entry.fsync_flags = IORING_FSYNC_DATASYNC;
+            entry.user_data = tag;
+
+            return submit();
+        }
+
+        bool reap(uint64_t& tag, int64_t& result, bool wait) override
+        {
+            uint32_t head = m_CompletionHead->load(std::memory_order_relaxed);
+
+            while (head == m_CompletionTail->load(std::memory_order_acquire))
+            {
+                if (!wait)
+                    return false;
+
+                if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                    return false;
+            }
+
+            const io_uring_cqe& completion = m_Completions[head & m_CompletionMask];
+
+            tag = completion.user_data;
+            result = completion.res;
+
+            m_CompletionHead->store(head + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        size_t capacity() override
+        {
+            return m_Capacity;
+        }
+
+        ~uring_io_queue()
+        {
+            if (m_Entries)
+                munmap(m_Entries, m_EntriesSize);
+
+            if (m_CompletionMapping && m_CompletionMapping != m_SubmissionMapping)
+                munmap(m_CompletionMapping, m_CompletionSize);
+
+            if (m_SubmissionMapping)
+                munmap(m_SubmissionMapping, m_SubmissionSize);
+
+            if (m_Ring >= 0)
+                close(m_Ring);
+        }
+    private:
+        explicit uring_io_queue(size_t capacity)
+            : m_Ring(-1),
+            m_Capacity(capacity),
+            m_SubmissionMapping(nullptr),
+            m_SubmissionSize(0),
+            m_CompletionMapping(nullptr),
+            m_CompletionSize(0),
+            m_Entries(nullptr),
+            m_EntriesSize(0)
+        {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+
+            int ring = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(capacity), &params));
+
+            if (ring < 0)
+                return;
+
+            m_SubmissionSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            m_CompletionSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+            bool single_mapping = params.features & IORING_FEAT_SINGLE_MMAP;
+
+            if (single_mapping && m_CompletionSize > m_SubmissionSize)
+                m_SubmissionSize = m_CompletionSize;
+
+            m_SubmissionMapping = map(ring, m_SubmissionSize, IORING_OFF_SQ_RING);
+
+            if (!m_SubmissionMapping)
+            {
+                close(ring);
+                return;
+            }
+
+            m_CompletionMapping = single_mapping
+                ? m_SubmissionMapping
+                : map(ring, m_CompletionSize, IORING_OFF_CQ_RING);
+
+            m_EntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+            m_Entries = static_cast<io_uring_sqe*>(map(ring, m_EntriesSize, IORING_OFF_SQES));
+
+            if (!m_CompletionMapping || !m_Entries)
+            {
+                close(ring);
+                return;
+            }
+
+            char* submission = static_cast<char*>(m_SubmissionMapping);
+            char* completion = static_cast<char*>(m_CompletionMapping);
+
+            m_SubmissionTail = reinterpret_cast<std::atomic<uint32_t>*>(submission + params.sq_off.tail);
+            m_SubmissionMask = *reinterpret_cast<uint32_t*>(submission + params.sq_off.ring_mask);
+            m_SubmissionArray = reinterpret_cast<uint32_t*>(submission + params.sq_off.array);
+
+            m_CompletionHead = reinterpret_cast<std::atomic<uint32_t>*>(completion + params.cq_off.head);
+            m_CompletionTail = reinterpret_cast<std::atomic<uint32_t>*>(completion + params.cq_off.tail);
+            m_CompletionMask = *reinterpret_cast<uint32_t*>(completion + params.cq_off.ring_mask);
+            m_Completions = reinterpret_cast<io_uring_cqe*>(completion + params.cq_off.cqes);
+
+            m_Ring = ring;
+        }
+
+        static void* map(int ring, size_t size, off_t offset)
+        {
+            void* mapping = mmap(
+                nullptr, size,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring, offset
+            );
+
+            return mapping == MAP_FAILED ? nullptr : mapping;
+        }
+
+        io_uring_sqe& next_entry()
+        {
+            uint32_t tail = m_SubmissionTail->load(std::memory_order_relaxed);
+            uint32_t index = tail & m_SubmissionMask;
+
+            io_uring_sqe& entry = m_Entries[index];
+            memset(&entry, 0, sizeof(entry));
+
+            m_SubmissionArray[index] = index;
+
+            return entry;
+        }
+
+        bool submit()
+        {
+            uint32_t tail = m_SubmissionTail->load(std::memory_order_relaxed);
+            m_SubmissionTail->store(tail + 1, std::memory_order_release);
+
+            int result;
+
+            do
+            {
+                result = enter(1, 0, 0);
+            } while (result < 0 && errno == EINTR);
+
+            return result >= 0;
+        }
+
+        int enter(unsigned submit, unsigned wait, unsigned flags)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_enter, m_Ring, submit, wait, flags, nullptr, 0));
+        }
+    };
+#endif
+
+    // Prefers io_uring, falls back to a writer thread
+    inline io_queue* make_io_queue(size_t capacity)
+    {
+    #ifdef BLOGGER_HAS_IO_URING
+        if (io_queue* queue = uring_io_queue::create(capacity))
+            return queue;
+    #endif
+
+        return new thread_io_queue(capacity);
+    }
+}
+
+#endif
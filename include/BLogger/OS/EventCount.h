@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+
+#ifdef _WIN32
+    #ifndef BLOGGER_FULL_WINDOWS
+        #define NOMINMAX
+        #define WIN32_MEAN_AND_LEAN
+    #endif
+    #include <Windows.h>
+    #pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+#else
+    #include <mutex>
+    #include <condition_variable>
+#endif
+
+namespace BLogger {
+
+    // Lets a thread park until some condition it has just checked
+    // might have changed, without holding a mutex on the hot path.
+    //
+    // waiter:   key = prepare_wait(); if (condition) cancel_wait(); else wait(key);
+    // notifier: make the condition true; notify_one();
+    //
+    // Notifying is a single load when nobody is parked.
+    class event_count
+    {
+    private:
+        std::atomic<uint32_t> m_Epoch;
+        std::atomic<uint32_t> m_Waiters;
+    #if !defined(_WIN32) && !defined(__linux__)
+        std::mutex              m_Access;
+        std::condition_variable m_Notifier;
+    #endif
+    public:
+        event_count()
+            : m_Epoch(0),
+            m_Waiters(0)
+        {
+        }
+
+        event_count(const event_count& other) = delete;
+        event_count& operator=(const event_count& other) = delete;
+
+        uint32_t prepare_wait()
+        {
+            m_Waiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            return m_Epoch.load(std::memory_order_acquire);
+        }
+
+        void cancel_wait()
+        {
+            m_Waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void wait(uint32_t key)
+        {
+            while (m_Epoch.load(std::memory_order_acquire) == key)
+                park(key);
+
+            m_Waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // Like wait, returns false if the deadline
+        // passed without a notification
+        bool wait_until(uint32_t key, std::chrono::steady_clock::time_point deadline)
+        {
+            bool notified = true;
+
+            while (m_Epoch.load(std::memory_order_acquire) == key)
+            {
+                auto now = std::chrono::steady_clock::now();
+
+                if (now >= deadline)
+                {
+                    notified = false;
+                    break;
+                }
+
+                park_for(key, std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now));
+            }
+
+            m_Waiters.fetch_sub(1, std::memory_order_relaxed);
+
+            return notified;
+        }
+
+        void notify_one()
+        {
+            notify(false);
+        }
+
+        void notify_all()
+        {
+            notify(true);
+        }
+    private:
+        void notify(bool all)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (!m_Waiters.load(std::memory_order_relaxed))
+                return;
+
+            m_Epoch.fetch_add(1, std::memory_order_release);
+            wake(all);
+        }
+
+    #ifdef _WIN32
+        void park(uint32_t key)
+        {
+            WaitOnAddress(&m_Epoch, &key, sizeof(key), INFINITE);
+        }
+
+        void park_for(uint32_t key, std::chrono::nanoseconds timeout)
+        {
+            // rounded up, so that it doesn't spin for the last millisecond
+            DWORD ms = static_cast<DWORD>((timeout.count() + 999999) / 1000000);
+
+            WaitOnAddress(&m_Epoch, &key, sizeof(key), ms);
+        }
+
+        void wake(bool all)
+        {
+            if (all)
+                WakeByAddressAll(&m_Epoch);
+            else
+                WakeByAddressSingle(&m_Epoch);
+        }
+    #elif defined(__linux__)
+        void park(uint32_t key)
+        {
+            syscall(SYS_futex, &m_Epoch, FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+        }
+
+        void park_for(uint32_t key, std::chrono::nanoseconds timeout)
+        {
+            timespec relative;
+            relative.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+            relative.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+
+            syscall(SYS_futex, &m_Epoch, FUTEX_WAIT_PRIVATE, key, &relative, nullptr, 0);
+        }
+
+        void wake(bool all)
+        {
+            syscall(SYS_futex, &m_Epoch, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+        }
+    #else
+        void park(uint32_t key)
+        {
+            std::unique_lock<std::mutex> lock(m_Access);
+
+            while (m_Epoch.load(std::memory_order_acquire) == key)
+                m_Notifier.wait(lock);
+        }
+
+        void park_for(uint32_t key, std::chrono::nanoseconds timeout)
+        {
+            std::unique_lock<std::mutex> lock(m_Access);
+
+            if (m_Epoch.load(std::memory_order_acquire) == key)
+                m_Notifier.wait_for(lock, timeout);
+        }
+
+        void wake(bool all)
+        {
+            std::lock_guard<std::mutex> lock(m_Access);
+
+            if (all)
+                m_Notifier.notify_all();
+            else
+                m_Notifier.notify_one();
+        }
+    #endif
+    };
+}
@@ -2,10 +2,14 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <thread>
+#include <cstdint>
 
 #ifdef _WIN32
     #define UPDATE_TIME(to, from) localtime_s(&to, &from)
+    #define UPDATE_UTC_TIME(to, from) gmtime_s(&to, &from)
     #define OPEN_FILE(file, path) fopen_s(&file, path.c_str(), "w")
+    #define OPEN_BINARY_FILE(file, path) fopen_s(&file, path.c_str(), "wb")
     #define MEMORY_COPY(dst, dst_size, src, src_size) memcpy_s(dst, dst_size, src, src_size)
     #define MEMORY_MOVE(dst, dst_size, src, src_size) memmove_s(dst, dst_size, src, src_size)
 
@@ -34,8 +38,96 @@
     #include <cstring>
     #include <algorithm>
     #define UPDATE_TIME(to, from) localtime_r(&from, &to)
+    #define UPDATE_UTC_TIME(to, from) gmtime_r(&from, &to)
     #define OPEN_FILE(file, path) file = fopen(path.c_str(), "w")
+    #define OPEN_BINARY_FILE(file, path) file = fopen(path.c_str(), "wb")
     #define MEMORY_COPY(dst, dst_size, src, src_size) memcpy(dst, src, src_size)
     #define MEMORY_MOVE(dst, dst_size, src, src_size) memmove(dst, src, src_size)
     #define STACK_ALLOC(size, out_ptr) out_ptr = static_cast<decltype(out_ptr)>(alloca(size))
 #endif
+
+// Flushes the stream and asks the OS to write it to disk
+#ifdef _WIN32
+    #include <io.h>
+
+    inline void sync_file(FILE* file)
+    {
+        fflush(file);
+        _commit(_fileno(file));
+    }
+#else
+    #include <unistd.h>
+
+    inline void sync_file(FILE* file)
+    {
+        fflush(file);
+        fsync(fileno(file));
+    }
+#endif
+
+// Used to keep hot atomics from sharing a cache line
+#define BLOGGER_CACHE_LINE 64
+
+// A hint for the CPU that we're inside of a spin loop
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define BLOGGER_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+    #define BLOGGER_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+    #define BLOGGER_CPU_RELAX() ((void)0)
+#endif
+
+// Pins the thread to the given CPU core,
+// returns false if that's not supported/failed
+#ifdef _WIN32
+    inline bool set_thread_affinity(std::thread& thread, size_t core)
+    {
+        DWORD_PTR mask = static_cast<DWORD_PTR>(1) << core;
+        return SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+    }
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+
+    inline bool set_thread_affinity(std::thread& thread, size_t core)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(core, &cpu_set);
+
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set) == 0;
+    }
+#else
+    inline bool set_thread_affinity(std::thread&, size_t)
+    {
+        return false;
+    }
+#endif
+
+// A numeric id of the calling thread,
+// cached since it's queried for every message
+#ifdef _WIN32
+    inline uint64_t get_thread_id()
+    {
+        static thread_local uint64_t id = GetCurrentThreadId();
+        return id;
+    }
+#elif defined(__linux__)
+    #include <sys/syscall.h>
+    #include <unistd.h>
+
+    inline uint64_t get_thread_id()
+    {
+        static thread_local uint64_t id = static_cast<uint64_t>(syscall(SYS_gettid));
+        return id;
+    }
+#else
+    #include <functional>
+
+    inline uint64_t get_thread_id()
+    {
+        static thread_local uint64_t id = std::hash<std::thread::id>()(std::this_thread::get_id());
+        return id;
+    }
+#endif
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#define BLOGGER_NO_NUMA_NODE -1
+
+// The kernel's values from linux/mempolicy.h
+#define BLOGGER_MPOL_PREFERRED 1
+#define BLOGGER_MPOL_MF_MOVE   (1 << 1)
+
+// The CPU cores that belong to the given NUMA
+// node, empty if that can't be queried
+#ifdef _WIN32
+    inline std::vector<size_t> numa_node_cores(int32_t node)
+    {
+        std::vector<size_t> cores;
+        ULONGLONG mask = 0;
+
+        if (node < 0 || !GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+            return cores;
+
+        for (size_t core = 0; core < 64; core++)
+        {
+            if (mask & (static_cast<ULONGLONG>(1) << core))
+                cores.push_back(core);
+        }
+
+        return cores;
+    }
+#elif defined(__linux__)
+    // Parses /sys/devices/system/node/nodeN/cpulist, e.g. "0-3,8-11"
+    inline std::vector<size_t> numa_node_cores(int32_t node)
+    {
+        std::vector<size_t> cores;
+
+        if (node < 0)
+            return cores;
+
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", static_cast<int>(node));
+
+        FILE* file = fopen(path, "r");
+
+        if (!file)
+            return cores;
+
+        unsigned long first;
+        unsigned long last;
+
+        while (fscanf(file, "%lu", &first) == 1)
+        {
+            last = first;
+
+            int next = fgetc(file);
+
+            if (next == '-')
+            {
+                if (fscanf(file, "%lu", &last) != 1)
+                    break;
+
+                next = fgetc(file);
+            }
+
+            for (unsigned long core = first; core <= last && core < CPU_SETSIZE; core++)
+                cores.push_back(core);
+
+            if (next != ',')
+                break;
+        }
+
+        fclose(file);
+
+        return cores;
+    }
+#else
+    inline std::vector<size_t> numa_node_cores(int32_t)
+    {
+        return {};
+    }
+#endif
+
+// Lets the thread run on any of the given cores,
+// returns false if that's not supported/failed
+#ifdef _WIN32
+    inline bool set_thread_affinity(std::thread& thread, const std::vector<size_t>& cores)
+    {
+        DWORD_PTR mask = 0;
+
+        for (size_t core : cores)
+            mask |= static_cast<DWORD_PTR>(1) << core;
+
+        return mask && SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+    }
+#elif defined(__linux__)
+    inline bool set_thread_affinity(std::thread& thread, const std::vector<size_t>& cores)
+    {
+        if (cores.empty())
+            return false;
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+
+        for (size_t core : cores)
+            CPU_SET(core, &cpu_set);
+
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set) == 0;
+    }
+#else
+    inline bool set_thread_affinity(std::thread&, const std::vector<size_t>&)
+    {
+        return false;
+    }
+#endif
+
+// Makes the pages of the given memory prefer the NUMA node and
+// moves the ones that were already touched elsewhere, pages only
+// partially covered by it included. Returns false if that's not
+// supported/failed.
+#if defined(__linux__) && defined(SYS_mbind)
+    inline bool bind_to_numa_node(const void* memory, size_t size, int32_t node)
+    {
+        const size_t bits = 8 * sizeof(unsigned long);
+
+        if (node < 0 || static_cast<size_t>(node) >= 16 * bits || !size)
+            return false;
+
+        uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t begin = reinterpret_cast<uintptr_t>(memory) & ~(page - 1);
+        uintptr_t end = (reinterpret_cast<uintptr_t>(memory) + size + page - 1) & ~(page - 1);
+
+        unsigned long node_mask[16] = {};
+        node_mask[node / bits] = 1ul << (node % bits);
+
+        return syscall(
+            SYS_mbind,
+            begin,
+            end - begin,
+            BLOGGER_MPOL_PREFERRED,
+            node_mask,
+            16 * bits,
+            BLOGGER_MPOL_MF_MOVE
+        ) == 0;
+    }
+#else
+    inline bool bind_to_numa_node(const void*, size_t, int32_t)
+    {
+        return false;
+    }
+#endif
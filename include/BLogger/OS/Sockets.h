@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Just enough of a socket API for the NetworkSink,
+// every socket it creates is non-blocking
+#ifdef _WIN32
+    #ifndef BLOGGER_FULL_WINDOWS
+        #define NOMINMAX
+        #define WIN32_MEAN_AND_LEAN
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+
+    #pragma comment(lib, "Ws2_32.lib")
+
+    typedef SOCKET blogger_socket;
+    #define BLOGGER_INVALID_SOCKET INVALID_SOCKET
+#else
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <netdb.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <errno.h>
+
+    typedef int blogger_socket;
+    #define BLOGGER_INVALID_SOCKET (-1)
+#endif
+
+namespace BLogger {
+
+    struct socket_address
+    {
+        sockaddr_storage storage;
+        socklen_t        size;
+    };
+
+    enum class socket_status
+    {
+        done,
+        would_block,
+        failed
+    };
+
+#ifdef _WIN32
+    inline bool init_sockets()
+    {
+        struct winsock
+        {
+            bool ok;
+
+            winsock()
+            {
+                WSADATA data;
+                ok = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+            }
+        };
+
+        static winsock instance;
+        return instance.ok;
+    }
+
+    inline void close_socket(blogger_socket socket)
+    {
+        closesocket(socket);
+    }
+
+    inline bool would_block()
+    {
+        int error = WSAGetLastError();
+        return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+    }
+
+    inline bool set_non_blocking(blogger_socket socket)
+    {
+        u_long enabled = 1;
+        return ioctlsocket(socket, FIONBIO, &enabled) == 0;
+    }
+
+    inline int poll_socket(blogger_socket socket, short events)
+    {
+        WSAPOLLFD fd = { socket, events, 0 };
+        return WSAPoll(&fd, 1, 0);
+    }
+
+    #define BLOGGER_SEND_FLAGS 0
+#else
+    inline bool init_sockets()
+    {
+        return true;
+    }
+
+    inline void close_socket(blogger_socket socket)
+    {
+        close(socket);
+    }
+
+    inline bool would_block()
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+    }
+
+    inline bool set_non_blocking(blogger_socket socket)
+    {
+        int flags = fcntl(socket, F_GETFL, 0);
+        return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    inline int poll_socket(blogger_socket socket, short events)
+    {
+        pollfd fd = { socket, events, 0 };
+        return poll(&fd, 1, 0);
+    }
+
+    // a collector going away mustn't kill the process
+    #ifdef MSG_NOSIGNAL
+        #define BLOGGER_SEND_FLAGS MSG_NOSIGNAL
+    #else
+        #define BLOGGER_SEND_FLAGS 0
+    #endif
+#endif
+
+    // Blocks while resolving, returns false if the host is unknown
+    inline bool resolve_address(const std::string& host, uint16_t port, bool stream, socket_address& out)
+    {
+        if (!init_sockets())
+            return false;
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = stream ? SOCK_STREAM : SOCK_DGRAM;
+
+        addrinfo* result = nullptr;
+        std::string service = std::to_string(port);
+
+        if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) || !result)
+            return false;
+
+        memcpy(&out.storage, result->ai_addr, result->ai_addrlen);
+        out.size = static_cast<socklen_t>(result->ai_addrlen);
+
+        freeaddrinfo(result);
+        return true;
+    }
+
+    // Starts connecting a non-blocking socket, a datagram
+    // socket is connected right away
+    inline blogger_socket open_socket(const socket_address& address, bool stream)
+    {
+        blogger_socket s = socket(
+            address.storage.ss_family,
+            stream ? SOCK_STREAM : SOCK_DGRAM,
+            0
+        );
+
+        if (s == BLOGGER_INVALID_SOCKET)
+            return s;
+
+    #ifdef SO_NOSIGPIPE
+        int enabled = 1;
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+    #endif
+
+        if (!set_non_blocking(s))
+        {
+            close_socket(s);
+            return BLOGGER_INVALID_SOCKET;
+        }
+
+        if (connect(s, reinterpret_cast<const sockaddr*>(&address.storage), address.size) != 0 && !would_block())
+        {
+            close_socket(s);
+            return BLOGGER_INVALID_SOCKET;
+        }
+
+        return s;
+    }
+
+    // Whether a connect started by open_socket has finished
+    inline socket_status check_connected(blogger_socket socket)
+    {
+        int ready = poll_socket(socket, POLLOUT);
+
+        if (ready == 0)
+            return socket_status::would_block;
+
+        if (ready < 0)
+            return socket_status::failed;
+
+        int error = 0;
+        socklen_t size = sizeof(error);
+
+        if (getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &size) != 0 || error)
+            return socket_status::failed;
+
+        return socket_status::done;
+    }
+
+    // Returns the number of bytes sent, 0 if the socket would
+    // block and a negative number if it's broken
+    inline int64_t send_some(blogger_socket socket, const char* data, size_t size)
+    {
+    #ifdef _WIN32
+        int sent = send(socket, data, static_cast<int>(size), BLOGGER_SEND_FLAGS);
+    #else
+        ssize_t sent = send(socket, data, size, BLOGGER_SEND_FLAGS);
+    #endif
+
+        if (sent >= 0)
+            return sent;
+
+        return would_block() ? 0 : -1;
+    }
+}
@@ -1,19 +1,209 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "BLogger/Loggers/LogMessage.h"
+#include "BLogger/Stats/Stats.h"
 
 namespace BLogger {
 
+    // Locks the mutex only if asked to,
+    // used by sinks that might be single writer
+    class optional_locker
+    {
+    private:
+        std::mutex* m_Mutex;
+    public:
+        optional_locker(std::mutex& mutex, bool should_lock)
+            : m_Mutex(should_lock ? &mutex : nullptr)
+        {
+            if (m_Mutex) m_Mutex->lock();
+        }
+
+        optional_locker(const optional_locker& other) = delete;
+        optional_locker& operator=(const optional_locker& other) = delete;
+
+        ~optional_locker()
+        {
+            if (m_Mutex) m_Mutex->unlock();
+        }
+    };
+
     class BaseSink
     {
+    protected:
+        bool m_SingleWriter = false;
+        std::atomic<level> m_Filter { level::trace };
+        std::shared_ptr<sink_stats> m_Stats = std::make_shared<sink_stats>();
+
+        // Set by wrappers that hand over the stats of the sink
+        // they write to, which records its own calls
+        bool m_ForwardsStats = false;
     public:
         virtual void write(BLoggerLogMessage& msg) = 0;
         virtual void flush() = 0;
 
+        // Flushes and waits for the data to reach the disk, used
+        // by Flush(timeout). Only the sinks that write files
+        // do more than flush.
+        virtual void sync()
+        {
+            flush();
+        }
+
+        // Called by the async backend with all of the consecutive
+        // messages it dequeued for this sink at once. Override
+        // to lock once/issue a single write per batch.
+        virtual void write_batch(BLoggerLogMessage* const* messages, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+                write(*messages[i]);
+        }
+
+        // Raw messages haven't been through finalize_format,
+        // see BLoggerLogMessage::is_deferred. Every sink of
+        // a logger that wants them is written to before the
+        // message is formatted for the rest.
+        virtual bool wants_raw_messages()
+        {
+            return false;
+        }
+
         // Is there a better way to forward the tag
         // to the file sink?
-        virtual void set_tag(BLoggerInString tag) {}
+        virtual void set_tag(BLoggerInString) {}
+
+        // Set by the async backend when only one
+        // thread is ever going to write to this sink,
+        // in which case the sink can skip its locking.
+        virtual void set_single_writer(bool single_writer)
+        {
+            m_SingleWriter = single_writer;
+        }
+
+        // Messages below the level are skipped by the loggers
+        // before any formatting is done for this sink
+        void set_filter(level lvl)
+        {
+            m_Filter.store(lvl, std::memory_order_relaxed);
+        }
+
+        level filter()
+        {
+            return m_Filter.load(std::memory_order_relaxed);
+        }
+
+        bool accepts(level lvl)
+        {
+            return lvl >= filter();
+        }
+
+        // The latency of the calls below and the messages they
+        // passed, kept alive by the pointer (e.g. for an exporter)
+        const std::shared_ptr<sink_stats>& stats()
+        {
+            return m_Stats;
+        }
+
+        // What the loggers call instead of write/write_batch/flush/sync,
+        // so that every call is recorded into stats. Define
+        // BLOGGER_NO_STATS to skip the timing.
+        void timed_write(BLoggerLogMessage& msg)
+        {
+            if (m_ForwardsStats)
+            {
+                write(msg);
+                return;
+            }
+#ifndef BLOGGER_NO_STATS
+            latency_timer timer(m_Stats->write_latency);
+#endif
+            write(msg);
+            m_Stats->messages.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void timed_write_batch(BLoggerLogMessage* const* messages, size_t count)
+        {
+            if (m_ForwardsStats)
+            {
+                write_batch(messages, count);
+                return;
+            }
+#ifndef BLOGGER_NO_STATS
+            latency_timer timer(m_Stats->write_latency);
+#endif
+            write_batch(messages, count);
+            m_Stats->messages.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        void timed_flush()
+        {
+            if (m_ForwardsStats)
+            {
+                flush();
+                return;
+            }
+#ifndef BLOGGER_NO_STATS
+            latency_timer timer(m_Stats->flush_latency);
+#endif
+            flush();
+        }
+
+        void timed_sync()
+        {
+            if (m_ForwardsStats)
+            {
+                sync();
+                return;
+            }
+#ifndef BLOGGER_NO_STATS
+            latency_timer timer(m_Stats->flush_latency);
+#endif
+            sync();
+        }
+
+        // Hands the sink only the messages that pass its filter,
+        // filtered is just scratch space
+        void write_filtered(
+            std::vector<BLoggerLogMessage*>& messages,
+            std::vector<BLoggerLogMessage*>& filtered
+        )
+        {
+            level lvl = filter();
+
+            if (lvl == level::trace)
+            {
+                timed_write_batch(messages.data(), messages.size());
+                return;
+            }
+
+            filtered.clear();
+
+            for (auto message : messages)
+            {
+                if (message->log_level() >= lvl)
+                    filtered.push_back(message);
+            }
+
+            if (!filtered.empty())
+                timed_write_batch(filtered.data(), filtered.size());
+        }
 
         virtual ~BaseSink() {}
+    protected:
+        // For the sinks that know how many bytes they wrote out,
+        // which call enable_byte_count from their constructor
+        void count_bytes(size_t size)
+        {
+            m_Stats->bytes_written.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        void enable_byte_count()
+        {
+            m_Stats->counts_bytes = true;
+        }
     };
 }
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <stdio.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "BLogger/Sinks/BaseSink.h"
+#include "BLogger/Formatter/BinaryFormat.h"
+#include "BLogger/OS/Functions.h"
+
+namespace BLogger {
+
+    // Writes compact binary records instead of text, see
+    // BinaryFormat.h. Deferred messages are stored as a format
+    // id and their packed arguments without ever being formatted,
+    // the rest is stored as the message text (without the pattern).
+    // The blogger-decode tool turns the files back into text.
+    class BinaryFileSink : public BaseSink
+    {
+    private:
+        FILE*         m_File;
+        BLoggerString m_DirectoryPath;
+        BLoggerString m_CachedTag;
+        size_t        m_BytesPerFile;
+        size_t        m_CurrentBytes;
+        size_t        m_MaxLogFiles;
+        size_t        m_CurrentLogFiles;
+        bool          m_RotateLogs;
+        std::mutex    m_FileAccess;
+        bl_string     m_Pending;
+
+        // Knows the formats of the current file
+        binary_log_encoder m_Encoder;
+
+        typedef std::lock_guard<std::mutex>
+            locker;
+    public:
+        BinaryFileSink(
+            BLoggerInString directoryPath,
+            BLoggerInString loggerTag,
+            size_t bytesPerFile,
+            size_t maxLogFiles,
+            bool rotateLogs = true
+        ) : m_File(nullptr),
+            m_DirectoryPath(directoryPath),
+            m_CachedTag(loggerTag),
+            m_BytesPerFile(bytesPerFile),
+            m_CurrentBytes(0),
+            m_MaxLogFiles(maxLogFiles),
+            m_CurrentLogFiles(1),
+            m_RotateLogs(rotateLogs),
+            m_FileAccess(),
+            m_Pending(),
+            m_Encoder()
+        {
+            m_DirectoryPath += '/';
+
+            enable_byte_count();
+            open_file();
+        }
+
+        bool wants_raw_messages() override
+        {
+            return true;
+        }
+
+        void set_tag(BLoggerInString tag) override
+        {
+            locker lock(m_FileAccess);
+
+            m_CachedTag = tag;
+
+            if (!ok())
+                return;
+
+            m_Pending.clear();
+            m_Encoder.put_tag(m_Pending, m_CachedTag);
+            write_pending();
+        }
+
+        void terminate()
+        {
+            locker lock(m_FileAccess);
+
+            if (m_File)
+            {
+                fclose(m_File);
+                m_File = nullptr;
+            }
+        }
+
+        bool ok()
+        {
+            return static_cast<bool>(m_File);
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            BLoggerLogMessage* messages[] = { &msg };
+            write_batch(messages, 1);
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            m_Pending.clear();
+
+            for (size_t i = 0; i < count && ok(); i++)
+            {
+                auto point = m_Encoder.save(m_Pending);
+
+                m_Encoder.put_message(m_Pending, *messages[i]);
+
+                size_t size = m_Pending.size() - point.size;
+
+                if (!m_BytesPerFile || m_CurrentBytes + m_Pending.size() <= m_BytesPerFile)
+                    continue;
+
+                // The record might define formats, so it's
+                // encoded again for the next file
+                m_Encoder.restore(m_Pending, point);
+
+                if (size > m_BytesPerFile)
+                    continue;
+
+                write_pending();
+
+                if (!rotate())
+                    return;
+
+                m_Encoder.put_message(m_Pending, *messages[i]);
+            }
+
+            write_pending();
+        }
+
+        void flush() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            if (m_File)
+                fflush(m_File);
+        }
+
+        void sync() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            if (m_File)
+                sync_file(m_File);
+        }
+
+        operator bool()
+        {
+            return ok();
+        }
+
+        ~BinaryFileSink()
+        {
+            if (m_File)
+                fclose(m_File);
+        }
+    private:
+        void write_pending()
+        {
+            if (m_File && !m_Pending.empty())
+            {
+                count_bytes(fwrite(m_Pending.data(), 1, m_Pending.size(), m_File));
+                m_CurrentBytes += m_Pending.size();
+            }
+
+            m_Pending.clear();
+        }
+
+        // Returns false if nothing can be written anymore
+        bool rotate()
+        {
+            if (m_CurrentLogFiles == m_MaxLogFiles)
+            {
+                if (!m_RotateLogs)
+                    return false;
+
+                m_CurrentLogFiles = 1;
+            }
+            else
+                ++m_CurrentLogFiles;
+
+            fclose(m_File);
+            m_File = nullptr;
+
+            open_file();
+
+            return ok();
+        }
+
+        // Every file starts with the magic, the tag
+        // and an empty format dictionary
+        void open_file()
+        {
+            BLoggerString path;
+            path += m_DirectoryPath;
+            path += m_CachedTag;
+            path += '-';
+            path += std::to_string(m_CurrentLogFiles);
+            path += ".blog";
+
+            OPEN_BINARY_FILE(m_File, path);
+
+            m_CurrentBytes = 0;
+            m_Encoder.reset();
+
+            if (!m_File)
+                return;
+
+            m_Pending.clear();
+            m_Encoder.put_header(m_Pending, m_CachedTag);
+            write_pending();
+        }
+    };
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <mutex>
+#include <cerrno>
+
+#include "BLogger/LogLevels.h"
+#include "BLogger/Sinks/BaseSink.h"
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+// A batch is written out early once this many bytes are buffered
+#define BLOGGER_STDOUT_BUFFER_SIZE (64u * 1024u)
+
+namespace BLogger {
+
+    // A console sink that collects every batch into its own buffer,
+    // colors included as ANSI escapes, and writes it to the stdout
+    // file descriptor with a single call, bypassing std::cout.
+    // Sinks of different loggers don't share a lock, so their
+    // writes are only atomic as far as the OS makes them: on a
+    // pipe that's up to PIPE_BUF (4 KB on Linux) bytes, a larger
+    // batch can be interleaved with the output of another sink.
+    //
+    // Anything still sitting in std::cout's buffer can end up
+    // after the messages, flush it first if the order matters.
+    class BufferedStdoutSink : public BaseSink
+    {
+    private:
+        bool       m_Colored;
+        std::mutex m_Access;
+        bl_string  m_Buffer;
+    public:
+        explicit BufferedStdoutSink(bool colored = false)
+            : m_Colored(colored),
+            m_Access(),
+            m_Buffer()
+        {
+            m_Buffer.reserve(BLOGGER_STDOUT_BUFFER_SIZE);
+
+        #ifdef _WIN32
+            if (m_Colored)
+                m_Colored = enable_escapes();
+        #endif
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            optional_locker lock(m_Access, !m_SingleWriter);
+
+            append(msg);
+            emit();
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            optional_locker lock(m_Access, !m_SingleWriter);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                append(*messages[i]);
+
+                if (m_Buffer.size() >= BLOGGER_STDOUT_BUFFER_SIZE)
+                    emit();
+            }
+
+            emit();
+        }
+
+        // Nothing is kept in between of writes
+        void flush() override
+        {
+        }
+    private:
+        void append(BLoggerLogMessage& msg)
+        {
+            if (m_Colored)
+                append(color_of(msg.log_level()));
+
+            m_Buffer.insert(m_Buffer.end(), msg.data(), msg.data() + msg.size());
+
+            if (m_Colored)
+                append(BLOGGER_ANSI_RESET);
+        }
+
+        void append(const char* escape)
+        {
+            while (*escape)
+                m_Buffer.push_back(*escape++);
+        }
+
+        void emit()
+        {
+            const bl_char* data = m_Buffer.data();
+            size_t left = m_Buffer.size();
+
+            while (left)
+            {
+            #ifdef _WIN32
+                int written = _write(1, data, static_cast<unsigned>(left));
+            #else
+                ssize_t written = ::write(1, data, left);
+            #endif
+
+                if (written < 0 && errno == EINTR)
+                    continue;
+
+                // stdout is closed or broken, drop the output
+                if (written <= 0)
+                    break;
+
+                data += written;
+                left -= static_cast<size_t>(written);
+            }
+
+            m_Buffer.clear();
+        }
+
+        static const char* color_of(level lvl)
+        {
+            switch (lvl)
+            {
+            case level::trace: return BLOGGER_ANSI_TRACE_COLOR;
+            case level::debug: return BLOGGER_ANSI_DEBUG_COLOR;
+            case level::info:  return BLOGGER_ANSI_INFO_COLOR;
+            case level::warn:  return BLOGGER_ANSI_WARN_COLOR;
+            case level::error: return BLOGGER_ANSI_ERROR_COLOR;
+            case level::crit:  return BLOGGER_ANSI_CRIT_COLOR;
+            default:           return "";
+            }
+        }
+
+    #ifdef _WIN32
+        // Escapes only work once the console is told to process them
+        static bool enable_escapes()
+        {
+            HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+            DWORD mode = 0;
+
+            if (!GetConsoleMode(console, &mode))
+                return false;
+
+            return SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING) != 0;
+        }
+    #endif
+    };
+}
@@ -17,6 +17,25 @@ namespace BLogger {
         {
             locker lock(s_GlobalWrite);
 
+            write_colored(msg);
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            locker lock(s_GlobalWrite);
+
+            for (size_t i = 0; i < count; i++)
+                write_colored(*messages[i]);
+        }
+
+        void flush() override
+        {
+            locker lock(s_GlobalWrite);
+            std::cout.flush();
+        }
+    private:
+        void write_colored(BLoggerLogMessage& msg)
+        {
             switch (msg.log_level())
             {
                 case level::trace: set_output_color(BLOGGER_TRACE_COLOR); break;
@@ -34,11 +53,5 @@ namespace BLogger {
 
             set_output_color(BLOGGER_RESET);
         }
-
-        void flush() override
-        {
-            locker lock(s_GlobalWrite);
-            std::cout.flush();
-        }
     };
 }
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <stdio.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <mutex>
+
+#include "BLogger/Sinks/BaseSink.h"
+#include "BLogger/Formatter/Timestamp.h"
+#include "BLogger/OS/Functions.h"
+
+// Define to enable the codecs, requires linking against libzstd/liblz4
+#ifdef BLOGGER_USE_ZSTD
+    #include <zstd.h>
+#endif
+
+#ifdef BLOGGER_USE_LZ4
+    #include <lz4frame.h>
+#endif
+
+// Messages are compressed once this many bytes are collected,
+// or when the sink is flushed
+#define BLOGGER_COMPRESSED_FRAME_SIZE (256u * 1024u)
+
+namespace BLogger {
+
+    enum class compression_codec
+    {
+        none,
+        zstd,
+        lz4
+    };
+
+    // One per frame in the <log file>.idx next to every log file
+    struct frame_index_entry
+    {
+        uint64_t offset;          // of the frame in the log file
+        uint32_t compressed_size;
+        uint32_t size;            // uncompressed
+        int64_t  first_timestamp; // wall clock ns of the first message
+        int64_t  last_timestamp;  // and of the last one
+    };
+
+    // A file sink that writes its messages as a series of
+    // independent zstd/lz4 frames, which the regular command
+    // line tools decompress as a single stream. Every frame is
+    // appended to an index file as soon as it's written, so the
+    // log can be followed while it's being written and a reader
+    // can seek straight to the frame that covers a point in time.
+    //
+    // Size based rotation counts compressed bytes and only
+    // happens in between of frames.
+    class CompressedFileSink : public BaseSink
+    {
+    private:
+        FILE*             m_File;
+        FILE*             m_Index;
+        BLoggerString     m_DirectoryPath;
+        BLoggerString     m_CachedTag;
+        size_t            m_BytesPerFile;
+        size_t            m_CurrentBytes;
+        size_t            m_MaxLogFiles;
+        size_t            m_CurrentLogFiles;
+        bool              m_RotateLogs;
+        bool              m_Full;
+        compression_codec m_Codec;
+        int               m_Level;
+        std::mutex        m_FileAccess;
+        bl_string         m_Input;
+        bl_string         m_Output;
+        int64_t           m_FirstTimestamp;
+        int64_t           m_LastTimestamp;
+
+    #ifdef BLOGGER_USE_ZSTD
+        ZSTD_CCtx*        m_ZstdContext;
+    #endif
+
+        typedef std::lock_guard<std::mutex>
+            locker;
+    public:
+        // A level of 0 picks the default of the codec
+        CompressedFileSink(
+            BLoggerInString directoryPath,
+            BLoggerInString loggerTag,
+            size_t bytesPerFile,
+            size_t maxLogFiles,
+            bool rotateLogs = true,
+            compression_codec codec = default_codec(),
+            int level = 0
+        ) : m_File(nullptr),
+            m_Index(nullptr),
+            m_DirectoryPath(directoryPath),
+            m_CachedTag(loggerTag),
+            m_BytesPerFile(bytesPerFile),
+            m_CurrentBytes(0),
+            m_MaxLogFiles(maxLogFiles),
+            m_CurrentLogFiles(1),
+            m_RotateLogs(rotateLogs),
+            m_Full(false),
+            m_Codec(codec),
+            m_Level(level),
+            m_FileAccess(),
+            m_Input(),
+            m_Output(),
+            m_FirstTimestamp(0),
+            m_LastTimestamp(0)
+        #ifdef BLOGGER_USE_ZSTD
+            , m_ZstdContext(nullptr)
+        #endif
+        {
+            m_DirectoryPath += '/';
+
+            if (!is_supported(codec))
+                return;
+
+        #ifdef BLOGGER_USE_ZSTD
+            if (codec == compression_codec::zstd)
+                m_ZstdContext = ZSTD_createCCtx();
+        #endif
+
+            m_Input.reserve(BLOGGER_COMPRESSED_FRAME_SIZE * 2);
+
+            enable_byte_count();
+            open_files();
+        }
+
+        // Whether the codec was compiled in
+        static bool is_supported(compression_codec codec)
+        {
+            switch (codec)
+            {
+        #ifdef BLOGGER_USE_ZSTD
+            case compression_codec::zstd: return true;
+        #endif
+        #ifdef BLOGGER_USE_LZ4
+            case compression_codec::lz4: return true;
+        #endif
+            default: return false;
+            }
+        }
+
+        static compression_codec default_codec()
+        {
+        #if defined(BLOGGER_USE_ZSTD)
+            return compression_codec::zstd;
+        #elif defined(BLOGGER_USE_LZ4)
+            return compression_codec::lz4;
+        #else
+            return compression_codec::none;
+        #endif
+        }
+
+        void set_tag(BLoggerInString tag) override
+        {
+            locker lock(m_FileAccess);
+            m_CachedTag = tag;
+        }
+
+        void terminate()
+        {
+            locker lock(m_FileAccess);
+
+            end_frame();
+            close_files();
+        }
+
+        bool ok()
+        {
+            return m_File && m_Index;
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+            stage(msg);
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            for (size_t i = 0; i < count; i++)
+                stage(*messages[i]);
+        }
+
+        // Ends the current frame early
+        void flush() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+            end_frame();
+        }
+
+        void sync() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+            end_frame();
+
+            if (!ok())
+                return;
+
+            sync_file(m_File);
+            sync_file(m_Index);
+        }
+
+        operator bool()
+        {
+            return ok();
+        }
+
+        ~CompressedFileSink()
+        {
+            terminate();
+
+        #ifdef BLOGGER_USE_ZSTD
+            ZSTD_freeCCtx(m_ZstdContext);
+        #endif
+        }
+    private:
+        void stage(BLoggerLogMessage& msg)
+        {
+            if (!ok() || m_Full)
+                return;
+
+            int64_t timestamp = to_wall_clock_ns(msg.log_timestamp());
+
+            if (m_Input.empty())
+                m_FirstTimestamp = timestamp;
+
+            m_LastTimestamp = timestamp;
+
+            m_Input.insert(m_Input.end(), msg.data(), msg.data() + msg.size());
+
+            if (m_Input.size() >= BLOGGER_COMPRESSED_FRAME_SIZE)
+                end_frame();
+        }
+
+        void end_frame()
+        {
+            if (!ok() || m_Input.empty())
+                return;
+
+            size_t size = compress();
+
+            if (size)
+            {
+                frame_index_entry entry;
+                entry.offset = m_CurrentBytes;
+                entry.compressed_size = static_cast<uint32_t>(size);
+                entry.size = static_cast<uint32_t>(m_Input.size());
+                entry.first_timestamp = m_FirstTimestamp;
+                entry.last_timestamp = m_LastTimestamp;
+
+                count_bytes(fwrite(m_Output.data(), 1, size, m_File));
+                fflush(m_File);
+
+                fwrite(&entry, sizeof(entry), 1, m_Index);
+                fflush(m_Index);
+
+                m_CurrentBytes += size;
+            }
+
+            m_Input.clear();
+
+            if (m_BytesPerFile && m_CurrentBytes >= m_BytesPerFile)
+                rotate();
+        }
+
+        // Returns the size of the frame in m_Output, 0 on failure
+        size_t compress()
+        {
+            switch (m_Codec)
+            {
+        #ifdef BLOGGER_USE_ZSTD
+            case compression_codec::zstd:
+            {
+                m_Output.resize(ZSTD_compressBound(m_Input.size()));
+
+                size_t size = ZSTD_compressCCtx(
+                    m_ZstdContext,
+                    m_Output.data(), m_Output.size(),
+                    m_Input.data(), m_Input.size(),
+                    m_Level ? m_Level : ZSTD_CLEVEL_DEFAULT
+                );
+
+                return ZSTD_isError(size) ? 0 : size;
+            }
+        #endif
+        #ifdef BLOGGER_USE_LZ4
+            case compression_codec::lz4:
+            {
+                LZ4F_preferences_t preferences;
+                memset(&preferences, 0, sizeof(preferences));
+
+                preferences.frameInfo.contentSize = m_Input.size();
+                preferences.compressionLevel = m_Level;
+
+                m_Output.resize(LZ4F_compressFrameBound(m_Input.size(), &preferences));
+
+                size_t size = LZ4F_compressFrame(
+                    m_Output.data(), m_Output.size(),
+                    m_Input.data(), m_Input.size(),
+                    &preferences
+                );
+
+                return LZ4F_isError(size) ? 0 : size;
+            }
+        #endif
+            default:
+                return 0;
+            }
+        }
+
+        void rotate()
+        {
+            close_files();
+
+            if (m_CurrentLogFiles == m_MaxLogFiles)
+            {
+                if (!m_RotateLogs)
+                {
+                    m_Full = true;
+                    return;
+                }
+
+                m_CurrentLogFiles = 1;
+            }
+            else
+                ++m_CurrentLogFiles;
+
+            open_files();
+        }
+
+        void open_files()
+        {
+            BLoggerString path;
+            path += m_DirectoryPath;
+            path += m_CachedTag;
+            path += '-';
+            path += std::to_string(m_CurrentLogFiles);
+            path += m_Codec == compression_codec::lz4 ? ".log.lz4" : ".log.zst";
+
+            BLoggerString indexPath = path + ".idx";
+
+            OPEN_BINARY_FILE(m_File, path);
+            OPEN_BINARY_FILE(m_Index, indexPath);
+
+            m_CurrentBytes = 0;
+
+            if (!ok())
+                close_files();
+        }
+
+        void close_files()
+        {
+            if (m_File)
+                fclose(m_File);
+
+            if (m_Index)
+                fclose(m_Index);
+
+            m_File = nullptr;
+            m_Index = nullptr;
+        }
+    };
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BLogger/Sinks/BaseSink.h"
+#include "BLogger/Loggers/RingBuffer.h"
+#include "BLogger/OS/EventCount.h"
+
+#define BLOGGER_DEDICATED_QUEUE_SIZE 8192
+#define BLOGGER_DEDICATED_BATCH_SIZE 64
+
+namespace BLogger {
+
+    // Gives a sink a queue and a thread of its own, so a slow sink
+    // (console, network...) only fills up its own queue instead of
+    // holding up the backend worker and every other sink on it.
+    //
+    // The messages are copied into the queue, once it's full new
+    // ones are dropped (see dropped) unless blockWhenFull is set.
+    // The filter of the wrapper is the one the loggers check,
+    // it starts out as the filter of the wrapped sink. The stats
+    // are the ones of the wrapped sink, timed on the thread of the
+    // wrapper, so they measure the writes and not the queueing.
+    class DedicatedSink : public BaseSink
+    {
+    private:
+        // A sync is a flush with the ticket its caller waits for
+        struct entry
+        {
+            bool              flush;
+            uint64_t          sync;
+            BLoggerLogMessage message;
+
+            entry()
+                : flush(false),
+                sync(0),
+                message()
+            {
+            }
+
+            entry(entry&& other) = default;
+            entry& operator=(entry&& other) = default;
+        };
+    private:
+        std::unique_ptr<BaseSink> m_Sink;
+        bool                      m_Raw;
+        bool                      m_BlockWhenFull;
+        ring_buffer<entry>        m_Queue;
+        event_count               m_Posted;
+        event_count               m_SpaceFreed;
+        event_count               m_Synced;
+        std::atomic<uint64_t>     m_SyncTickets;
+        std::atomic<uint64_t>     m_SyncedTicket;
+        std::atomic<bool>         m_Running;
+        std::atomic<size_t>       m_Dropped;
+        std::thread               m_Thread;
+    public:
+        explicit DedicatedSink(
+            BaseSink* sink,
+            size_t capacity = BLOGGER_DEDICATED_QUEUE_SIZE,
+            bool blockWhenFull = false
+        ) : m_Sink(sink),
+            m_Raw(sink->wants_raw_messages()),
+            m_BlockWhenFull(blockWhenFull),
+            m_Queue(capacity),
+            m_Posted(),
+            m_SpaceFreed(),
+            m_Synced(),
+            m_SyncTickets(0),
+            m_SyncedTicket(0),
+            m_Running(true),
+            m_Dropped(0),
+            m_Thread()
+        {
+            set_filter(sink->filter());
+
+            m_Stats = sink->stats();
+            m_ForwardsStats = true;
+
+            m_Thread = std::thread(&DedicatedSink::worker, this);
+        }
+
+        DedicatedSink(const DedicatedSink& other) = delete;
+        DedicatedSink& operator=(const DedicatedSink& other) = delete;
+
+        BaseSink& sink()
+        {
+            return *m_Sink;
+        }
+
+        size_t dropped()
+        {
+            return m_Dropped.load(std::memory_order_relaxed);
+        }
+
+        bool wants_raw_messages() override
+        {
+            return m_Raw;
+        }
+
+        void set_tag(BLoggerInString tag) override
+        {
+            m_Sink->set_tag(tag);
+        }
+
+        // Only the thread of the wrapper ever writes to the sink,
+        // the queue itself takes any number of producers
+        void set_single_writer(bool) override
+        {
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            push(msg, m_BlockWhenFull);
+            m_Posted.notify_one();
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            for (size_t i = 0; i < count; i++)
+                push(*messages[i], m_BlockWhenFull);
+
+            m_Posted.notify_one();
+        }
+
+        // Flushes the sink once everything queued
+        // before is written, doesn't wait for it
+        void flush() override
+        {
+            entry e;
+            e.flush = true;
+
+            push(e, true);
+            m_Posted.notify_one();
+        }
+
+        // Syncs the sink once everything queued before is
+        // written and waits for it. A sync queued later also
+        // covers everything before this one, so it's enough
+        // for the last synced ticket to reach ours.
+        void sync() override
+        {
+            entry e;
+            e.flush = true;
+            e.sync = m_SyncTickets.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+            uint64_t ticket = e.sync;
+
+            push(e, true);
+            m_Posted.notify_one();
+
+            while (m_SyncedTicket.load(std::memory_order_acquire) < ticket)
+            {
+                uint32_t key = m_Synced.prepare_wait();
+
+                if (m_SyncedTicket.load(std::memory_order_acquire) >= ticket)
+                {
+                    m_Synced.cancel_wait();
+                    break;
+                }
+
+                m_Synced.wait(key);
+            }
+        }
+
+        // Writes whatever is still queued first
+        ~DedicatedSink()
+        {
+            m_Running.store(false, std::memory_order_release);
+            m_Posted.notify_all();
+
+            m_Thread.join();
+        }
+    private:
+        void push(BLoggerLogMessage& msg, bool block)
+        {
+            entry e;
+            e.message = msg;
+
+            push(e, block);
+        }
+
+        void push(entry& e, bool block)
+        {
+            if (m_Queue.try_push(std::move(e)))
+                return;
+
+            if (!block)
+            {
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            for (;;)
+            {
+                uint32_t key = m_SpaceFreed.prepare_wait();
+
+                if (m_Queue.try_push(std::move(e)))
+                {
+                    m_SpaceFreed.cancel_wait();
+                    return;
+                }
+
+                m_SpaceFreed.wait(key);
+            }
+        }
+
+        void worker()
+        {
+            std::vector<entry> batch(BLOGGER_DEDICATED_BATCH_SIZE);
+            std::vector<BLoggerLogMessage*> messages;
+            messages.reserve(BLOGGER_DEDICATED_BATCH_SIZE);
+
+            for (;;)
+            {
+                size_t count = m_Queue.try_pop_bulk(batch.data(), batch.size());
+
+                if (!count)
+                {
+                    if (!m_Running.load(std::memory_order_acquire))
+                        return;
+
+                    uint32_t key = m_Posted.prepare_wait();
+
+                    if (!m_Queue.empty_approx() || !m_Running.load(std::memory_order_acquire))
+                        m_Posted.cancel_wait();
+                    else
+                        m_Posted.wait(key);
+
+                    continue;
+                }
+
+                m_SpaceFreed.notify_all();
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (!batch[i].flush)
+                    {
+                        messages.push_back(&batch[i].message);
+                        continue;
+                    }
+
+                    write_messages(messages);
+
+                    if (!batch[i].sync)
+                    {
+                        m_Sink->timed_flush();
+                        continue;
+                    }
+
+                    m_Sink->timed_sync();
+
+                    atomic_raise(m_SyncedTicket, batch[i].sync);
+                    m_Synced.notify_all();
+                }
+
+                write_messages(messages);
+            }
+        }
+
+        void write_messages(std::vector<BLoggerLogMessage*>& messages)
+        {
+            if (!messages.empty())
+                m_Sink->timed_write_batch(messages.data(), messages.size());
+
+            messages.clear();
+        }
+    };
+}
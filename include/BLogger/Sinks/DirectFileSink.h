@@ -0,0 +1,488 @@
+#pragma once
+
+#include <chrono>
+
+#include "BLogger/Sinks/FileSink.h"
+
+namespace BLogger {
+
+    // When the data written by a DirectFileSink is synced to disk
+    enum class sync_policy
+    {
+        never,     // only when the file is closed
+        per_batch, // after every write/write_batch call
+        interval   // at most once per sync interval
+    };
+}
+
+#ifndef __linux__
+namespace BLogger {
+
+    // Not implemented for other platforms yet
+    class DirectFileSink : public FileSink
+    {
+    public:
+        DirectFileSink(
+            BLoggerInString directoryPath,
+            BLoggerInString loggerTag,
+            size_t bytesPerFile,
+            size_t maxLogFiles,
+            bool rotateLogs = true,
+            sync_policy = sync_policy::never,
+            std::chrono::milliseconds = std::chrono::milliseconds(1000)
+        ) : FileSink(directoryPath, loggerTag, bytesPerFile, maxLogFiles, rotateLogs)
+        {
+        }
+    };
+}
+#else
+
+#include <mutex>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "BLogger/OS/DirectIO.h"
+
+#define BLOGGER_DIRECT_PAGE_SIZE (64u * 1024u)
+#define BLOGGER_DIRECT_PAGES 4
+#define BLOGGER_DIRECT_ALIGNMENT 4096u
+
+namespace BLogger {
+
+    // A file sink that bypasses the page cache. Messages are
+    // collected into aligned BLOGGER_DIRECT_PAGE_SIZE pages that
+    // are written with O_DIRECT through io_uring (or a writer
+    // thread if that's not available), with up to
+    // BLOGGER_DIRECT_PAGES - 1 pages in flight while the next
+    // one is being filled, so the caller never waits for the disk
+    // unless all of them are.
+    //
+    // A partially filled page is written (zero padded to the
+    // alignment) on flush and by the sync policy. The padding is
+    // trimmed on flush and when the file is closed, rotating the
+    // log waits for the writes of the previous file to complete.
+    // Falls back to regular writes if the filesystem doesn't
+    // support O_DIRECT, e.g. tmpfs.
+    class DirectFileSink : public BaseSink
+    {
+    private:
+        struct page
+        {
+            bl_char* data;
+            size_t   used;
+            iovec    vec;
+            bool     in_flight;
+        };
+
+        static constexpr uint64_t sync_tag = ~static_cast<uint64_t>(0);
+    private:
+        BLoggerString             m_DirectoryPath;
+        BLoggerString             m_CachedTag;
+        size_t                    m_BytesPerFile;
+        size_t                    m_CurrentBytes;
+        size_t                    m_MaxLogFiles;
+        size_t                    m_CurrentLogFiles;
+        bool                      m_RotateLogs;
+        sync_policy               m_SyncPolicy;
+        std::chrono::milliseconds m_SyncInterval;
+        std::chrono::steady_clock::time_point
+                                  m_LastSync;
+        std::mutex                m_FileAccess;
+        std::unique_ptr<io_queue> m_Queue;
+        int                       m_File;
+        bool                      m_Failed;
+        page                      m_Pages[BLOGGER_DIRECT_PAGES];
+        size_t                    m_CurrentPage;
+        size_t                    m_InFlight;
+
+        // where the current page starts inside of the file
+        uint64_t                  m_FileOffset;
+
+        // set after a partially filled page was submitted,
+        // rewriting the same range has to wait for it
+        bool                      m_Ordered;
+
+        typedef std::lock_guard<std::mutex>
+            locker;
+    public:
+        DirectFileSink(
+            BLoggerInString directoryPath,
+            BLoggerInString loggerTag,
+            size_t bytesPerFile,
+            size_t maxLogFiles,
+            bool rotateLogs = true,
+            sync_policy syncPolicy = sync_policy::never,
+            std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000)
+        ) : m_DirectoryPath(directoryPath),
+            m_CachedTag(loggerTag),
+            m_BytesPerFile(bytesPerFile),
+            m_CurrentBytes(0),
+            m_MaxLogFiles(maxLogFiles),
+            m_CurrentLogFiles(1),
+            m_RotateLogs(rotateLogs),
+            m_SyncPolicy(syncPolicy),
+            m_SyncInterval(syncInterval),
+            m_LastSync(std::chrono::steady_clock::now()),
+            m_FileAccess(),
+            m_Queue(make_io_queue(BLOGGER_DIRECT_PAGES * 2)),
+            m_File(-1),
+            m_Failed(false),
+            m_Pages(),
+            m_CurrentPage(0),
+            m_InFlight(0),
+            m_FileOffset(0),
+            m_Ordered(false)
+        {
+            m_DirectoryPath += '/';
+
+            enable_byte_count();
+
+            for (auto& p : m_Pages)
+            {
+                void* data = nullptr;
+
+                if (posix_memalign(&data, BLOGGER_DIRECT_ALIGNMENT, BLOGGER_DIRECT_PAGE_SIZE))
+                    throw std::bad_alloc();
+
+                p.data = static_cast<bl_char*>(data);
+                p.used = 0;
+                p.in_flight = false;
+            }
+
+            open_file();
+        }
+
+        void set_tag(BLoggerInString tag) override
+        {
+            locker lock(m_FileAccess);
+            m_CachedTag = tag;
+        }
+
+        void terminate()
+        {
+            locker lock(m_FileAccess);
+            close_file();
+        }
+
+        bool ok()
+        {
+            return m_File >= 0 && !m_Failed;
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            append(msg.data(), msg.size());
+            after_batch();
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            for (size_t i = 0; i < count; i++)
+                append(messages[i]->data(), messages[i]->size());
+
+            after_batch();
+        }
+
+        // Waits for everything written so far to reach the file
+        void flush() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            if (!ok())
+                return;
+
+            submit_partial();
+            wait_all();
+            trim();
+        }
+
+        // O_DIRECT skips the page cache, the
+        // device cache still needs a sync
+        void sync() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            if (!ok())
+                return;
+
+            submit_partial();
+            wait_all();
+            trim();
+
+            fdatasync(m_File);
+        }
+
+        operator bool()
+        {
+            return ok();
+        }
+
+        ~DirectFileSink()
+        {
+            terminate();
+
+            for (auto& p : m_Pages)
+                free(p.data);
+        }
+    private:
+        void append(const bl_char* data, size_t size)
+        {
+            if (!ok())
+                return;
+
+            if (m_BytesPerFile)
+            {
+                if (size > m_BytesPerFile)
+                    return;
+
+                if (m_CurrentBytes + size > m_BytesPerFile && !rotate())
+                    return;
+            }
+
+            m_CurrentBytes += size;
+            count_bytes(size);
+
+            while (size)
+            {
+                page& current = m_Pages[m_CurrentPage];
+                size_t space = BLOGGER_DIRECT_PAGE_SIZE - current.used;
+                size_t count = size < space ? size : space;
+
+                memcpy(current.data + current.used, data, count);
+                current.used += count;
+                data += count;
+                size -= count;
+
+                if (current.used == BLOGGER_DIRECT_PAGE_SIZE)
+                    submit_full();
+            }
+        }
+
+        void after_batch()
+        {
+            if (!ok() || m_SyncPolicy == sync_policy::never)
+                return;
+
+            if (m_SyncPolicy == sync_policy::interval)
+            {
+                auto now = std::chrono::steady_clock::now();
+
+                if (now - m_LastSync < m_SyncInterval)
+                    return;
+
+                m_LastSync = now;
+            }
+
+            submit_partial();
+            submit_sync();
+        }
+
+        void submit_full()
+        {
+            page& current = m_Pages[m_CurrentPage];
+
+            submit_page(current, BLOGGER_DIRECT_PAGE_SIZE, m_Ordered);
+            m_Ordered = false;
+
+            m_FileOffset += BLOGGER_DIRECT_PAGE_SIZE;
+            m_CurrentPage = acquire_page();
+            m_Pages[m_CurrentPage].used = 0;
+        }
+
+        // Writes a copy of the current page so it can keep being filled
+        void submit_partial()
+        {
+            page& current = m_Pages[m_CurrentPage];
+
+            if (!current.used)
+                return;
+
+            page& copy = m_Pages[acquire_page()];
+
+            size_t size = aligned(current.used);
+
+            memcpy(copy.data, current.data, current.used);
+            memset(copy.data + current.used, 0, size - current.used);
+            copy.used = current.used;
+
+            submit_page(copy, size, m_Ordered);
+            m_Ordered = true;
+        }
+
+        void submit_page(page& p, size_t size, bool ordered)
+        {
+            reserve_slot();
+
+            p.vec.iov_base = p.data;
+            p.vec.iov_len = size;
+            p.in_flight = true;
+
+            uint64_t tag = static_cast<uint64_t>(&p - m_Pages);
+
+            if (!m_Queue->submit_write(tag, m_File, &p.vec, m_FileOffset, ordered))
+            {
+                p.in_flight = false;
+                m_Failed = true;
+                return;
+            }
+
+            ++m_InFlight;
+        }
+
+        void submit_sync()
+        {
+            reserve_slot();
+
+            if (!m_Queue->submit_sync(sync_tag, m_File))
+            {
+                m_Failed = true;
+                return;
+            }
+
+            ++m_InFlight;
+        }
+
+        // A free page other than the current one
+        size_t acquire_page()
+        {
+            for (;;)
+            {
+                for (size_t i = 0; i < BLOGGER_DIRECT_PAGES; i++)
+                {
+                    if (i != m_CurrentPage && !m_Pages[i].in_flight)
+                        return i;
+                }
+
+                complete_one();
+            }
+        }
+
+        void reserve_slot()
+        {
+            while (m_InFlight >= m_Queue->capacity())
+                complete_one();
+        }
+
+        void complete_one()
+        {
+            uint64_t tag;
+            int64_t result;
+
+            // the queue itself broke, nothing is going to complete
+            if (!m_Queue->reap(tag, result, true))
+            {
+                m_Failed = true;
+                m_InFlight = 0;
+
+                for (auto& p : m_Pages)
+                    p.in_flight = false;
+
+                return;
+            }
+
+            --m_InFlight;
+
+            if (result < 0)
+                m_Failed = true;
+
+            if (tag == sync_tag)
+                return;
+
+            page& p = m_Pages[tag];
+
+            if (static_cast<uint64_t>(result) != p.vec.iov_len)
+                m_Failed = true;
+
+            p.in_flight = false;
+        }
+
+        void wait_all()
+        {
+            while (m_InFlight)
+                complete_one();
+        }
+
+        // Cuts off the padding of the last page
+        void trim()
+        {
+            uint64_t size = m_FileOffset + m_Pages[m_CurrentPage].used;
+            int result = ftruncate(m_File, static_cast<off_t>(size));
+            (void)result;
+        }
+
+        static size_t aligned(size_t size)
+        {
+            return (size + BLOGGER_DIRECT_ALIGNMENT - 1) / BLOGGER_DIRECT_ALIGNMENT * BLOGGER_DIRECT_ALIGNMENT;
+        }
+
+        // Returns false if the message should be discarded
+        bool rotate()
+        {
+            size_t next = m_CurrentLogFiles + 1;
+
+            if (m_CurrentLogFiles == m_MaxLogFiles)
+            {
+                if (!m_RotateLogs)
+                    return false;
+
+                next = 1;
+            }
+
+            close_file();
+
+            m_CurrentLogFiles = next;
+            open_file();
+
+            return ok();
+        }
+
+        void open_file()
+        {
+            BLoggerString path;
+            path += m_DirectoryPath;
+            path += m_CachedTag;
+            path += '-';
+            path += std::to_string(m_CurrentLogFiles);
+            path += ".log";
+
+            int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+            m_File = open(path.c_str(), flags | O_DIRECT, 0666);
+
+            if (m_File < 0 && errno == EINVAL)
+                m_File = open(path.c_str(), flags, 0666);
+
+            m_Failed = false;
+            m_FileOffset = 0;
+            m_CurrentBytes = 0;
+            m_Ordered = false;
+            m_Pages[m_CurrentPage].used = 0;
+        }
+
+        void close_file()
+        {
+            if (m_File < 0)
+                return;
+
+            if (!m_Failed)
+                submit_partial();
+
+            wait_all();
+            trim();
+
+            fdatasync(m_File);
+
+            close(m_File);
+            m_File = -1;
+        }
+    };
+}
+#endif
@@ -1,26 +1,81 @@
 #pragma once
 
 #include <stdio.h>
+#include <time.h>
 #include <string>
 #include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <functional>
 
 #include "BLogger/Sinks/BaseSink.h"
+#include "BLogger/Sinks/Housekeeper.h"
 #include "BLogger/OS/Functions.h"
 
 namespace BLogger {
 
+    // Starts a new log file when the local hour/day changes,
+    // in addition to the size limit
+    enum class rotation_interval
+    {
+        none,
+        hourly,
+        daily
+    };
+
+    // Called on the housekeeping thread with the path of a log
+    // file once it's been rotated out, synced and closed,
+    // e.g. to compress or move it.
+    typedef std::function<void(const BLoggerString& path)>
+        rotation_callback;
+
+    // The thread that rotates the log only swaps the file
+    // it writes to. The next file is opened ahead of time
+    // by the housekeeper under a .pending name, so that it
+    // doesn't wipe the file it replaces too early, and gets
+    // renamed once the previous file has been synced and closed,
+    // which is done in the background as well.
     class FileSink : public BaseSink
     {
     private:
-        FILE*         m_File;
-        BLoggerString m_DirectoryPath;
-        BLoggerString m_CachedTag;
-        size_t        m_BytesPerFile;
-        size_t        m_CurrentBytes;
-        size_t        m_MaxLogFiles;
-        size_t        m_CurrentLogFiles;
-        bool          m_RotateLogs;
-        std::mutex    m_FileAccess;
+        struct prepared_file
+        {
+            std::mutex    access;
+            std::condition_variable ready_notifier;
+            BLoggerString path;
+            size_t        index;
+            FILE*         file;
+            bool          ready;
+            bool          abandoned;
+
+            prepared_file(BLoggerString path, size_t index)
+                : access(),
+                path(std::move(path)),
+                index(index),
+                file(nullptr),
+                ready(false),
+                abandoned(false)
+            {
+            }
+        };
+    private:
+        FILE*             m_File;
+        BLoggerString     m_DirectoryPath;
+        BLoggerString     m_CachedTag;
+        BLoggerString     m_CurrentPath;
+        size_t            m_BytesPerFile;
+        size_t            m_CurrentBytes;
+        size_t            m_MaxLogFiles;
+        size_t            m_CurrentLogFiles;
+        bool              m_RotateLogs;
+        rotation_interval m_Interval;
+        time_t            m_NextRotation;
+        bool              m_RotationDue;
+        rotation_callback m_OnRotated;
+        std::mutex        m_FileAccess;
+        bl_string         m_Pending;
+
+        std::shared_ptr<prepared_file> m_Prepared;
 
         typedef std::lock_guard<std::mutex>
             locker;
@@ -30,7 +85,9 @@ namespace BLogger {
             BLoggerInString loggerTag,
             size_t bytesPerFile,
             size_t maxLogFiles,
-            bool rotateLogs = true
+            bool rotateLogs = true,
+            rotation_interval interval = rotation_interval::none,
+            rotation_callback onRotated = nullptr
         ) : m_File(nullptr),
             m_DirectoryPath(directoryPath),
             m_BytesPerFile(bytesPerFile),
@@ -38,7 +95,13 @@ namespace BLogger {
             m_MaxLogFiles(0),
             m_CurrentLogFiles(0),
             m_RotateLogs(rotateLogs),
-            m_FileAccess()
+            m_Interval(interval),
+            m_NextRotation(0),
+            m_RotationDue(false),
+            m_OnRotated(std::move(onRotated)),
+            m_FileAccess(),
+            m_Pending(),
+            m_Prepared()
         {
             m_CachedTag = loggerTag;
 
@@ -51,6 +114,7 @@ namespace BLogger {
             m_DirectoryPath = directoryPath;
             m_DirectoryPath += '/';
 
+            enable_byte_count();
             newLogFile();
         }
 
@@ -60,6 +124,8 @@ namespace BLogger {
             m_CachedTag = tag;
         }
 
+        // Also waits for the background work of the
+        // previous rotations to finish
         void terminate()
         {
             locker lock(m_FileAccess);
@@ -69,6 +135,11 @@ namespace BLogger {
                 fclose(m_File);
                 m_File = nullptr;
             }
+
+            discard_prepared();
+
+            if (rotates())
+                housekeeper::get().wait();
         }
 
         bool ok()
@@ -80,50 +151,68 @@ namespace BLogger {
         {
             size_t size = msg.size();
 
-            locker lock(m_FileAccess);
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
 
             if (!ok())
                 return;
 
-            ++size;
+            check_interval();
 
-            if (m_BytesPerFile && size > m_BytesPerFile)
+            if (!reserve(size + 1))
                 return;
 
-            if (m_BytesPerFile && (m_CurrentBytes + size) > m_BytesPerFile)
+            count_bytes(fwrite(msg.data(), 1, size, m_File));
+        }
+
+        // Coalesces the whole batch into a single fwrite,
+        // splitting it only when the log file is rotated
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            m_Pending.clear();
+
+            check_interval();
+
+            for (size_t i = 0; i < count; i++)
             {
-                if (m_CurrentLogFiles == m_MaxLogFiles)
-                {
-                    if (!m_RotateLogs)
-                        return;
-                    else
-                    {
-                        m_CurrentLogFiles = 1;
-                        m_CurrentBytes = 0;
-                        newLogFile();
-                    }
-                }
-                else
-                {
-                    m_CurrentBytes = 0;
-                    ++m_CurrentLogFiles;
-                    newLogFile();
-                }
-            }
+                size_t size = messages[i]->size();
 
-            m_CurrentBytes += size;
+                if (needs_rotation(size + 1))
+                    write_pending();
+
+                if (!ok())
+                    return;
+
+                if (!reserve(size + 1))
+                    continue;
+
+                m_Pending.insert(
+                    m_Pending.end(),
+                    messages[i]->data(),
+                    messages[i]->data() + size
+                );
+            }
 
-            fwrite(msg.data(), 1, size - 1, m_File);
+            write_pending();
         }
 
         void flush() override
         {
-            locker lock(m_FileAccess);
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
 
             if (m_File)
                 fflush(m_File);
         }
 
+        void sync() override
+        {
+            optional_locker lock(m_FileAccess, !m_SingleWriter);
+
+            if (m_File)
+                sync_file(m_File);
+        }
+
         operator bool()
         {
             return ok();
@@ -131,33 +220,282 @@ namespace BLogger {
 
         ~FileSink()
         {
-            if (m_File)
-                fclose(m_File);
+            terminate();
         }
     private:
+        bool rotates()
+        {
+            return m_BytesPerFile || m_Interval != rotation_interval::none;
+        }
+
+        bool exceeds_size(size_t size)
+        {
+            return m_BytesPerFile && (m_CurrentBytes + size) > m_BytesPerFile;
+        }
+
+        bool needs_rotation(size_t size)
+        {
+            return m_RotationDue || exceeds_size(size);
+        }
+
+        // Checked once per write call instead of per message
+        void check_interval()
+        {
+            if (m_Interval != rotation_interval::none && time(nullptr) >= m_NextRotation)
+                m_RotationDue = true;
+        }
+
+        // Rotates the log file if needed, returns
+        // false if the message should be discarded
+        bool reserve(size_t size)
+        {
+            if (m_BytesPerFile && size > m_BytesPerFile)
+                return false;
+
+            if (needs_rotation(size))
+            {
+                bool full = exceeds_size(size);
+
+                m_RotationDue = false;
+
+                // Past the last file the current one is
+                // kept if it's only the interval that ran out
+                size_t index = next_file_index(m_CurrentLogFiles);
+
+                if (index)
+                {
+                    m_CurrentLogFiles = index;
+                    m_CurrentBytes = 0;
+                    newLogFile();
+                }
+                else if (full)
+                    return false;
+                else
+                    schedule_rotation();
+            }
+
+            m_CurrentBytes += size;
+
+            return ok();
+        }
+
+        size_t next_file_index(size_t current)
+        {
+            if (current == m_MaxLogFiles)
+                return m_RotateLogs ? 1 : 0;
+
+            return current + 1;
+        }
+
+        void write_pending()
+        {
+            if (m_File && !m_Pending.empty())
+                count_bytes(fwrite(m_Pending.data(), 1, m_Pending.size(), m_File));
+
+            m_Pending.clear();
+        }
+
         void constructFullPath(
-            BLoggerString& outPath
+            BLoggerString& outPath,
+            size_t index,
+            bool pending = false
         )
         {
             outPath += m_DirectoryPath;
             outPath += m_CachedTag;
             outPath += '-';
-            outPath += std::to_string(m_CurrentLogFiles);
+            outPath += std::to_string(index);
             outPath += ".log";
+
+            if (pending)
+                outPath += ".pending";
         }
 
         void newLogFile()
         {
-            if (m_File)
+            BLoggerString fullPath;
+            constructFullPath(fullPath, m_CurrentLogFiles);
+
+            BLoggerString pendingPath;
+            FILE* next = take_prepared(m_CurrentLogFiles, pendingPath);
+
+            if (!next)
+                OPEN_FILE(next, fullPath);
+
+            FILE* old = m_File;
+            BLoggerString oldPath = std::move(m_CurrentPath);
+
+            m_File = next;
+            m_CurrentPath = fullPath;
+
+            schedule_rotation();
+
+            // With a single log file the new one replaces the old one,
+            // which has to be closed (and handed to the callback) before
+            // that. Otherwise the rename and the next file go first so
+            // they don't wait for the sync.
+            bool replacesOld = old && oldPath == fullPath;
+
+            if (!replacesOld)
             {
-                fclose(m_File);
-                m_File = nullptr;
+                publish_pending(pendingPath, fullPath);
+                prepare_next();
             }
 
-            BLoggerString fullPath;
-            constructFullPath(fullPath);
+            if (old)
+            {
+                rotation_callback callback;
+
+                // reopened under the same name, the old contents are gone
+                if (!replacesOld || !pendingPath.empty())
+                    callback = m_OnRotated;
+
+                housekeeper::get().post(
+                    [old, oldPath, callback]()
+                    {
+                        sync_file(old);
+                        fclose(old);
+
+                        if (callback)
+                            callback(oldPath);
+                    }
+                );
+            }
+
+            if (replacesOld)
+            {
+                publish_pending(pendingPath, fullPath);
+                prepare_next();
+            }
+        }
+
+        void publish_pending(const BLoggerString& pendingPath, const BLoggerString& path)
+        {
+            if (pendingPath.empty())
+                return;
+
+            housekeeper::get().post(
+                [pendingPath, path]()
+                {
+                    rename(pendingPath.c_str(), path.c_str());
+                }
+            );
+        }
+
+        void schedule_rotation()
+        {
+            if (m_Interval == rotation_interval::none)
+                return;
+
+            time_t now = time(nullptr);
+
+            tm boundary;
+            UPDATE_TIME(boundary, now);
+
+            boundary.tm_min = 0;
+            boundary.tm_sec = 0;
+            boundary.tm_isdst = -1;
+
+            if (m_Interval == rotation_interval::hourly)
+                ++boundary.tm_hour;
+            else
+            {
+                boundary.tm_hour = 0;
+                ++boundary.tm_mday;
+            }
 
-            OPEN_FILE(m_File, fullPath);
+            m_NextRotation = mktime(&boundary);
+        }
+
+        // Asks the housekeeper to open the file that the next
+        // rotation is going to switch to. Windows can't rename
+        // a file that's still open, it's opened inline there.
+        void prepare_next()
+        {
+        #ifndef _WIN32
+            if (!m_File || !rotates())
+                return;
+
+            size_t index = next_file_index(m_CurrentLogFiles);
+
+            if (!index)
+                return;
+
+            BLoggerString path;
+            constructFullPath(path, index, true);
+
+            auto prepared = std::make_shared<prepared_file>(std::move(path), index);
+            m_Prepared = prepared;
+
+            housekeeper::get().post(
+                [prepared]()
+                {
+                    FILE* file = nullptr;
+                    OPEN_FILE(file, prepared->path);
+
+                    locker lock(prepared->access);
+
+                    if (prepared->abandoned)
+                    {
+                        if (file)
+                        {
+                            fclose(file);
+                            remove(prepared->path.c_str());
+                        }
+
+                        return;
+                    }
+
+                    prepared->file = file;
+                    prepared->ready = true;
+                    prepared->ready_notifier.notify_one();
+                }
+            );
+        #endif
+        }
+
+        // Only waits if the housekeeper is behind. Opening the file
+        // inline instead could race with a queued rename to its name.
+        FILE* take_prepared(size_t index, BLoggerString& pendingPath)
+        {
+            if (!m_Prepared || m_Prepared->index != index)
+            {
+                discard_prepared();
+                return nullptr;
+            }
+
+            std::shared_ptr<prepared_file> prepared = std::move(m_Prepared);
+            std::unique_lock<std::mutex> lock(prepared->access);
+
+            prepared->ready_notifier.wait(lock, [&] { return prepared->ready; });
+
+            if (!prepared->file)
+                return nullptr;
+
+            pendingPath = prepared->path;
+
+            return prepared->file;
+        }
+
+        void discard_prepared()
+        {
+            if (!m_Prepared)
+                return;
+
+            std::shared_ptr<prepared_file> prepared = std::move(m_Prepared);
+            locker lock(prepared->access);
+
+            if (!prepared->ready)
+            {
+                prepared->abandoned = true;
+                return;
+            }
+
+            if (prepared->file)
+            {
+                fclose(prepared->file);
+                remove(prepared->path.c_str());
+            }
         }
     };
 }
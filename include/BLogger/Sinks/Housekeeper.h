@@ -0,0 +1,90 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+
+namespace BLogger {
+
+    // A single background thread shared by all sinks that runs
+    // the slow filesystem work, e.g. opening, syncing and closing
+    // log files, off of the threads that write the messages.
+    //
+    // Jobs must not refer to the sink that posted them since
+    // the sink might be destroyed before they run.
+    class housekeeper
+    {
+    private:
+        std::mutex                        m_Access;
+        std::condition_variable           m_Notifier;
+        std::deque<std::function<void()>> m_Jobs;
+        std::thread                       m_Thread;
+    public:
+        // Never destroyed, sinks owned by statics
+        // can still post jobs while the program exits
+        static housekeeper& get()
+        {
+            static housekeeper* instance = new housekeeper();
+            return *instance;
+        }
+
+        void post(std::function<void()> job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Access);
+                m_Jobs.emplace_back(std::move(job));
+            }
+
+            m_Notifier.notify_one();
+        }
+
+        // Blocks until every job posted before the call has run
+        void wait()
+        {
+            std::mutex done_access;
+            std::condition_variable done_notifier;
+            bool done = false;
+
+            post([&]()
+            {
+                std::lock_guard<std::mutex> lock(done_access);
+                done = true;
+                done_notifier.notify_one();
+            });
+
+            std::unique_lock<std::mutex> lock(done_access);
+            done_notifier.wait(lock, [&] { return done; });
+        }
+    private:
+        housekeeper()
+            : m_Access(),
+            m_Notifier(),
+            m_Jobs(),
+            m_Thread(std::bind(&housekeeper::run, this))
+        {
+        }
+
+        housekeeper(const housekeeper& other) = delete;
+        housekeeper& operator=(const housekeeper& other) = delete;
+
+        void run()
+        {
+            for (;;)
+            {
+                std::function<void()> job;
+
+                {
+                    std::unique_lock<std::mutex> lock(m_Access);
+                    m_Notifier.wait(lock, [this] { return !m_Jobs.empty(); });
+
+                    job = std::move(m_Jobs.front());
+                    m_Jobs.pop_front();
+                }
+
+                job();
+            }
+        }
+    };
+}
@@ -0,0 +1,521 @@
+#pragma once
+
+#include "BLogger/Sinks/FileSink.h"
+
+#ifdef _WIN32
+namespace BLogger {
+
+    // Not implemented for windows yet
+    typedef FileSink MappedFileSink;
+}
+#else
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// With BLOGGER_INFINITE bytes per file the
+// file is mapped and extended in windows of this size
+#define BLOGGER_MAPPED_WINDOW_SIZE (32u * 1024u * 1024u)
+#define BLOGGER_MAPPED_SEGMENTS 3
+
+namespace BLogger {
+
+    // A file sink that writes by copying the messages right into
+    // a shared mapping of the log file. Every log file (or window
+    // of BLOGGER_MAPPED_WINDOW_SIZE bytes if the size is unlimited)
+    // is preallocated upfront, writers then reserve their range with
+    // a single fetch_add on the write offset and copy the message
+    // without taking any lock.
+    //
+    // The next log file is opened, preallocated and mapped as soon
+    // as the current one becomes active, under a .pending name so
+    // that rotation doesn't wipe the file it replaces too early.
+    // Switching to it is then just a rename.
+    class MappedFileSink : public BaseSink
+    {
+    private:
+        struct segment
+        {
+            int                 file;
+            bl_char*            mapping;
+            size_t              mapping_size;
+
+            // where inside of the file the mapping starts
+            size_t              file_offset;
+            size_t              file_index;
+
+            // Both are relative to the mapping. limit is the start of
+            // the first reservation that didn't fit, everything before
+            // it is written data.
+            std::atomic<size_t> offset;
+            std::atomic<size_t> limit;
+
+            // Writers currently copying into the mapping.
+            // Never reset, every increment is paired with a decrement.
+            std::atomic<size_t> writers;
+
+            segment()
+                : file(-1),
+                mapping(nullptr),
+                mapping_size(0),
+                file_offset(0),
+                file_index(0),
+                offset(0),
+                limit(0),
+                writers(0)
+            {
+            }
+        };
+    private:
+        BLoggerString           m_DirectoryPath;
+        BLoggerString           m_CachedTag;
+        size_t                  m_BytesPerFile;
+        size_t                  m_MaxLogFiles;
+        bool                    m_RotateLogs;
+        std::mutex              m_SwitchAccess;
+        segment                 m_Segments[BLOGGER_MAPPED_SEGMENTS];
+        size_t                  m_CurrentSegment;
+        std::atomic<segment*>   m_Current;
+        segment*                m_Next;
+
+        typedef std::lock_guard<std::mutex>
+            locker;
+    public:
+        MappedFileSink(
+            BLoggerInString directoryPath,
+            BLoggerInString loggerTag,
+            size_t bytesPerFile,
+            size_t maxLogFiles,
+            bool rotateLogs = true
+        ) : m_DirectoryPath(directoryPath),
+            m_CachedTag(loggerTag),
+            m_BytesPerFile(bytesPerFile),
+            m_MaxLogFiles(maxLogFiles),
+            m_RotateLogs(rotateLogs),
+            m_SwitchAccess(),
+            m_CurrentSegment(0),
+            m_Current(nullptr),
+            m_Next(nullptr)
+        {
+            m_DirectoryPath += '/';
+
+            enable_byte_count();
+
+            segment& first = m_Segments[0];
+
+            if (!open_segment(first, 1, false))
+                return;
+
+            m_Current.store(&first, std::memory_order_release);
+
+            prepare_next();
+        }
+
+        void set_tag(BLoggerInString tag) override
+        {
+            locker lock(m_SwitchAccess);
+            m_CachedTag = tag;
+        }
+
+        void terminate()
+        {
+            locker lock(m_SwitchAccess);
+
+            segment* current = m_Current.exchange(nullptr);
+
+            if (current)
+            {
+                drain(*current);
+                close_segment(*current, true);
+            }
+
+            discard_next();
+        }
+
+        bool ok()
+        {
+            return m_Current.load(std::memory_order_acquire) != nullptr;
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            append(msg.data(), msg.size());
+        }
+
+        // Reserves the space for the whole batch at once
+        // if it fits into the current file
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            size_t total = 0;
+
+            for (size_t i = 0; i < count; i++)
+                total += messages[i]->size();
+
+            segment* seg = acquire();
+
+            if (!seg)
+                return;
+
+            size_t start = seg->offset.fetch_add(total, std::memory_order_relaxed);
+
+            if (start + total <= seg->mapping_size)
+            {
+                bl_char* out = seg->mapping + start;
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    memcpy(out, messages[i]->data(), messages[i]->size());
+                    out += messages[i]->size();
+                }
+
+                count_bytes(total);
+                release(*seg);
+                return;
+            }
+
+            record_limit(*seg, start);
+            release(*seg);
+
+            for (size_t i = 0; i < count; i++)
+                write(*messages[i]);
+        }
+
+        // The data is in the page cache as soon as it's copied,
+        // this only asks the kernel to start writing it back
+        void flush() override
+        {
+            write_back(MS_ASYNC);
+        }
+
+        // Waits for the current file to be written back
+        void sync() override
+        {
+            write_back(MS_SYNC);
+        }
+
+        operator bool()
+        {
+            return ok();
+        }
+
+        ~MappedFileSink()
+        {
+            terminate();
+        }
+    private:
+        void write_back(int flags)
+        {
+            segment* seg = acquire();
+
+            if (!seg)
+                return;
+
+            size_t written = seg->offset.load(std::memory_order_relaxed);
+
+            if (written > seg->mapping_size)
+                written = seg->mapping_size;
+
+            msync(seg->mapping, written, flags);
+
+            release(*seg);
+        }
+
+        size_t max_message_size()
+        {
+            return m_BytesPerFile ? m_BytesPerFile : BLOGGER_MAPPED_WINDOW_SIZE;
+        }
+
+        void append(const bl_char* data, size_t size)
+        {
+            if (size > max_message_size())
+                return;
+
+            for (;;)
+            {
+                segment* seg = acquire();
+
+                if (!seg)
+                    return;
+
+                size_t start = seg->offset.fetch_add(size, std::memory_order_relaxed);
+
+                if (start + size <= seg->mapping_size)
+                {
+                    memcpy(seg->mapping + start, data, size);
+                    count_bytes(size);
+                    release(*seg);
+                    return;
+                }
+
+                record_limit(*seg, start);
+                release(*seg);
+
+                if (!advance(seg))
+                    return;
+            }
+        }
+
+        // Registers the caller as a writer of the current segment.
+        // The segment is rechecked after the increment, which pairs
+        // with the switcher storing the new segment before it waits
+        // for the writers of the old one to leave.
+        segment* acquire()
+        {
+            for (;;)
+            {
+                segment* seg = m_Current.load();
+
+                if (!seg)
+                    return nullptr;
+
+                seg->writers.fetch_add(1);
+
+                if (m_Current.load() == seg)
+                    return seg;
+
+                seg->writers.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        void release(segment& seg)
+        {
+            seg.writers.fetch_sub(1, std::memory_order_release);
+        }
+
+        void record_limit(segment& seg, size_t start)
+        {
+            size_t limit = seg.limit.load(std::memory_order_relaxed);
+
+            while (start < limit &&
+                   !seg.limit.compare_exchange_weak(limit, start, std::memory_order_relaxed));
+        }
+
+        // Must be called after a new segment was published
+        void drain(segment& seg)
+        {
+            while (seg.writers.load())
+                std::this_thread::yield();
+        }
+
+        // Called by a writer that ran out of space in seg,
+        // returns false if nothing can be written anymore
+        bool advance(segment* seg)
+        {
+            locker lock(m_SwitchAccess);
+
+            segment* current = m_Current.load();
+
+            // somebody else already switched
+            if (current != seg)
+                return current != nullptr;
+
+            if (!m_BytesPerFile)
+                return advance_window(*seg);
+
+            segment* next = m_Next;
+            m_Next = nullptr;
+
+            if (!next)
+            {
+                m_Current.store(nullptr);
+                drain(*seg);
+                close_segment(*seg, true);
+
+                return false;
+            }
+
+            publish_pending(*next);
+
+            m_Current.store(next);
+            m_CurrentSegment = static_cast<size_t>(next - m_Segments);
+
+            drain(*seg);
+            close_segment(*seg, true);
+
+            prepare_next();
+
+            return true;
+        }
+
+        // Maps the next window of the same file right after the
+        // data written into the previous one. Its size depends on
+        // where the previous window ended so it can't be mapped
+        // ahead, but the disk space for it already is allocated.
+        bool advance_window(segment& seg)
+        {
+            drain(seg);
+
+            size_t end = seg.file_offset + written_size(seg);
+            segment& next = m_Segments[(m_CurrentSegment + 1) % BLOGGER_MAPPED_SEGMENTS];
+
+            if (!map_window(next, seg.file, seg.file_index, end))
+            {
+                m_Current.store(nullptr);
+                close_segment(seg, true);
+
+                return false;
+            }
+
+            m_Current.store(&next);
+            m_CurrentSegment = static_cast<size_t>(&next - m_Segments);
+
+            close_segment(seg, false);
+
+            return true;
+        }
+
+        size_t written_size(segment& seg)
+        {
+            size_t written = seg.offset.load(std::memory_order_relaxed);
+            size_t limit = seg.limit.load(std::memory_order_relaxed);
+
+            if (limit < written)
+                written = limit;
+
+            return written;
+        }
+
+        size_t next_file_index(size_t current)
+        {
+            if (current == m_MaxLogFiles)
+                return m_RotateLogs ? 1 : 0;
+
+            return current + 1;
+        }
+
+        void prepare_next()
+        {
+            if (!m_BytesPerFile)
+                return;
+
+            segment* current = m_Current.load(std::memory_order_relaxed);
+            size_t index = next_file_index(current->file_index);
+
+            if (!index)
+                return;
+
+            segment& next = m_Segments[(m_CurrentSegment + 1) % BLOGGER_MAPPED_SEGMENTS];
+
+            if (open_segment(next, index, true))
+                m_Next = &next;
+        }
+
+        void discard_next()
+        {
+            if (!m_Next)
+                return;
+
+            BLoggerString path;
+            full_path(path, m_Next->file_index, true);
+
+            close_segment(*m_Next, false);
+            close(m_Next->file);
+            unlink(path.c_str());
+
+            m_Next = nullptr;
+        }
+
+        void publish_pending(segment& next)
+        {
+            BLoggerString pending;
+            BLoggerString path;
+
+            full_path(pending, next.file_index, true);
+            full_path(path, next.file_index, false);
+
+            rename(pending.c_str(), path.c_str());
+        }
+
+        void full_path(BLoggerString& out, size_t index, bool pending)
+        {
+            out += m_DirectoryPath;
+            out += m_CachedTag;
+            out += '-';
+            out += std::to_string(index);
+            out += ".log";
+
+            if (pending)
+                out += ".pending";
+        }
+
+        bool open_segment(segment& seg, size_t index, bool pending)
+        {
+            BLoggerString path;
+            full_path(path, index, pending);
+
+            int file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+            if (file < 0)
+                return false;
+
+            if (!map_window(seg, file, index, 0))
+            {
+                close(file);
+                return false;
+            }
+
+            return true;
+        }
+
+        // Maps max_message_size() bytes of the file starting
+        // at offset, which doesn't have to be page aligned
+        bool map_window(segment& seg, int file, size_t index, size_t offset)
+        {
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t aligned = offset - offset % page;
+            size_t size = max_message_size() + (offset - aligned);
+
+            if (posix_fallocate(file, static_cast<off_t>(aligned), static_cast<off_t>(size)))
+                return false;
+
+            void* mapping = mmap(
+                nullptr, size,
+                PROT_READ | PROT_WRITE, MAP_SHARED,
+                file, static_cast<off_t>(aligned)
+            );
+
+            if (mapping == MAP_FAILED)
+                return false;
+
+            seg.file = file;
+            seg.mapping = static_cast<bl_char*>(mapping);
+            seg.mapping_size = size;
+            seg.file_offset = aligned;
+            seg.file_index = index;
+            seg.offset.store(offset - aligned, std::memory_order_relaxed);
+            seg.limit.store(size, std::memory_order_relaxed);
+
+            return true;
+        }
+
+        // Trims the preallocated space that wasn't written
+        // to and closes the file if asked to
+        void close_segment(segment& seg, bool close_file)
+        {
+            if (!seg.mapping)
+                return;
+
+            size_t end = seg.file_offset + written_size(seg);
+
+            munmap(seg.mapping, seg.mapping_size);
+            seg.mapping = nullptr;
+
+            if (close_file)
+            {
+                int result = ftruncate(seg.file, static_cast<off_t>(end));
+                (void)result;
+
+                close(seg.file);
+            }
+        }
+    };
+}
+#endif
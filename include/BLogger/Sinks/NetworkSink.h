@@ -0,0 +1,510 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "BLogger/Sinks/BaseSink.h"
+#include "BLogger/Formatter/BinaryFormat.h"
+#include "BLogger/OS/Sockets.h"
+
+// How many bytes a single frame can hold, a message that
+// doesn't fit into an empty one is sent in a frame of its own
+#define BLOGGER_NETWORK_DATAGRAM_SIZE 1400u
+#define BLOGGER_NETWORK_FRAME_SIZE (64u * 1024u)
+
+// The default limit of bytes waiting to be sent
+#define BLOGGER_NETWORK_BUFFER_SIZE (4u * 1024u * 1024u)
+
+// Reconnect attempts back off from the first to the second
+#define BLOGGER_NETWORK_MIN_RETRY_MS 100
+#define BLOGGER_NETWORK_MAX_RETRY_MS 5000
+
+// user-level messages
+#define BLOGGER_SYSLOG_FACILITY 1
+
+namespace BLogger {
+
+    enum class network_protocol
+    {
+        udp,
+        tcp
+    };
+
+    enum class network_format
+    {
+        // RFC 5424 messages, one per datagram over udp,
+        // octet counted (RFC 6587) over tcp
+        syslog,
+
+        // Frames of a 4 byte big endian size followed by a
+        // complete binary log (see BinaryFormat.h), which
+        // binary_log_reader decodes on its own
+        binary
+    };
+
+    // Ships the messages off to a collector. Every call only
+    // does what the non-blocking socket allows and keeps the
+    // rest, up to a limit after which new messages are dropped,
+    // so a slow or missing collector never stalls logging.
+    // A broken tcp connection is reestablished with backoff,
+    // whatever is left is sent by the next write or flush.
+    class NetworkSink : public BaseSink
+    {
+    private:
+        BLoggerString    m_CachedTag;
+        BLoggerString    m_AppName;
+        BLoggerString    m_Hostname;
+        BLoggerString    m_ProcessId;
+        network_protocol m_Protocol;
+        network_format   m_Format;
+        size_t           m_MaxBuffered;
+        std::mutex       m_Access;
+
+        socket_address   m_Address;
+        bool             m_Resolved;
+        blogger_socket   m_Socket;
+        bool             m_Connected;
+        std::chrono::milliseconds
+                         m_RetryDelay;
+        std::chrono::steady_clock::time_point
+                         m_NextAttempt;
+
+        // The frame being filled
+        bl_string          m_Frame;
+        size_t             m_FrameMessages;
+        binary_log_encoder m_Encoder;
+
+        // Complete frames waiting to be sent, starting at m_Head,
+        // the first one might have been sent partially
+        bl_string          m_Queue;
+        std::deque<size_t> m_FrameSizes;
+        size_t             m_Head;
+        size_t             m_Sent;
+        uint64_t           m_Dropped;
+
+        typedef std::lock_guard<std::mutex>
+            locker;
+    public:
+        // Resolves the host right away, the sink
+        // drops every message if that fails
+        NetworkSink(
+            BLoggerInString host,
+            uint16_t port,
+            BLoggerInString loggerTag,
+            network_protocol protocol = network_protocol::udp,
+            network_format format = network_format::syslog,
+            size_t maxBuffered = BLOGGER_NETWORK_BUFFER_SIZE
+        ) : m_CachedTag(loggerTag),
+            m_AppName(syslog_name(m_CachedTag.c_str(), 48)),
+            m_Hostname(),
+            m_ProcessId(),
+            m_Protocol(protocol),
+            m_Format(format),
+            m_MaxBuffered(maxBuffered),
+            m_Access(),
+            m_Address(),
+            m_Resolved(false),
+            m_Socket(BLOGGER_INVALID_SOCKET),
+            m_Connected(false),
+            m_RetryDelay(BLOGGER_NETWORK_MIN_RETRY_MS),
+            m_NextAttempt(),
+            m_Frame(),
+            m_FrameMessages(0),
+            m_Encoder(),
+            m_Queue(),
+            m_FrameSizes(),
+            m_Head(0),
+            m_Sent(0),
+            m_Dropped(0)
+        {
+            m_Resolved = resolve_address(
+                BLoggerString(host.data(), host.size()),
+                port,
+                is_stream(),
+                m_Address
+            );
+
+            bl_char hostname[256] = {};
+
+            if (gethostname(hostname, sizeof(hostname) - 1) == 0)
+                m_Hostname = syslog_name(hostname, 255);
+            else
+                m_Hostname = "-";
+
+        #ifdef _WIN32
+            m_ProcessId = std::to_string(GetCurrentProcessId());
+        #else
+            m_ProcessId = std::to_string(getpid());
+        #endif
+        }
+
+        // The messages are encoded from scratch
+        bool wants_raw_messages() override
+        {
+            return true;
+        }
+
+        void set_tag(BLoggerInString tag) override
+        {
+            locker lock(m_Access);
+
+            end_frame();
+
+            m_CachedTag = tag;
+            m_AppName = syslog_name(m_CachedTag.c_str(), 48);
+        }
+
+        bool ok()
+        {
+            return m_Resolved;
+        }
+
+        // Messages dropped because too much was waiting
+        // to be sent or the collector refused them
+        uint64_t dropped()
+        {
+            locker lock(m_Access);
+            return m_Dropped;
+        }
+
+        void write(BLoggerLogMessage& msg) override
+        {
+            BLoggerLogMessage* messages[] = { &msg };
+            write_batch(messages, 1);
+        }
+
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            optional_locker lock(m_Access, !m_SingleWriter);
+
+            if (!ok())
+                return;
+
+            for (size_t i = 0; i < count; i++)
+                add(*messages[i]);
+
+            end_frame();
+            send_pending();
+        }
+
+        // Sends whatever the socket takes without waiting
+        void flush() override
+        {
+            optional_locker lock(m_Access, !m_SingleWriter);
+
+            if (!ok())
+                return;
+
+            end_frame();
+            send_pending();
+        }
+
+        operator bool()
+        {
+            return ok();
+        }
+
+        ~NetworkSink()
+        {
+            if (ok())
+            {
+                end_frame();
+                send_pending();
+            }
+
+            if (m_Socket != BLOGGER_INVALID_SOCKET)
+                close_socket(m_Socket);
+        }
+    private:
+        bool is_stream()
+        {
+            return m_Protocol == network_protocol::tcp;
+        }
+
+        void add(BLoggerLogMessage& msg)
+        {
+            if (m_Format == network_format::syslog)
+            {
+                m_Frame.clear();
+                put_syslog(msg);
+                commit(m_Frame.data(), m_Frame.size());
+                m_Frame.clear();
+                return;
+            }
+
+            size_t limit = is_stream() ? BLOGGER_NETWORK_FRAME_SIZE : BLOGGER_NETWORK_DATAGRAM_SIZE;
+
+            if (!m_FrameMessages)
+                begin_frame();
+
+            auto point = m_Encoder.save(m_Frame);
+            m_Encoder.put_message(m_Frame, msg);
+
+            if (m_FrameMessages && m_Frame.size() + 4 > limit)
+            {
+                // The record might define formats, every
+                // frame has to be decodable on its own
+                m_Encoder.restore(m_Frame, point);
+                end_frame();
+
+                begin_frame();
+                m_Encoder.put_message(m_Frame, msg);
+            }
+
+            ++m_FrameMessages;
+        }
+
+        void begin_frame()
+        {
+            m_Frame.clear();
+            m_Encoder.reset();
+            m_Encoder.put_header(m_Frame, m_CachedTag);
+        }
+
+        void end_frame()
+        {
+            if (!m_FrameMessages)
+                return;
+
+            commit(m_Frame.data(), m_Frame.size());
+
+            m_Frame.clear();
+            m_FrameMessages = 0;
+        }
+
+        // Queues a frame along with its size prefix
+        void commit(const bl_char* data, size_t size)
+        {
+            bl_char prefix[16];
+            size_t prefix_size = 0;
+
+            if (m_Format == network_format::binary)
+            {
+                uint32_t length = static_cast<uint32_t>(size);
+
+                prefix[0] = static_cast<bl_char>(length >> 24);
+                prefix[1] = static_cast<bl_char>(length >> 16);
+                prefix[2] = static_cast<bl_char>(length >> 8);
+                prefix[3] = static_cast<bl_char>(length);
+                prefix_size = 4;
+            }
+            else if (is_stream())
+                prefix_size = static_cast<size_t>(snprintf(prefix, sizeof(prefix), "%zu ", size));
+
+            if (m_Queue.size() - m_Head + prefix_size + size > m_MaxBuffered)
+            {
+                m_Dropped += m_Format == network_format::binary ? m_FrameMessages : 1;
+                return;
+            }
+
+            m_Queue.insert(m_Queue.end(), prefix, prefix + prefix_size);
+            m_Queue.insert(m_Queue.end(), data, data + size);
+            m_FrameSizes.push_back(prefix_size + size);
+        }
+
+        void send_pending()
+        {
+            while (!m_FrameSizes.empty() && connected())
+            {
+                size_t size = m_FrameSizes.front();
+                const bl_char* frame = m_Queue.data() + m_Head;
+
+                // A datagram can't be sent partially, the
+                // collector refusing it just drops it
+                if (!is_stream())
+                {
+                    int64_t sent = send_some(m_Socket, frame, size);
+
+                    if (sent == 0)
+                        break;
+
+                    if (sent < 0)
+                        ++m_Dropped;
+
+                    pop_frame();
+                    continue;
+                }
+
+                int64_t sent = send_some(m_Socket, frame + m_Sent, size - m_Sent);
+
+                if (sent < 0)
+                {
+                    disconnect();
+                    break;
+                }
+
+                if (sent == 0)
+                    break;
+
+                m_Sent += static_cast<size_t>(sent);
+
+                if (m_Sent == size)
+                    pop_frame();
+            }
+
+            // Keeps the queue from growing while
+            // the collector is just slow
+            if (m_Head && m_Head >= m_Queue.size() / 2)
+            {
+                m_Queue.erase(m_Queue.begin(), m_Queue.begin() + static_cast<std::ptrdiff_t>(m_Head));
+                m_Head = 0;
+            }
+        }
+
+        void pop_frame()
+        {
+            m_Head += m_FrameSizes.front();
+            m_Sent = 0;
+            m_FrameSizes.pop_front();
+
+            if (m_FrameSizes.empty())
+            {
+                m_Queue.clear();
+                m_Head = 0;
+            }
+        }
+
+        // Starts/finishes connecting, returns true once sending is possible
+        bool connected()
+        {
+            if (m_Socket != BLOGGER_INVALID_SOCKET)
+            {
+                if (m_Connected)
+                    return true;
+
+                socket_status status = check_connected(m_Socket);
+
+                if (status == socket_status::failed)
+                    disconnect();
+
+                if (status != socket_status::done)
+                    return false;
+
+                m_Connected = true;
+                m_RetryDelay = std::chrono::milliseconds(BLOGGER_NETWORK_MIN_RETRY_MS);
+                return true;
+            }
+
+            if (std::chrono::steady_clock::now() < m_NextAttempt)
+                return false;
+
+            m_Socket = open_socket(m_Address, is_stream());
+
+            if (m_Socket == BLOGGER_INVALID_SOCKET)
+            {
+                disconnect();
+                return false;
+            }
+
+            if (!is_stream())
+            {
+                m_Connected = true;
+                return true;
+            }
+
+            return connected();
+        }
+
+        void disconnect()
+        {
+            if (m_Socket != BLOGGER_INVALID_SOCKET)
+                close_socket(m_Socket);
+
+            m_Socket = BLOGGER_INVALID_SOCKET;
+            m_Connected = false;
+
+            // The collector only understands whole frames
+            if (m_Sent)
+            {
+                ++m_Dropped;
+                pop_frame();
+            }
+
+            m_NextAttempt = std::chrono::steady_clock::now() + m_RetryDelay;
+            m_RetryDelay *= 2;
+
+            if (m_RetryDelay.count() > BLOGGER_NETWORK_MAX_RETRY_MS)
+                m_RetryDelay = std::chrono::milliseconds(BLOGGER_NETWORK_MAX_RETRY_MS);
+        }
+
+        // <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD MSG
+        void put_syslog(BLoggerLogMessage& msg)
+        {
+            bl_char header[64];
+
+            int size = snprintf(header, sizeof(header), "<%d>1 ",
+                BLOGGER_SYSLOG_FACILITY * 8 + syslog_severity(msg.log_level())
+            );
+
+            m_Frame.insert(m_Frame.end(), header, header + size);
+
+            put_timestamp(to_wall_clock_ns(msg.log_timestamp()));
+
+            m_Frame.push_back(' ');
+            m_Frame.insert(m_Frame.end(), m_Hostname.begin(), m_Hostname.end());
+            m_Frame.push_back(' ');
+
+            m_Frame.insert(m_Frame.end(), m_AppName.begin(), m_AppName.end());
+            m_Frame.push_back(' ');
+
+            m_Frame.insert(m_Frame.end(), m_ProcessId.begin(), m_ProcessId.end());
+
+            // no MSGID or STRUCTURED-DATA
+            static constexpr char nil[] = " - - ";
+            m_Frame.insert(m_Frame.end(), nil, nil + sizeof(nil) - 1);
+
+            size_t begin = m_Frame.size();
+
+            if (msg.is_deferred() || msg.has_fields())
+            {
+                BLoggerMessageBuffer text = msg.message_text();
+                m_Frame.insert(m_Frame.end(), text.data(), text.data() + text.size());
+            }
+            else
+                m_Frame.insert(m_Frame.end(), msg.data(), msg.data() + msg.size());
+
+            while (m_Frame.size() > begin && (m_Frame.back() == '\n' || m_Frame.back() == '\r'))
+                m_Frame.pop_back();
+        }
+
+        void put_timestamp(int64_t wall_ns)
+        {
+            bl_char text[BLOGGER_RFC3339_SIZE];
+            timestamp_cache::render_rfc3339(wall_ns, text);
+
+            m_Frame.insert(m_Frame.end(), text, text + sizeof(text));
+        }
+
+        static int syslog_severity(level lvl)
+        {
+            switch (lvl)
+            {
+            case level::crit:  return 2;
+            case level::error: return 3;
+            case level::warn:  return 4;
+            case level::info:  return 6;
+            default:           return 7;
+            }
+        }
+
+        // Header fields are printable ascii without spaces
+        static BLoggerString syslog_name(const bl_char* name, size_t max_size)
+        {
+            BLoggerString out;
+
+            for (; *name && out.size() < max_size; name++)
+            {
+                bl_char c = *name;
+                out.push_back(c > 32 && c < 127 ? c : '_');
+            }
+
+            if (out.empty())
+                out = "-";
+
+            return out;
+        }
+    };
+}
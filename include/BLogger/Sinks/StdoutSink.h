@@ -28,6 +28,19 @@ namespace BLogger {
             );
         }
 
+        void write_batch(BLoggerLogMessage* const* messages, size_t count) override
+        {
+            locker lock(s_GlobalWrite);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                std::cout.write(
+                    messages[i]->data(),
+                    messages[i]->size()
+                );
+            }
+        }
+
         void flush() override
         {
             locker lock(s_GlobalWrite);
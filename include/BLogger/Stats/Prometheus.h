@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BLogger/Formatter/FormatUtilities.h"
+#include "BLogger/Loggers/AsyncLogger.h"
+#include "BLogger/Stats/Stats.h"
+
+namespace BLogger {
+
+    // Renders the stats of the pools and sinks added to it in the
+    // Prometheus text format, for an endpoint of the application
+    // to return on every scrape. Nothing is exported on its own,
+    // collecting only reads the counters, so it can be called
+    // from any thread while logging goes on.
+    class prometheus_exporter
+    {
+    private:
+        typedef std::pair<BLoggerString, thread_pool*>                pool_entry;
+        typedef std::pair<BLoggerString, std::shared_ptr<sink_stats>> sink_entry;
+    private:
+        std::mutex              m_Lock;
+        std::vector<pool_entry> m_Pools;
+        std::vector<sink_entry> m_Sinks;
+    public:
+        prometheus_exporter() = default;
+
+        prometheus_exporter(const prometheus_exporter& other) = delete;
+        prometheus_exporter& operator=(const prometheus_exporter& other) = delete;
+
+        // Exported with pool="name", e.g. add_pool("audit", thread_pool::get("audit"))
+        void add_pool(BLoggerInString name, thread_pool* pool)
+        {
+            BLoggerString labels;
+            append_label(labels, "pool", name);
+
+            std::lock_guard<std::mutex> locker(m_Lock);
+            m_Pools.emplace_back(std::move(labels), pool);
+        }
+
+        // Exported with sink="name"
+        void add_sink(BLoggerInString name, BaseSink& sink)
+        {
+            BLoggerString labels;
+            append_label(labels, "sink", name);
+
+            std::lock_guard<std::mutex> locker(m_Lock);
+            m_Sinks.emplace_back(std::move(labels), sink.stats());
+        }
+
+        // Every sink the logger has at this point, exported
+        // with logger="name" and sink="N" (the order they
+        // were added in)
+        void add_logger(BLoggerInString name, const BaseLogger& logger)
+        {
+            auto stats = logger.SinkStats();
+
+            std::lock_guard<std::mutex> locker(m_Lock);
+
+            for (size_t i = 0; i < stats.size(); i++)
+            {
+                BLoggerString labels;
+                append_label(labels, "logger", name);
+                labels.push_back(',');
+                append_label(labels, "sink", std::to_string(i));
+
+                m_Sinks.emplace_back(std::move(labels), std::move(stats[i]));
+            }
+        }
+
+        BLoggerString collect()
+        {
+            std::lock_guard<std::mutex> locker(m_Lock);
+
+            BLoggerString out;
+
+            std::vector<thread_pool_stats> pools;
+            pools.reserve(m_Pools.size());
+
+            for (auto& pool : m_Pools)
+                pools.push_back(pool.second->stats());
+
+            write_pool_metric(out, pools, "blogger_queue_capacity", "gauge",
+                "Message slots in the queue of the pool.",
+                [](const thread_pool_stats& s) { return static_cast<uint64_t>(s.queue_capacity); });
+            write_pool_metric(out, pools, "blogger_queue_depth", "gauge",
+                "Messages waiting in the queue of the pool.",
+                [](const thread_pool_stats& s) { return static_cast<uint64_t>(s.queue_depth); });
+            write_pool_metric(out, pools, "blogger_queue_high_water_mark", "gauge",
+                "The most messages the backend has found in the queue.",
+                [](const thread_pool_stats& s) { return static_cast<uint64_t>(s.high_water_mark); });
+            write_pool_metric(out, pools, "blogger_backend_threads", "gauge",
+                "Backend threads of the pool.",
+                [](const thread_pool_stats& s) { return static_cast<uint64_t>(s.workers); });
+            write_pool_metric(out, pools, "blogger_messages_posted_total", "counter",
+                "Messages posted to the queue of the pool.",
+                [](const thread_pool_stats& s) { return s.posted; });
+            write_pool_metric(out, pools, "blogger_messages_dropped_total", "counter",
+                "Messages dropped or sampled out by the overflow policy.",
+                [](const thread_pool_stats& s) { return s.dropped; });
+            write_pool_metric(out, pools, "blogger_messages_written_total", "counter",
+                "Messages the backend handed to the sinks.",
+                [](const thread_pool_stats& s) { return s.written; });
+
+            write_sink_metric(out, "blogger_sink_messages_total",
+                "Messages written by the sink.",
+                [](const sink_stats& s) { return s.messages.load(std::memory_order_relaxed); });
+
+            // only for the sinks that count them
+            write_sink_metric(out, "blogger_sink_bytes_written_total",
+                "Bytes written to disk by the sink.",
+                [](const sink_stats& s) { return s.bytes_written.load(std::memory_order_relaxed); },
+                true);
+
+            write_sink_histogram(out, "blogger_sink_write_seconds",
+                "The latency of every write call of the sink.",
+                [](const sink_stats& s) { return s.write_latency.snapshot(); });
+            write_sink_histogram(out, "blogger_sink_flush_seconds",
+                "The latency of every flush call of the sink.",
+                [](const sink_stats& s) { return s.flush_latency.snapshot(); });
+
+            return out;
+        }
+    private:
+        // name="value" with the value escaped as the format wants it
+        static void append_label(BLoggerString& out, const bl_char* name, BLoggerInString value)
+        {
+            out.append(name);
+            out.append("=\"");
+
+            for (bl_char c : value)
+            {
+                if (c == '\\' || c == '"')
+                {
+                    out.push_back('\\');
+                    out.push_back(c);
+                }
+                else if (c == '\n')
+                    out.append("\\n");
+                else
+                    out.push_back(c);
+            }
+
+            out.push_back('"');
+        }
+
+        static void write_header(BLoggerString& out, const bl_char* name, const bl_char* type, const bl_char* help)
+        {
+            out.append("# HELP ").append(name).push_back(' ');
+            out.append(help).push_back('\n');
+            out.append("# TYPE ").append(name).push_back(' ');
+            out.append(type).push_back('\n');
+        }
+
+        static void write_sample(BLoggerString& out, const bl_char* name, const BLoggerString& labels, uint64_t value)
+        {
+            out.append(name).push_back('{');
+            out.append(labels).append("} ");
+            out.append(std::to_string(value)).push_back('\n');
+        }
+
+        static void write_seconds(BLoggerString& out, uint64_t ns)
+        {
+            bl_char text[32];
+            int size = snprintf(text, sizeof(text), "%.9g", static_cast<double>(ns) / 1e9);
+
+            out.append(text, static_cast<size_t>(size));
+        }
+
+        template<typename GetterT>
+        void write_pool_metric(
+            BLoggerString& out,
+            const std::vector<thread_pool_stats>& stats,
+            const bl_char* name,
+            const bl_char* type,
+            const bl_char* help,
+            GetterT get)
+        {
+            if (stats.empty())
+                return;
+
+            write_header(out, name, type, help);
+
+            // m_Pools and stats are in the same order
+            for (size_t i = 0; i < stats.size(); i++)
+                write_sample(out, name, m_Pools[i].first, get(stats[i]));
+        }
+
+        template<typename GetterT>
+        void write_sink_metric(
+            BLoggerString& out,
+            const bl_char* name,
+            const bl_char* help,
+            GetterT get,
+            bool byte_counts = false)
+        {
+            bool any = false;
+
+            for (auto& sink : m_Sinks)
+            {
+                if (byte_counts && !sink.second->counts_bytes)
+                    continue;
+
+                if (!any)
+                    write_header(out, name, "counter", help);
+
+                any = true;
+                write_sample(out, name, sink.first, get(*sink.second));
+            }
+        }
+
+        // The buckets are cumulative in this format, the
+        // last one of latency_histogram becomes +Inf
+        template<typename GetterT>
+        void write_sink_histogram(BLoggerString& out, const bl_char* name, const bl_char* help, GetterT get)
+        {
+            if (m_Sinks.empty())
+                return;
+
+            write_header(out, name, "histogram", help);
+
+            for (auto& sink : m_Sinks)
+            {
+                histogram_snapshot snapshot = get(*sink.second);
+                uint64_t seen = 0;
+
+                for (size_t i = 0; i < BLOGGER_LATENCY_BUCKETS; i++)
+                {
+                    seen += snapshot.buckets[i];
+
+                    out.append(name).append("_bucket{");
+                    out.append(sink.first).append(",le=\"");
+
+                    if (i == BLOGGER_LATENCY_BUCKETS - 1)
+                        out.append("+Inf");
+                    else
+                        write_seconds(out, histogram_snapshot::bucket_bound(i));
+
+                    out.append("\"} ").append(std::to_string(seen)).push_back('\n');
+                }
+
+                out.append(name).append("_sum{");
+                out.append(sink.first).append("} ");
+                write_seconds(out, snapshot.sum_ns);
+                out.push_back('\n');
+
+                out.append(name).append("_count{");
+                out.append(sink.first).append("} ");
+                out.append(std::to_string(snapshot.count)).push_back('\n');
+            }
+        }
+    };
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "BLogger/OS/Functions.h"
+
+#define BLOGGER_STAT_STRIPES 16
+
+// Bucket N counts durations below 2^N nanoseconds,
+// the last one everything that's longer
+#define BLOGGER_LATENCY_BUCKETS 32
+
+namespace BLogger {
+
+    // A counter that many threads add to without sharing a cache
+    // line: every thread gets one of BLOGGER_STAT_STRIPES stripes
+    // and load sums all of them up, so reading is the slow part
+    class striped_counter
+    {
+    private:
+        struct stripe
+        {
+            std::atomic<uint64_t> value;
+            char                  pad[BLOGGER_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+        };
+    private:
+        stripe m_Stripes[BLOGGER_STAT_STRIPES];
+    public:
+        striped_counter()
+        {
+            for (auto& s : m_Stripes)
+                s.value.store(0, std::memory_order_relaxed);
+        }
+
+        striped_counter(const striped_counter& other) = delete;
+        striped_counter& operator=(const striped_counter& other) = delete;
+
+        void add(uint64_t count = 1)
+        {
+            m_Stripes[stripe_index()].value.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        uint64_t load() const
+        {
+            uint64_t sum = 0;
+
+            for (auto& s : m_Stripes)
+                sum += s.value.load(std::memory_order_relaxed);
+
+            return sum;
+        }
+    private:
+        // handed out round robin as threads show up
+        static size_t stripe_index()
+        {
+            static std::atomic<size_t> next(0);
+            static thread_local size_t index =
+                next.fetch_add(1, std::memory_order_relaxed) % BLOGGER_STAT_STRIPES;
+
+            return index;
+        }
+    };
+
+    // Raises value to at least candidate
+    template<typename T>
+    void atomic_raise(std::atomic<T>& value, T candidate)
+    {
+        T current = value.load(std::memory_order_relaxed);
+
+        while (current < candidate &&
+               !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // A snapshot of a latency_histogram
+    struct histogram_snapshot
+    {
+        uint64_t buckets[BLOGGER_LATENCY_BUCKETS];
+        uint64_t count;
+        uint64_t sum_ns;
+
+        // The upper bound of bucket index in nanoseconds
+        static uint64_t bucket_bound(size_t index)
+        {
+            return static_cast<uint64_t>(1) << index;
+        }
+
+        // An upper bound of the given quantile (0 to 1), i.e.
+        // the bound of the bucket it falls into
+        uint64_t quantile_ns(double quantile) const
+        {
+            uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(count));
+            uint64_t seen = 0;
+
+            for (size_t i = 0; i < BLOGGER_LATENCY_BUCKETS; i++)
+            {
+                seen += buckets[i];
+
+                if (seen > rank)
+                    return bucket_bound(i);
+            }
+
+            return bucket_bound(BLOGGER_LATENCY_BUCKETS - 1);
+        }
+    };
+
+    // Durations in power of two buckets, recording one is
+    // a couple of relaxed increments on the recording thread
+    class latency_histogram
+    {
+    private:
+        std::atomic<uint64_t> m_Buckets[BLOGGER_LATENCY_BUCKETS];
+        std::atomic<uint64_t> m_Count;
+        std::atomic<uint64_t> m_Sum;
+    public:
+        latency_histogram()
+            : m_Count(0),
+            m_Sum(0)
+        {
+            for (auto& bucket : m_Buckets)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+
+        latency_histogram(const latency_histogram& other) = delete;
+        latency_histogram& operator=(const latency_histogram& other) = delete;
+
+        void record(uint64_t ns)
+        {
+            size_t index = 0;
+
+            while (index < BLOGGER_LATENCY_BUCKETS - 1 && ns >= histogram_snapshot::bucket_bound(index))
+                index++;
+
+            m_Buckets[index].fetch_add(1, std::memory_order_relaxed);
+            m_Count.fetch_add(1, std::memory_order_relaxed);
+            m_Sum.fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        histogram_snapshot snapshot() const
+        {
+            histogram_snapshot out;
+
+            // the count is the sum of the buckets that were read, so
+            // that it always matches them even while recording goes on
+            out.count = 0;
+
+            for (size_t i = 0; i < BLOGGER_LATENCY_BUCKETS; i++)
+            {
+                out.buckets[i] = m_Buckets[i].load(std::memory_order_relaxed);
+                out.count += out.buckets[i];
+            }
+
+            out.sum_ns = m_Sum.load(std::memory_order_relaxed);
+
+            return out;
+        }
+    };
+
+    // Times a sink call into a histogram
+    class latency_timer
+    {
+    private:
+        latency_histogram&                    m_Histogram;
+        std::chrono::steady_clock::time_point m_Begin;
+    public:
+        explicit latency_timer(latency_histogram& histogram)
+            : m_Histogram(histogram),
+            m_Begin(std::chrono::steady_clock::now())
+        {
+        }
+
+        latency_timer(const latency_timer& other) = delete;
+        latency_timer& operator=(const latency_timer& other) = delete;
+
+        ~latency_timer()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - m_Begin;
+
+            m_Histogram.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()
+            ));
+        }
+    };
+
+    // Kept by every sink and shared with whoever exports them,
+    // so it can outlive the sink. Only the calls the loggers
+    // make (see BaseSink::write_filtered) are timed.
+    struct sink_stats
+    {
+        // one sample per write/write_batch call
+        latency_histogram     write_latency;
+        latency_histogram     flush_latency;
+        std::atomic<uint64_t> messages;
+
+        // only counted by the sinks that write files (compressed
+        // bytes for CompressedFileSink), those set counts_bytes
+        // before they're added to a logger, see BaseSink::count_bytes
+        std::atomic<uint64_t> bytes_written;
+        bool                  counts_bytes;
+
+        sink_stats()
+            : messages(0),
+            bytes_written(0),
+            counts_bytes(false)
+        {
+        }
+    };
+
+    // A snapshot of the counters of a thread_pool
+    struct thread_pool_stats
+    {
+        size_t   queue_capacity;
+        size_t   queue_depth;
+        size_t   high_water_mark;
+        uint64_t posted;
+        uint64_t dropped;
+        uint64_t written;
+        uint16_t workers;
+    };
+}